@@ -2,6 +2,7 @@ Project( externals = '../externals', paths = [ '../externals/src' ] )
 
 Include( 'demo' )
 Include( 'relight' )
+Include( 'benchmark' )
 
 Module( url = 'https://github.com/dmsovetov/foo.git',        folder = '../externals/src' )
 Module( url = 'https://github.com/dmsovetov/dreemchest.git', folder = '../externals/src', makefile = 'src' )
@@ -0,0 +1,552 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#include <Relight.h>
+#include <rt/Tracer.h>
+
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace relight;
+
+//! Lightmap size of each benchmark mesh.
+const int k_LightmapSize = 128;
+
+//! Amount of quads along each side of a benchmark mesh.
+const int k_GridSize = 32;
+
+//! Amount of benchmark meshes.
+const int k_MeshCount = 8;
+
+//! Lightmap size of a crypt tomb and ground.
+const int k_CryptLightmapSize = 256;
+
+//! Lightmap size of each crypt gravestone.
+const int k_GravestoneLightmapSize = 64;
+
+//! A scale applied to crypt mesh positions.
+const float k_CryptScale = 0.005f;
+
+//! Amount of ambient occlusion samples per lumel.
+const int k_AmbientOcclusionSamples = 32;
+
+//! Amount of random segments traced to measure a tracer throughput.
+const int k_TracerSegments = 1 << 18;
+
+//! Bakes direct light and ambient occlusion to a mesh.
+class BenchmarkJob : public Job {
+public:
+
+    //! Constructs a BenchmarkJob instance.
+    BenchmarkJob( int rayBatchSize = 0 )
+        : m_ambientOcclusion( AmbientOcclusionSettings::fast() )
+    {
+        m_ambientOcclusion.m_samples      = k_AmbientOcclusionSamples;
+        m_ambientOcclusion.m_rayBatchSize = rayBatchSize;
+
+        // ** Adaptive sampling is disabled, so each lumel traces the same amount of rays
+        m_ambientOcclusion.m_tolerance    = 0.0f;
+    }
+
+    //! Executes a job.
+    virtual void execute( JobData* data )
+    {
+        data->m_relight->bakeDirectLight( data->m_scene, data->m_mesh, data->m_worker, data->m_iterator );
+        data->m_relight->bakeAmbientOcclusion( data->m_scene, data->m_mesh, data->m_worker, m_ambientOcclusion, data->m_iterator );
+    }
+
+    //! Returns a cost estimator used to schedule this job.
+    virtual BakeCostEstimator costEstimator( void ) const
+    {
+        BakeCostEstimator estimator;
+        estimator.setAmbientOcclusion( m_ambientOcclusion );
+        return estimator;
+    }
+
+private:
+
+    AmbientOcclusionSettings m_ambientOcclusion;
+};
+
+// ** createSkewedGrid
+//! Creates a grid of quads with lightmap columns of a cubic growing width, so faces differ a lot in lumel count.
+Mesh* createSkewedGrid( int size, float extent )
+{
+    VertexBuffer vertices;
+    IndexBuffer  indices;
+
+    for( int y = 0; y <= size; y++ ) {
+        for( int x = 0; x <= size; x++ ) {
+            float u = x / float( size );
+            float v = y / float( size );
+
+            Vertex vertex;
+            vertex.position                   = Vec3( u * extent, 0.0f, v * extent );
+            vertex.normal                     = Vec3( 0.0f, 1.0f, 0.0f );
+            vertex.uv[Vertex::Diffuse]        = Uv( u, v );
+            vertex.uv[Vertex::Lightmap]       = Uv( 0.01f + 0.98f * u * u * u, 0.01f + 0.98f * v );
+            vertex.material                   = NULL;
+            vertices.push_back( vertex );
+        }
+    }
+
+    for( int y = 0; y < size; y++ ) {
+        for( int x = 0; x < size; x++ ) {
+            Index i = y * (size + 1) + x;
+
+            indices.push_back( i );
+            indices.push_back( i + size + 1 );
+            indices.push_back( i + 1 );
+
+            indices.push_back( i + 1 );
+            indices.push_back( i + size + 1 );
+            indices.push_back( i + size + 2 );
+        }
+    }
+
+    Mesh* mesh = Mesh::create();
+    mesh->addFaces( vertices, indices );
+
+    return mesh;
+}
+
+// ** createGroundPlane
+//! Creates a square ground plane centered at origin.
+Mesh* createGroundPlane( float size )
+{
+    VertexBuffer vertices;
+    IndexBuffer  indices;
+
+    for( int i = 0; i < 4; i++ ) {
+        float u = float( i == 1 || i == 2 );
+        float v = float( i >= 2 );
+
+        Vertex vertex;
+        vertex.position                   = Vec3( (u - 0.5f) * size, 0.0f, (v - 0.5f) * size );
+        vertex.normal                     = Vec3( 0.0f, 1.0f, 0.0f );
+        vertex.uv[Vertex::Diffuse]        = Uv( u * size, v * size );
+        vertex.uv[Vertex::Lightmap]       = Uv( u * 0.99f, v * 0.99f );
+        vertex.material                   = NULL;
+        vertices.push_back( vertex );
+    }
+
+    indices.push_back( 0 );
+    indices.push_back( 2 );
+    indices.push_back( 1 );
+
+    indices.push_back( 0 );
+    indices.push_back( 3 );
+    indices.push_back( 2 );
+
+    Mesh* mesh = Mesh::create();
+    mesh->addFaces( vertices, indices );
+
+    return mesh;
+}
+
+// ** readString
+//! Reads a length prefixed string from a crypt mesh file.
+bool readString( FILE* file, String& value )
+{
+    unsigned int length = 0;
+
+    if( fread( &length, sizeof( length ), 1, file ) != 1 ) {
+        return false;
+    }
+
+    value.resize( length );
+
+    return length == 0 || fread( &value[0], length, 1, file ) == 1;
+}
+
+// ** loadMesh
+//! Loads a crypt mesh file used by a lightmapping demo, a Z-up mesh is rotated to be Y-up and scaled to scene units. Returns NULL if a file failed to load.
+Mesh* loadMesh( const String& fileName )
+{
+    //! A vertex layout of a crypt mesh file.
+    struct MeshVertex {
+        Vec3    position;
+        Vec3    normal;
+        Vec3    tangent;
+        Uv      diffuse;
+        Uv      lightmap;
+    };
+
+    FILE* file = fopen( fileName.c_str(), "rb" );
+
+    if( !file ) {
+        return NULL;
+    }
+
+    unsigned int header[3] = { 0, 0, 0 };   // ** Magic, bone count and submesh count
+    bool         success   = fread( header, sizeof( header ), 1, file ) == 1 && header[1] == 0;
+    Mesh*        mesh      = Mesh::create();
+
+    for( unsigned int i = 0; success && i < header[2]; i++ ) {
+        String       name, material, declaration;
+        unsigned int counts[3] = { 0, 0, 0 };   // ** Vertex count, vertex stride and index count
+
+        success = readString( file, name ) && readString( file, material ) && readString( file, declaration )
+               && fread( counts, sizeof( counts ), 1, file ) == 1 && counts[1] == sizeof( MeshVertex );
+
+        if( !success ) {
+            break;
+        }
+
+        Array<MeshVertex>     meshVertices;
+        Array<unsigned short> meshIndices;
+
+        meshVertices.resize( counts[0] );
+        meshIndices.resize( counts[2] );
+
+        success = ( counts[0] == 0 || fread( &meshVertices[0], sizeof( MeshVertex ), counts[0], file ) == counts[0] )
+               && ( counts[2] == 0 || fread( &meshIndices[0], sizeof( unsigned short ), counts[2], file ) == counts[2] );
+
+        if( !success ) {
+            break;
+        }
+
+        VertexBuffer vertices;
+        IndexBuffer  indices;
+
+        for( unsigned int j = 0; j < counts[0]; j++ ) {
+            const MeshVertex& source = meshVertices[j];
+
+            Vertex vertex;
+            vertex.position                   = Vec3( source.position.x, source.position.z, -source.position.y ) * k_CryptScale;
+            vertex.normal                     = Vec3( source.normal.x, source.normal.z, -source.normal.y );
+            vertex.uv[Vertex::Diffuse]        = source.diffuse;
+            vertex.uv[Vertex::Lightmap]       = source.lightmap;
+            vertex.material                   = NULL;
+            vertices.push_back( vertex );
+        }
+
+        for( unsigned int j = 0; j < counts[2]; j++ ) {
+            indices.push_back( meshIndices[j] );
+        }
+
+        mesh->addFaces( vertices, indices );
+    }
+
+    fclose( file );
+
+    if( !success ) {
+        delete mesh;
+        return NULL;
+    }
+
+    return mesh;
+}
+
+//! Benchmark scene with all objects allocated for it.
+struct BenchmarkScene {
+    Scene*                  m_scene;        //!< Relight scene.
+    Array<Mesh*>            m_prototypes;   //!< Meshes instanced by scene meshes.
+    Array<Mesh*>            m_meshes;       //!< Scene mesh instances.
+    Array<Lightmap*>        m_lightmaps;    //!< Mesh lightmaps.
+    Array<Light*>           m_lights;       //!< Scene lights.
+};
+
+// ** addInstance
+//! Adds a mesh instance with it's own lightmap to a benchmark scene.
+void addInstance( Relight* relight, BenchmarkScene& benchmark, Mesh* prototype, const Matrix4& transform, int lightmapSize )
+{
+    Mesh*     mesh     = benchmark.m_scene->addMesh( prototype, transform );
+    Lightmap* lightmap = relight->createLightmap( lightmapSize, lightmapSize );
+    lightmap->addMesh( mesh );
+
+    benchmark.m_meshes.push_back( mesh );
+    benchmark.m_lightmaps.push_back( lightmap );
+}
+
+// ** createCryptScene
+//! Creates a crypt scene laid out the same way as a lightmapping demo does: a tomb surrounded by gravestones lit by a directional light. Returns false if crypt meshes failed to load.
+bool createCryptScene( Relight* relight, TracerBackend backend, const String& path, BenchmarkScene& benchmark )
+{
+    Mesh* tomb       = loadMesh( path + "/Tomb05_c.mesh" );
+    Mesh* gravestone = loadMesh( path + "/Gravestone01.mesh" );
+
+    if( !tomb || !gravestone ) {
+        delete tomb;
+        delete gravestone;
+        return false;
+    }
+
+    Mesh* ground = createGroundPlane( 10.0f );
+
+    benchmark.m_scene = relight->createScene( backend );
+    benchmark.m_prototypes.push_back( tomb );
+    benchmark.m_prototypes.push_back( gravestone );
+    benchmark.m_prototypes.push_back( ground );
+
+    benchmark.m_scene->begin();
+
+    Vec3 direction = Vec3( 0.0f, 2.0f, 0.0f ) - Vec3( 1.5f, 4.5f, 1.5f );
+    direction.normalize();
+
+    Light* light = Light::createDirectionalLight( direction, Rgb( 0.75f, 0.74609375f, 0.67578125f ), 3.0f );
+    benchmark.m_scene->addLight( light );
+    benchmark.m_lights.push_back( light );
+
+    addInstance( relight, benchmark, tomb, Matrix4::translation( 0.0f, 0.0f, 0.0f ), k_CryptLightmapSize );
+    addInstance( relight, benchmark, ground, Matrix4::translation( 0.0f, 0.0f, 0.0f ), k_CryptLightmapSize );
+
+    for( int i = -2; i <= 2; i++ ) {
+        for( int j = -2; j <= 2; j++ ) {
+            if( i == 0 && j == 0 ) {
+                continue;
+            }
+
+            addInstance( relight, benchmark, gravestone, Matrix4::translation( i * 1.4f, 0.0f, j * 1.4f ), k_GravestoneLightmapSize );
+        }
+    }
+
+    benchmark.m_scene->end();
+
+    return true;
+}
+
+// ** createGridScene
+//! Creates a benchmark scene of stacked skewed grids lit by a set of point lights.
+void createGridScene( Relight* relight, TracerBackend backend, BenchmarkScene& benchmark )
+{
+    Mesh* grid = createSkewedGrid( k_GridSize, 10.0f );
+
+    benchmark.m_scene = relight->createScene( backend );
+    benchmark.m_prototypes.push_back( grid );
+
+    benchmark.m_scene->begin();
+
+    for( int i = 0; i < k_MeshCount; i++ ) {
+        addInstance( relight, benchmark, grid, Matrix4::translation( float( i % 2 ) * 3.0f, float( i ) * 1.5f, 0.0f ), k_LightmapSize );
+    }
+
+    for( int i = 0; i < 4; i++ ) {
+        Light* light = Light::createPointLight( Vec3( 2.0f + i * 2.0f, k_MeshCount * 1.5f + 2.0f, 5.0f ), 30.0f );
+        benchmark.m_scene->addLight( light );
+        benchmark.m_lights.push_back( light );
+    }
+
+    benchmark.m_scene->end();
+}
+
+// ** destroyScene
+//! Destroys a benchmark scene, prototypes are deleted last, because scene meshes are instances sharing their geometry.
+void destroyScene( BenchmarkScene& benchmark )
+{
+    delete benchmark.m_scene;
+
+    for( int i = 0, n = ( int )benchmark.m_meshes.size(); i < n; i++ ) {
+        delete benchmark.m_meshes[i];
+    }
+
+    for( int i = 0, n = ( int )benchmark.m_lightmaps.size(); i < n; i++ ) {
+        delete benchmark.m_lightmaps[i];
+    }
+
+    for( int i = 0, n = ( int )benchmark.m_lights.size(); i < n; i++ ) {
+        delete benchmark.m_lights[i];
+    }
+
+    for( int i = 0, n = ( int )benchmark.m_prototypes.size(); i < n; i++ ) {
+        delete benchmark.m_prototypes[i];
+    }
+}
+
+// ** bakeScene
+//! Bakes a scene with a given amount of threads, a tile size and an occlusion ray batch size and returns the elapsed time in seconds, the amount of shadow and occlusion rays traced per second is written to a rayRate.
+double bakeScene( Relight* relight, Scene* scene, int threadCount, int tileSize, int rayBatchSize, double& rayRate )
+{
+    WorkerPool   pool( threadCount );
+    BenchmarkJob job( rayBatchSize );
+
+    Statistics::reset();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    relight->bake( scene, &job, &pool, BakeGlobalTaskSet, tileSize );
+    double time = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    rayRate = ( Statistics::total( RayShadow ).m_rays + Statistics::total( RayAmbientOcclusion ).m_rays ) / time;
+
+    return time;
+}
+
+// ** traceSegments
+//! Traces random segments inside a scene bounds with a scene tracer and returns the amount of rays per second for closest hit and occlusion queries.
+void traceSegments( const Scene* scene, double& traceRate, double& testRate )
+{
+    Array<rt::Segment> segments;
+    Random             random;
+    const Bounds&      bounds = scene->bounds();
+    Vec3               size   = bounds.max() - bounds.min();
+
+    segments.resize( k_TracerSegments );
+
+    for( int i = 0; i < k_TracerSegments; i++ ) {
+        Vec3 start = bounds.min() + Vec3( random.next0to1() * size.x, random.next0to1() * size.y, random.next0to1() * size.z );
+        Vec3 end   = bounds.min() + Vec3( random.next0to1() * size.x, random.next0to1() * size.y, random.next0to1() * size.z );
+        segments[i] = rt::Segment( start, end, rt::HitAll );
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scene->tracer()->traceSegments( &segments[0], k_TracerSegments );
+    traceRate = k_TracerSegments / std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    start = std::chrono::steady_clock::now();
+    scene->tracer()->testSegments( &segments[0], k_TracerSegments );
+    testRate = k_TracerSegments / std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// ** main
+int main( int argc, char** argv )
+{
+    int    maxThreads   = max2( argc > 1 ? atoi( argv[1] ) : ( int )std::thread::hardware_concurrency(), 1 );
+    String cryptPath    = argc > 2 ? argv[2] : "data/crypt";
+    int    tileSizes[]  = { 0, 8, 16, 32 };
+    int    batchSizes[] = { 0, 1024, 4096, 16384 };
+
+    Relight* relight = Relight::create();
+
+    // ** Statistics wrap a scene tracer to count traced rays, so they are enabled before scenes are built
+    Statistics::enable();
+
+    // ** Each backend has a single crypt and grid scene reused by all measurements
+    TracerBackend  backends[]     = { TracerEmbree, TracerBvh };
+    const char*    backendNames[] = { "embree", "bvh" };
+    const int      backendCount   = int( sizeof( backends ) / sizeof( backends[0] ) );
+    BenchmarkScene crypt[backendCount];
+    BenchmarkScene grid[backendCount];
+    int            cryptCount     = 0;
+
+    for( int i = 0; i < backendCount; i++ ) {
+        if( cryptCount == i && createCryptScene( relight, backends[i], cryptPath, crypt[i] ) ) {
+            cryptCount++;
+        }
+
+        createGridScene( relight, backends[i], grid[i] );
+    }
+
+    if( cryptCount < backendCount ) {
+        printf( "Failed to load crypt meshes from '%s', only a skewed grid scene is benchmarked.\n\n", cryptPath.c_str() );
+    }
+
+    // ** The crypt scene is the main case, the skewed grid is an extra one with faces that differ a lot in lumel count
+    const char*     sceneNames[] = { "crypt", "grid" };
+    BenchmarkScene* scenes[]     = { cryptCount == backendCount ? crypt : NULL, grid };
+    const int       sceneCount   = int( sizeof( scenes ) / sizeof( scenes[0] ) );
+
+    // ** Compare tracer backends
+    printf( "%-8s %-10s %12s %12s %10s %12s\n", "scene", "tracer", "trace, Mr/s", "test, Mr/s", "bake, s", "bake, Mr/s" );
+
+    for( int i = 0; i < sceneCount; i++ ) {
+        if( !scenes[i] ) {
+            continue;
+        }
+
+        for( int j = 0; j < backendCount; j++ ) {
+            double traceRate = 0.0;
+            double testRate  = 0.0;
+            double bakeRate  = 0.0;
+
+            traceSegments( scenes[i][j].m_scene, traceRate, testRate );
+            double time = bakeScene( relight, scenes[i][j].m_scene, maxThreads, 16, 0, bakeRate );
+
+            printf( "%-8s %-10s %12.2f %12.2f %10.3f %12.2f\n", sceneNames[i], backendNames[j], traceRate * 1e-6, testRate * 1e-6, time, bakeRate * 1e-6 );
+        }
+    }
+
+    printf( "\n" );
+
+    // ** Compare occlusion rays traced per lumel with ones deferred to coherence sorted batches
+    printf( "%-8s %-10s %8s %10s %12s %8s\n", "scene", "tracer", "batch", "time, s", "bake, Mr/s", "speedup" );
+
+    for( int i = 0; i < sceneCount; i++ ) {
+        if( !scenes[i] ) {
+            continue;
+        }
+
+        for( int j = 0; j < backendCount; j++ ) {
+            double immediate = 0.0;
+
+            for( int k = 0; k < int( sizeof( batchSizes ) / sizeof( batchSizes[0] ) ); k++ ) {
+                double rayRate = 0.0;
+                double time    = bakeScene( relight, scenes[i][j].m_scene, maxThreads, 16, batchSizes[k], rayRate );
+
+                if( batchSizes[k] == 0 ) {
+                    immediate = rayRate;
+                }
+
+                printf( "%-8s %-10s %8d %10.3f %12.2f %8.2f\n", sceneNames[i], backendNames[j], batchSizes[k], time, rayRate * 1e-6, rayRate / immediate );
+            }
+        }
+    }
+
+    printf( "\n" );
+
+    // ** Measure bake scaling on a skewed grid with a default tracer, because it's uneven faces stress the scheduling most
+    Scene* scene = grid[0].m_scene;
+
+    printf( "%-10s %8s %10s %12s %8s\n", "iterator", "threads", "time, s", "bake, Mr/s", "speedup" );
+
+    for( int i = 0; i < int( sizeof( tileSizes ) / sizeof( tileSizes[0] ) ); i++ ) {
+        char name[32];
+
+        if( tileSizes[i] > 0 ) {
+            sprintf( name, "tile %d", tileSizes[i] );
+        } else {
+            sprintf( name, "striding" );
+        }
+
+        double single = 0.0;
+
+        for( int threads = 1; threads <= maxThreads; threads *= 2 ) {
+            double rayRate = 0.0;
+            double time    = bakeScene( relight, scene, threads, tileSizes[i], 0, rayRate );
+
+            if( threads == 1 ) {
+                single = time;
+            }
+
+            printf( "%-10s %8d %10.3f %12.2f %8.2f\n", name, threads, time, rayRate * 1e-6, single / time );
+        }
+    }
+
+    for( int i = 0; i < backendCount; i++ ) {
+        if( i < cryptCount ) {
+            destroyScene( crypt[i] );
+        }
+
+        destroyScene( grid[i] );
+    }
+
+    Statistics::disable();
+
+    delete relight;
+
+    return 0;
+}
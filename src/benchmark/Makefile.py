@@ -0,0 +1 @@
+benchmark = Executable( 'benchmark', sources = [ '.' ], paths = [ '../relight' ], link = [ 'relight' ] )
@@ -280,21 +280,25 @@ Lightmapping::Lightmapping( renderer::Hal* hal ) : m_hal( hal )
 		#endif
         }
 
+        virtual relight::BakeCostEstimator costEstimator( void ) const {
+            relight::BakeCostEstimator estimator;
+		#if BAKE_INDIRECT
+            estimator.setIndirectLight( m_indirect );
+		#endif
+            return estimator;
+        }
+
 	private:
 
 		relight::IndirectLightSettings m_indirect;
     };
 
-    typedef ThreadWorker LmWorker;
-
-    // ** Bake scene
-    m_rootWorker = new LmWorker;
-    for( int i = 0; i < k_Workers; i++ ) {
-        m_relightWorkers.push_back( new LmWorker );
-    }
+    // ** Bake scene in background, the root worker runs a bake job on a pool thread
+    m_workerPool = new relight::WorkerPool( k_Workers, new LightmapProgress );
+    m_rootWorker = new relight::PooledWorker( m_workerPool );
 
 	const Rgb kSkyColor( 0.86f, 0.93f, 1.0f );
-	m_relight->bake( m_relightScene, new Bake( relight::IndirectLightSettings::production( m_scene->settings()->ambient()/*kSkyColor*/, Rgb(0, 0, 0), 100, 500 ) ), m_rootWorker, m_relightWorkers );
+	m_relight->bake( m_relightScene, new Bake( relight::IndirectLightSettings::production( m_scene->settings()->ambient()/*kSkyColor*/, Rgb(0, 0, 0), 100, 500 ) ), m_rootWorker, m_workerPool->workers() );
 #endif
 }
 
@@ -475,8 +479,17 @@ void Lightmapping::createBuffersFromMesh( SceneMesh& mesh )
     }
     mesh.m_vertexBuffer->unlock();
 
+    // ** Renderer index buffers are 16-bit, so indices are narrowed when Relight is built with 32-bit ones
+    if( mesh.m_mesh->vertexCount() > 0x10000 ) {
+        printf( "Mesh has %d vertices, which can't be addressed by 16-bit renderer indices\n", mesh.m_mesh->vertexCount() );
+        assert( false );
+    }
+
     mesh.m_indexBuffer = m_hal->createIndexBuffer( mesh.m_mesh->indexCount(), false );
-    memcpy( mesh.m_indexBuffer->lock(), mesh.m_mesh->indexBuffer(), mesh.m_mesh->indexCount() * sizeof( relight::Index ) );
+    unsigned short* indices = ( unsigned short* )mesh.m_indexBuffer->lock();
+    for( int i = 0; i < mesh.m_mesh->indexCount(); i++ ) {
+        indices[i] = static_cast<unsigned short>( mesh.m_mesh->index( i ) );
+    }
     mesh.m_indexBuffer->unlock();
 }
 
@@ -615,35 +628,14 @@ void Lightmapping::handleUpdate( platform::Window* window )
     m_hal->present();
 }
 
-// ** ThreadWorker::worker
-void ThreadWorker::worker( void* userData )
-{
-    relight::JobData* data = reinterpret_cast<relight::JobData*>( userData );
-    data->m_job->execute( data );
-    delete data;
-}
-
-// ** ThreadWorker::ThreadWorker
-ThreadWorker::ThreadWorker( void )
-{
-}
-
-// ** ThreadWorker::push
-void ThreadWorker::push( relight::Job* job, relight::JobData* data )
+// ** LightmapProgress::notify
+void LightmapProgress::notify( const relight::Mesh* instance, int step, int stepCount )
 {
-    data->m_worker = this;
-	m_thread = thread::Thread::create();
-	m_thread->start( dcThisMethod( ThreadWorker::worker ), data );
-}
-
-// ** ThreadWorker::wait
-void ThreadWorker::wait( void )
-{
-	m_thread->wait();
+    reinterpret_cast<SceneMeshInstance*>( instance->userData() )->m_dirty = true;
 }
 
-// ** ThreadWorker::notify
-void ThreadWorker::notify( const relight::Mesh* instance, int step, int stepCount )
+// ** LightmapProgress::notifyEta
+void LightmapProgress::notifyEta( float elapsed, float remaining, float fraction )
 {
-    reinterpret_cast<SceneMeshInstance*>( instance->userData() )->m_dirty = true;
+    printf( "%2.1f%% baked, %2.1fs elapsed, %2.1fs left\n", fraction * 100.0f, elapsed, remaining );
 }
\ No newline at end of file
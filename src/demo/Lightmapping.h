@@ -53,36 +53,12 @@ struct SceneMeshInstance {
     bool                        m_dirty;
 };
 
-//! Relight background worker.
-class ThreadWorker : public relight::Worker {
+//! Marks mesh instances as dirty while they are baked.
+class LightmapProgress : public relight::Progress {
 public:
 
-                    //! Constructs a ThreadWorker instance.
-                    ThreadWorker( void );
-
-    //! Pushes a new job to this worker.
-    virtual void    push( relight::Job* job, relight::JobData* data );
-
-    //! Waits for completion of this worker.
-    virtual void    wait( void );
-
     virtual void    notify( const relight::Mesh* instance, int step, int stepCount );
-
-private:
-
-    //! Thread worker callback.
-    static void     worker( void* userData );
-
-private:
-
-    //! Thread worker data
-    struct ThreadData {
-        relight::JobData*   m_data;
-        relight::Progress*  m_progress;
-    };
-
-    //! Thread handle.
-	thread::Thread*	m_thread;
+    virtual void    notifyEta( float elapsed, float remaining, float fraction );
 };
 
 // ** class Lightmapping
@@ -123,8 +99,8 @@ private:
 
     relight::Relight*               m_relight;
     relight::Scene*                 m_relightScene;
+    relight::WorkerPool*            m_workerPool;
     relight::Worker*                m_rootWorker;
-    relight::Workers                m_relightWorkers;
 
     Meshes                          m_meshes;
     Textures                        m_textures;
@@ -27,6 +27,7 @@
 #include "BuildCheck.h"
 
 #include "Lightmap.h"
+#include "Worker.h"
 #include "scene/Mesh.h"
 
 namespace relight {
@@ -110,7 +111,7 @@ void Lightmap::initializeLumels( const Mesh* mesh )
 {
     // ** For each face in a sub mesh
     for( int i = 0, n = mesh->faceCount(); i < n; i++ ) {
-        initializeLumels( mesh->face( i ) );
+        initializeLumels( mesh, mesh->face( i ) );
     }
 }
 
@@ -130,7 +131,7 @@ void Lightmap::rect( const Rect& uv, int& x1, int& y1, int& x2, int& y2 ) const
 }
 
 // ** Lightmap::initializeLumels
-void Lightmap::initializeLumels( const Face& face )
+void Lightmap::initializeLumels( const Mesh* mesh, const Face& face )
 {
 	// ** Get the UV bounding rect
 	s32 uStart, uEnd, vStart, vEnd;
@@ -148,17 +149,17 @@ void Lightmap::initializeLumels( const Face& face )
                 continue;
             }
 
-            initializeLumel( lumel, face, barycentric );
+            initializeLumel( lumel, mesh, face, barycentric );
         }
     }
 }
 
 // ** Lightmap::initializeLumel
-void Lightmap::initializeLumel( Lumel& lumel, const Face& face, const Uv& barycentric )
+void Lightmap::initializeLumel( Lumel& lumel, const Mesh* mesh, const Face& face, const Uv& barycentric )
 {
     lumel.m_faceIdx     = face.faceIdx();
-    lumel.m_position    = face.positionAt( barycentric );
-    lumel.m_normal      = face.normalAt( barycentric );
+    lumel.m_position    = mesh->worldPosition( face.positionAt( barycentric ) );
+    lumel.m_normal      = mesh->worldNormal( face.normalAt( barycentric ) );
     lumel.m_color       = Rgb( 0, 0, 0 );
     lumel.m_flags       = lumel.m_flags | Lumel::Valid;
 }
@@ -375,43 +376,149 @@ RelightStatus Photonmap::addMesh( const Mesh* mesh, bool copyVertexColor )
 // ** Photonmap::gather
 void Photonmap::gather( int radius )
 {
+    Worker  worker;
+    Workers workers;
+    workers.push_back( &worker );
+
+    gather( radius, 0, workers );
+}
+
+// ** Photonmap::gather
+void Photonmap::gather( int radius, int minPhotons, const Workers& workers )
+{
+    Array<PhotonSum> sums;
+    buildSums( sums );
+
+    // ** Gathers photons to a band of rows
+    class GatherJob : public Job {
+    public:
+
+                        GatherJob( Photonmap* photonmap, const Array<PhotonSum>& sums, int first, int last, int radius, int minPhotons )
+                            : m_photonmap( photonmap ), m_sums( sums ), m_first( first ), m_last( last ), m_radius( radius ), m_minPhotons( minPhotons ) {}
+
+        virtual void    execute( JobData* ) { m_photonmap->gatherRows( m_sums, m_first, m_last, m_radius, m_minPhotons ); }
+
+    private:
+
+        Photonmap*              m_photonmap;
+        const Array<PhotonSum>& m_sums;
+        int                     m_first;
+        int                     m_last;
+        int                     m_radius;
+        int                     m_minPhotons;
+    };
+
+    // ** Split rows into bands, so each worker gets a few of them
+    int                 bandCount = max2( min2( ( int )workers.size() * 4, m_height ), 1 );
+    int                 rows      = (m_height + bandCount - 1) / bandCount;
+    Array<GatherJob*>   jobs;
+
+    for( int y = 0, i = 0; y < m_height; y += rows, i++ ) {
+        GatherJob* job = new GatherJob( this, sums, y, min2( y + rows, m_height ), radius, minPhotons );
+        jobs.push_back( job );
+
+        JobData* data = new JobData;
+        data->m_job   = job;
+        workers[i % workers.size()]->push( job, data );
+    }
+
+    for( int i = 0; i < ( int )workers.size(); i++ ) {
+        workers[i]->wait();
+    }
+
+    for( int i = 0; i < ( int )jobs.size(); i++ ) {
+        delete jobs[i];
+    }
+}
+
+// ** Photonmap::buildSums
+void Photonmap::buildSums( Array<PhotonSum>& sums ) const
+{
+    int stride = m_width + 1;
+
+    // ** The first row and column are zero, so there is no need to check bounds when summing
+    PhotonSum zero = { 0.0, 0.0, 0.0, 0.0 };
+    sums.assign( stride * (m_height + 1), zero );
+
     for( int y = 0; y < m_height; y++ ) {
-        for( int x = 0; x < m_height; x++ ) {
-            lumel( x, y ).m_gathered = gather( x, y, radius );
+        PhotonSum row = zero;
+
+        for( int x = 0; x < m_width; x++ ) {
+            const Lumel&     lumel = m_lumels[y * m_width + x];
+            const PhotonSum& above = sums[y * stride + x + 1];
+            PhotonSum&       entry = sums[(y + 1) * stride + x + 1];
+
+            row.r       += lumel.m_color.r;
+            row.g       += lumel.m_color.g;
+            row.b       += lumel.m_color.b;
+            row.photons += lumel.m_photons;
+
+            entry.r       = above.r       + row.r;
+            entry.g       = above.g       + row.g;
+            entry.b       = above.b       + row.b;
+            entry.photons = above.photons + row.photons;
         }
     }
 }
 
-// ** Photonmap::gather
-Rgb Photonmap::gather( int x, int y, int radius ) const
+// ** Photonmap::sum
+double Photonmap::sum( const Array<PhotonSum>& sums, int x1, int y1, int x2, int y2, Rgb* color ) const
 {
-    Rgb color;
-    int photons = 0;
+    int stride = m_width + 1;
 
-    for( int j = y - radius; j <= y + radius; j++ ) {
-        for( int i = x - radius; i <= x + radius; i++ ) {
-            if( i < 0 || j < 0 || i >= m_width || j >= m_height ) {
-                continue;
-            }
+    const PhotonSum& a = sums[y1 * stride + x1];
+    const PhotonSum& b = sums[y1 * stride + x2 + 1];
+    const PhotonSum& c = sums[(y2 + 1) * stride + x1];
+    const PhotonSum& d = sums[(y2 + 1) * stride + x2 + 1];
 
-            const Lumel& lumel = m_lumels[j * m_width + i];
-            float distance = sqrtf( static_cast<float>( (x - i) * (x - i) + (y - j) * (y - j) ) );
-            if( distance > radius ) {
-                continue;
-            }
+    if( color ) {
+        *color = Rgb( static_cast<float>( d.r - b.r - c.r + a.r ), static_cast<float>( d.g - b.g - c.g + a.g ), static_cast<float>( d.b - b.b - c.b + a.b ) );
+    }
+
+    return d.photons - b.photons - c.photons + a.photons;
+}
 
-            color   += lumel.m_color;
-            photons += lumel.m_photons;
+// ** Photonmap::gather
+Rgb Photonmap::gather( const Array<PhotonSum>& sums, int x, int y, int radius, int minPhotons ) const
+{
+    // ** Find the smallest radius that covers the requested amount of photons
+    if( minPhotons > 0 ) {
+        int lo = 0;
+        int hi = radius;
+
+        while( lo < hi ) {
+            int r = (lo + hi) / 2;
+
+            if( sum( sums, max2( x - r, 0 ), max2( y - r, 0 ), min2( x + r, m_width - 1 ), min2( y + r, m_height - 1 ), NULL ) >= minPhotons ) {
+                hi = r;
+            } else {
+                lo = r + 1;
+            }
         }
+
+        radius = lo;
     }
 
-    if( photons == 0 ) {
+    Rgb    color;
+    double photons = sum( sums, max2( x - radius, 0 ), max2( y - radius, 0 ), min2( x + radius, m_width - 1 ), min2( y + radius, m_height - 1 ), &color );
+
+    if( photons <= 0.0 ) {
         return Rgb( 0.0f, 0.0f, 0.0f );
     }
 
     return color / static_cast<float>( photons );
 }
 
+// ** Photonmap::gatherRows
+void Photonmap::gatherRows( const Array<PhotonSum>& sums, int first, int last, int radius, int minPhotons )
+{
+    for( int y = first; y < last; y++ ) {
+        for( int x = 0; x < m_width; x++ ) {
+            lumel( x, y ).m_gathered = gather( sums, x, y, radius, minPhotons );
+        }
+    }
+}
+
 // ------------------------------------------------ Radiancemap ------------------------------------------------ //
 
 // ** Radiancemap::Radiancemap
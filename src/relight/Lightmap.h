@@ -59,6 +59,8 @@ namespace relight {
     friend class Relight;
     public:
 
+        virtual                 ~Lightmap( void ) {}
+
         //! Returns a lightmap width
         int                     width( void ) const;
 
@@ -128,11 +130,11 @@ namespace relight {
         //! Initializes all lumels corresponding to a given mesh.
         void                    initializeLumels( const Mesh* mesh );
 
-        //! Initializes all lumels corresponsing to a given face.
-        void                    initializeLumels( const Face& face );
+        //! Initializes all lumels corresponsing to a given mesh face.
+        void                    initializeLumels( const Mesh* mesh, const Face& face );
 
-        //! Initializes a given face lumel.
-        void                    initializeLumel( Lumel& lumel, const Face& face, const Uv& barycentric );
+        //! Initializes a given face lumel, mesh instances have lumels transformed to a world space.
+        void                    initializeLumel( Lumel& lumel, const Mesh* mesh, const Face& face, const Uv& barycentric );
 
         //! Fills invalid lumel.
         void                    fillInvalidAt( int x, int y, const Rgb& color );
@@ -157,16 +159,43 @@ namespace relight {
         //! Does a gathering of photons for all lumels.
         void                    gather( int radius );
 
+        //! Does a gathering of photons for all lumels using a set of workers.
+        /*!
+         Photons are gathered from a square window around each lumel with a help of a summed
+         area table, so a gather cost does not depend on a radius. Lightmap rows are split
+         between workers.
+
+         \param radius Maximum gather radius.
+         \param minPhotons When positive, the radius of each lumel is reduced to the smallest one that covers this amount of photons.
+         \param workers Workers to gather photons on.
+         */
+        void                    gather( int radius, int minPhotons, const Workers& workers );
+
         //! Adds an instance to this photonmap.
         virtual RelightStatus   addMesh( const Mesh* mesh, bool copyVertexColor = false );
 
     private:
 
+        //! Summed area table entry.
+        struct PhotonSum {
+            double              r, g, b;    //!< Total photon color.
+            double              photons;    //!< Total amount of photons.
+        };
+
                                 //! Constructs a new Photonmap instance
                                 Photonmap( int width, int height );
 
+        //! Builds a summed area table of photon colors and counts.
+        void                    buildSums( Array<PhotonSum>& sums ) const;
+
+        //! Sums photons inside a rectangle, returns the amount of photons.
+        double                  sum( const Array<PhotonSum>& sums, int x1, int y1, int x2, int y2, Rgb* color ) const;
+
         //! Gathers surrounding photons to lumel
-        Rgb                     gather( int x, int y, int radius ) const;
+        Rgb                     gather( const Array<PhotonSum>& sums, int x, int y, int radius, int minPhotons ) const;
+
+        //! Gathers photons to a given range of lightmap rows.
+        void                    gatherRows( const Array<PhotonSum>& sums, int first, int last, int radius, int minPhotons );
     };
 
 	//! Radiance map is for creating a radiosity patches from it.
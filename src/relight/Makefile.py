@@ -1,2 +1,9 @@
-relight = StaticLibrary( 'relight', sources = [ '.', 'baker', 'scene', 'rt' ], defines = [ 'RELIGHT_BUILD_LIBRARY' ] )
-relight.linkExternal( Library( 'embree2', True ) )
\ No newline at end of file
+import os
+
+# Embree ray tracer backend is linked unless RELIGHT_USE_EMBREE=0 is set, the built-in BVH tracer is used without it
+useEmbree = os.environ.get( 'RELIGHT_USE_EMBREE', '1' ) != '0'
+
+relight = StaticLibrary( 'relight', sources = [ '.', 'baker', 'scene', 'rt' ], defines = [ 'RELIGHT_BUILD_LIBRARY' ] + ( [] if useEmbree else [ 'RELIGHT_USE_EMBREE=0' ] ) )
+
+if useEmbree:
+	relight.linkExternal( Library( 'embree2', True ) )
@@ -0,0 +1,202 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#include "BuildCheck.h"
+
+#include "Progressive.h"
+#include "Lightmap.h"
+#include "scene/Scene.h"
+#include "scene/Mesh.h"
+#include "baker/Baker.h"
+
+namespace relight {
+
+// ** ProgressiveBake::ProgressiveBake
+ProgressiveBake::ProgressiveBake( Relight* relight, const Scene* scene, Job* job ) : m_relight( relight ), m_scene( scene ), m_job( job ), m_pass( 0 ), m_stopped( false )
+{
+    reset();
+}
+
+// ** ProgressiveBake::reset
+void ProgressiveBake::reset( void )
+{
+    m_accumulators.clear();
+    m_meshes.clear();
+
+    for( int i = 0, n = m_scene->meshCount(); i < n; i++ ) {
+        const Mesh* mesh     = m_scene->mesh( i );
+        Lightmap*   lightmap = mesh->lightmap();
+
+        m_meshes[mesh] = MeshState();
+
+        if( !lightmap ) {
+            continue;
+        }
+
+        Accumulator& accumulator = m_accumulators[lightmap];
+        accumulator.m_sums.assign( lightmap->width() * lightmap->height(), Rgb( 0, 0, 0 ) );
+        accumulator.m_counts.assign( lightmap->width() * lightmap->height(), 0 );
+    }
+}
+
+// ** ProgressiveBake::passCount
+int ProgressiveBake::passCount( void ) const
+{
+    int count = -1;
+
+    for( MeshStates::const_iterator i = m_meshes.begin(), end = m_meshes.end(); i != end; ++i ) {
+        count = count < 0 ? i->second.m_passes : min2( count, i->second.m_passes );
+    }
+
+    return max2( count, 0 );
+}
+
+// ** ProgressiveBake::passCount
+int ProgressiveBake::passCount( const Mesh* mesh ) const
+{
+    MeshStates::const_iterator i = m_meshes.find( mesh );
+    return i != m_meshes.end() ? i->second.m_passes : 0;
+}
+
+// ** ProgressiveBake::stop
+void ProgressiveBake::stop( void )
+{
+    m_stopped = true;
+}
+
+// ** ProgressiveBake::pass
+void ProgressiveBake::pass( WorkerPool* pool, BakeScheduling scheduling, int tileSize )
+{
+    // ** Meshes that have completed this pass before it was stopped are skipped
+    m_pass    = passCount();
+    m_stopped = false;
+
+    for( MeshStates::iterator i = m_meshes.begin(), end = m_meshes.end(); i != end; ++i ) {
+        i->second.m_started = false;
+    }
+
+    // ** Bakers accumulate lights to lumel colors, so lumels are cleared before a pass
+    for( Accumulators::iterator i = m_accumulators.begin(), end = m_accumulators.end(); i != end; ++i ) {
+        Lumel* lumels = i->first->lumels();
+
+        for( int j = 0, n = i->first->width() * i->first->height(); j < n; j++ ) {
+            lumels[j].m_color = Rgb( 0, 0, 0 );
+        }
+    }
+
+    m_relight->bake( m_scene, this, pool, scheduling, tileSize );
+
+    for( MeshStates::iterator i = m_meshes.begin(), end = m_meshes.end(); i != end; ++i ) {
+        if( !i->second.m_started ) {
+            continue;
+        }
+
+        accumulate( i->first );
+        i->second.m_passes++;
+    }
+
+    resolve();
+}
+
+// ** ProgressiveBake::execute
+void ProgressiveBake::execute( JobData* data )
+{
+    int pass = 0;
+
+    // ** A mesh is started by it's first job, so a stop does not leave a mesh partially baked
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        MeshState& state = m_meshes[data->m_mesh];
+
+        if( !state.m_started ) {
+            if( m_stopped || state.m_passes > m_pass ) {
+                return;
+            }
+
+            state.m_started = true;
+        }
+
+        pass = state.m_passes;
+    }
+
+    data->m_iterator->setPass( pass );
+    m_job->execute( data );
+}
+
+// ** ProgressiveBake::costEstimator
+BakeCostEstimator ProgressiveBake::costEstimator( void ) const
+{
+    return m_job->costEstimator();
+}
+
+// ** ProgressiveBake::accumulate
+void ProgressiveBake::accumulate( const Mesh* mesh )
+{
+    Lightmap* lightmap = mesh->lightmap();
+
+    if( !lightmap ) {
+        return;
+    }
+
+    Accumulator& accumulator = m_accumulators[lightmap];
+
+    for( int i = 0, n = mesh->faceCount(); i < n; i++ ) {
+        int uStart, uEnd, vStart, vEnd;
+        lightmap->rect( mesh->face( i ).uvRect(), uStart, vStart, uEnd, vEnd );
+
+        for( int v = max2( vStart, 0 ); v <= min2( vEnd, lightmap->height() - 1 ); v++ ) {
+            for( int u = max2( uStart, 0 ); u <= min2( uEnd, lightmap->width() - 1 ); u++ ) {
+                const Lumel& lumel = lightmap->lumel( u, v );
+
+                if( !lumel || lumel.m_faceIdx != i ) {
+                    continue;
+                }
+
+                int index = v * lightmap->width() + u;
+
+                accumulator.m_sums[index] += lumel.m_color;
+                accumulator.m_counts[index]++;
+            }
+        }
+    }
+}
+
+// ** ProgressiveBake::resolve
+void ProgressiveBake::resolve( void )
+{
+    for( Accumulators::iterator i = m_accumulators.begin(), end = m_accumulators.end(); i != end; ++i ) {
+        const Accumulator& accumulator = i->second;
+        Lumel*             lumels      = i->first->lumels();
+
+        for( int j = 0, n = ( int )accumulator.m_counts.size(); j < n; j++ ) {
+            if( accumulator.m_counts[j] ) {
+                lumels[j].m_color = accumulator.m_sums[j] / static_cast<float>( accumulator.m_counts[j] );
+            }
+        }
+    }
+}
+
+} // namespace relight
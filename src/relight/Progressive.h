@@ -0,0 +1,135 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#ifndef __Relight_Progressive_H__
+#define __Relight_Progressive_H__
+
+#include "Worker.h"
+
+#include <atomic>
+
+namespace relight {
+
+    // ** class ProgressiveBake
+    /*!
+     Bakes a scene with a sequence of accumulated passes. Each pass runs a user job for every scene mesh,
+     so a job's sample counts define how many samples a pass adds to each lumel. Each pass samples lumels
+     with it's own random stream, lightmaps hold an average of all passes accumulated by each lumel, so
+     a current estimate can be read after any pass and converges as passes are added.
+
+     A pass may be stopped from any thread, meshes that were not started yet are skipped and are baked
+     first by a next pass. Photon maps are not updated by passes, so only final gather, ambient occlusion
+     and area light noise is refined.
+     */
+    class ProgressiveBake : public Job {
+    public:
+
+                            //! Constructs a ProgressiveBake instance.
+                            /*!
+                             \param relight Relight instance used for baking.
+                             \param scene Scene to be baked, it should not be modified while passes are accumulated.
+                             \param job User job that bakes a single pass to a mesh.
+                             */
+                            ProgressiveBake( Relight* relight, const Scene* scene, Job* job );
+
+        //! Bakes a next pass on all threads of a worker pool and updates lightmaps with a current estimate.
+        void                pass( WorkerPool* pool, BakeScheduling scheduling = BakeGlobalTaskSet, int tileSize = 16 );
+
+        //! Stops a pass in progress, meshes that are not started yet are left for a next pass.
+        void                stop( void );
+
+        //! Discards all accumulated passes.
+        void                reset( void );
+
+        //! Returns an amount of passes completed by all scene meshes.
+        int                 passCount( void ) const;
+
+        //! Returns an amount of passes accumulated by a mesh.
+        int                 passCount( const Mesh* mesh ) const;
+
+        //! Executes a user job if a mesh is baked by a current pass.
+        virtual void        execute( JobData* data );
+
+        //! Returns a cost estimator of a user job.
+        virtual BakeCostEstimator costEstimator( void ) const;
+
+    private:
+
+        //! Accumulated passes of a single lightmap.
+        struct Accumulator {
+            Array<Rgb>      m_sums;     //!< Sum of lumel colors baked by all passes.
+            Array<int>      m_counts;   //!< Amount of passes accumulated by each lumel.
+        };
+
+        //! Progressive state of a single mesh.
+        struct MeshState {
+                            //! Constructs a MeshState instance.
+                            MeshState( void ) : m_passes( 0 ), m_started( false ) {}
+
+            int             m_passes;   //!< Amount of passes accumulated by a mesh.
+            bool            m_started;  //!< Was a mesh started by a current pass.
+        };
+
+        //! Container types.
+        typedef Map<Lightmap*, Accumulator>         Accumulators;
+        typedef Map<const Mesh*, MeshState>         MeshStates;
+
+        //! Adds colors baked to lumels of a mesh to their sums.
+        void                accumulate( const Mesh* mesh );
+
+        //! Writes an average of accumulated passes to lumels of all lightmaps.
+        void                resolve( void );
+
+    private:
+
+        //! Relight instance.
+        Relight*            m_relight;
+
+        //! Scene to be baked.
+        const Scene*        m_scene;
+
+        //! User job.
+        Job*                m_job;
+
+        //! Accumulated lightmap passes.
+        Accumulators        m_accumulators;
+
+        //! Progressive state of scene meshes.
+        MeshStates          m_meshes;
+
+        //! A pass index baked by a current pass, meshes that are already past it are skipped.
+        int                 m_pass;
+
+        //! The flag indicating that a current pass should be stopped.
+        std::atomic<bool>   m_stopped;
+
+        //! Guards mesh states while a pass is running.
+        std::mutex          m_mutex;
+    };
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_Progressive_H__ ) */
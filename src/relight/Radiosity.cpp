@@ -283,15 +283,17 @@ void cRadiositySolver::UpdateIndirectTexture( float *pixels, int width, int heig
 }
 
 // ** cRadiositySolver::RefineFormFactors
-void cRadiositySolver::RefineFormFactors( sRadiositySample& sample, int maxFormFactors )
+void cRadiositySolver::RefineFormFactors( sRadiositySample& sample, int maxFormFactors, int index )
 {
 	if( sample.formFactors.empty() ) {
 		return;
 	}
 
 	if( maxFormFactors ) {
+		relight::Random random( index );
+
 		while( sample.formFactors.size() > maxFormFactors ) {
-			sample.formFactors.erase( sample.formFactors.begin() + rand() % sample.formFactors.size() );
+			sample.formFactors.erase( sample.formFactors.begin() + random.next( ( int )sample.formFactors.size() ) );
 		}
 	}
 
@@ -336,7 +338,7 @@ int cRadiositySolver::ComputeFormFactors( int maxFormFactors )
 		//	DistanceSqAreaFormFactor( i, j );
 		}
 
-		RefineFormFactors( sample, maxFormFactors );
+		RefineFormFactors( sample, maxFormFactors, i );
 
 		printf( "Form factor %d%%\r", int( float( i ) / totalSamples * 100 ) );
 	}
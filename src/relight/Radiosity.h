@@ -74,7 +74,7 @@ private:
 
 private:
 
-	void					RefineFormFactors( sRadiositySample& sample, int maxFormFactors );
+	void					RefineFormFactors( sRadiositySample& sample, int maxFormFactors, int index );
 
 	void					DistanceFormFactor( unsigned short receiverIndex, unsigned short senderIndex );
 	void					DistanceSqAreaFormFactor( unsigned short receiverIndex, unsigned short senderIndex );
@@ -28,6 +28,7 @@
 #include "Relight.h"
 #include "Lightmap.h"
 #include "Worker.h"
+#include "Statistics.h"
 
 #include "scene/Scene.h"
 #include "scene/Mesh.h"
@@ -39,6 +40,66 @@
 
 namespace relight {
 
+// ** DirectLightSettings::draft
+DirectLightSettings DirectLightSettings::draft( void )
+{
+    DirectLightSettings settings;
+
+    settings.m_maxError        = 0.05f;
+    settings.m_threshold       = 0.002f;
+    settings.m_minContribution = 0.005f;
+    settings.m_rayBatchSize    = 0;
+    settings.m_areaSamples     = 16;
+    settings.m_areaMinSamples  = 4;
+
+    return settings;
+}
+
+// ** DirectLightSettings::fast
+DirectLightSettings DirectLightSettings::fast( void )
+{
+    DirectLightSettings settings;
+
+    settings.m_maxError        = 0.02f;
+    settings.m_threshold       = 0.001f;
+    settings.m_minContribution = 0.001f;
+    settings.m_rayBatchSize    = 0;
+    settings.m_areaSamples     = 32;
+    settings.m_areaMinSamples  = 8;
+
+    return settings;
+}
+
+// ** DirectLightSettings::best
+DirectLightSettings DirectLightSettings::best( void )
+{
+    DirectLightSettings settings;
+
+    settings.m_maxError        = 0.01f;
+    settings.m_threshold       = 0.0005f;
+    settings.m_minContribution = 0.0005f;
+    settings.m_rayBatchSize    = 0;
+    settings.m_areaSamples     = 64;
+    settings.m_areaMinSamples  = 16;
+
+    return settings;
+}
+
+// ** DirectLightSettings::production
+DirectLightSettings DirectLightSettings::production( void )
+{
+    DirectLightSettings settings;
+
+    settings.m_maxError        = 0.005f;
+    settings.m_threshold       = 0.0002f;
+    settings.m_minContribution = 0.0001f;
+    settings.m_rayBatchSize    = 0;
+    settings.m_areaSamples     = 128;
+    settings.m_areaMinSamples  = 16;
+
+    return settings;
+}
+
 // ** IndirectLightSettings::draft
 IndirectLightSettings IndirectLightSettings::draft( const Rgb& skyColor, const Rgb& ambientColor, float photonMaxDistance, float finalGatherDistance )
 {
@@ -55,6 +116,15 @@ IndirectLightSettings IndirectLightSettings::draft( const Rgb& skyColor, const R
     settings.m_finalGatherSamples       = 32;
     settings.m_finalGatherDistance      = finalGatherDistance;
     settings.m_finalGatherRadius        = 7;
+    settings.m_finalGatherPhotons       = 0;
+    settings.m_finalGatherMinSamples    = 16;
+    settings.m_finalGatherTolerance     = 0.1f;
+    settings.m_sampleSequence           = Sampler::Sobol;
+
+    settings.m_rayBatchSize             = 0;
+
+    settings.m_irradianceCacheSpacing   = 0;
+    settings.m_irradianceCacheError     = 0.2f;
     
     return settings;
 }
@@ -75,6 +145,15 @@ IndirectLightSettings IndirectLightSettings::fast( const Rgb& skyColor, const Rg
     settings.m_finalGatherSamples       = 64;
     settings.m_finalGatherDistance      = finalGatherDistance;
     settings.m_finalGatherRadius        = 7;
+    settings.m_finalGatherPhotons       = 0;
+    settings.m_finalGatherMinSamples    = 16;
+    settings.m_finalGatherTolerance     = 0.1f;
+    settings.m_sampleSequence           = Sampler::Sobol;
+
+    settings.m_rayBatchSize             = 0;
+
+    settings.m_irradianceCacheSpacing   = 0;
+    settings.m_irradianceCacheError     = 0.3f;
 
     return settings;
 }
@@ -95,6 +174,15 @@ IndirectLightSettings IndirectLightSettings::best( const Rgb& skyColor, const Rg
     settings.m_finalGatherSamples       = 128;
     settings.m_finalGatherDistance      = finalGatherDistance;
     settings.m_finalGatherRadius        = 7;
+    settings.m_finalGatherPhotons       = 0;
+    settings.m_finalGatherMinSamples    = 16;
+    settings.m_finalGatherTolerance     = 0.05f;
+    settings.m_sampleSequence           = Sampler::Sobol;
+
+    settings.m_rayBatchSize             = 0;
+
+    settings.m_irradianceCacheSpacing   = 0;
+    settings.m_irradianceCacheError     = 0.15f;
 
     return settings;
 }
@@ -115,6 +203,15 @@ IndirectLightSettings IndirectLightSettings::production( const Rgb& skyColor, co
     settings.m_finalGatherSamples       = 1024;
     settings.m_finalGatherDistance      = finalGatherDistance;
     settings.m_finalGatherRadius        = 7;
+    settings.m_finalGatherPhotons       = 0;
+    settings.m_finalGatherMinSamples    = 32;
+    settings.m_finalGatherTolerance     = 0.05f;
+    settings.m_sampleSequence           = Sampler::Sobol;
+
+    settings.m_rayBatchSize             = 0;
+
+    settings.m_irradianceCacheSpacing   = 0;
+    settings.m_irradianceCacheError     = 0.1f;
 
     return settings;
 }
@@ -128,6 +225,10 @@ AmbientOcclusionSettings AmbientOcclusionSettings::draft( float occludedFraction
     settings.m_maxDistance      = maxDistance;
     settings.m_exponent         = exponent;
     settings.m_occludedFraction = occludedFraction;
+    settings.m_minSamples       = 16;
+    settings.m_tolerance        = 0.05f;
+    settings.m_sampleSequence   = Sampler::Sobol;
+    settings.m_rayBatchSize     = 0;
 
     return settings;
 }
@@ -141,6 +242,10 @@ AmbientOcclusionSettings AmbientOcclusionSettings::fast( float occludedFraction,
     settings.m_maxDistance      = maxDistance;
     settings.m_exponent         = exponent;
     settings.m_occludedFraction = occludedFraction;
+    settings.m_minSamples       = 16;
+    settings.m_tolerance        = 0.03f;
+    settings.m_sampleSequence   = Sampler::Sobol;
+    settings.m_rayBatchSize     = 0;
 
     return settings;
 }
@@ -154,6 +259,10 @@ AmbientOcclusionSettings AmbientOcclusionSettings::best( float occludedFraction,
     settings.m_maxDistance      = maxDistance;
     settings.m_exponent         = exponent;
     settings.m_occludedFraction = occludedFraction;
+    settings.m_minSamples       = 32;
+    settings.m_tolerance        = 0.02f;
+    settings.m_sampleSequence   = Sampler::Sobol;
+    settings.m_rayBatchSize     = 0;
 
     return settings;
 }
@@ -167,6 +276,10 @@ AmbientOcclusionSettings AmbientOcclusionSettings::production( float occludedFra
     settings.m_maxDistance      = maxDistance;
     settings.m_exponent         = exponent;
     settings.m_occludedFraction = occludedFraction;
+    settings.m_minSamples       = 32;
+    settings.m_tolerance        = 0.01f;
+    settings.m_sampleSequence   = Sampler::Sobol;
+    settings.m_rayBatchSize     = 0;
 
     return settings;
 }
@@ -184,9 +297,9 @@ Relight* Relight::create( void )
 }
 
 // ** Relight::createScene
-Scene* Relight::createScene( void ) const
+Scene* Relight::createScene( TracerBackend backend, SceneMode mode ) const
 {
-    return new Scene;
+    return new Scene( backend, mode );
 }
 
 // ** Relight::createLightmap
@@ -202,24 +315,90 @@ Photonmap* Relight::createPhotonmap( int width, int height ) const
 }
 
 // ** Relight::bake
-void Relight::bake( const Scene* scene, Job* job, Worker* root, const Workers& workers )
+void Relight::bake( const Scene* scene, Job* job, Worker* root, const Workers& workers, BakeScheduling scheduling, int tileSize )
 {
     JobData* data   = new JobData;
     data->m_scene   = scene;
     data->m_relight = this;
-    data->m_job     = new FullBakeJob( job, workers );
+    data->m_job     = new FullBakeJob( job, workers, scheduling, tileSize );
 
     root->push( data->m_job, data );
 }
 
+// ** Relight::bake
+void Relight::bake( const Scene* scene, Job* job, WorkerPool* pool, BakeScheduling scheduling, int tileSize )
+{
+    PooledWorker root( pool );
+    FullBakeJob  fullBake( job, pool->workers(), scheduling, tileSize );
+
+    // ** This call blocks until the bake is completed, so a bake job is not allocated
+    JobData* data   = new JobData;
+    data->m_scene   = scene;
+    data->m_relight = this;
+    data->m_job     = &fullBake;
+
+    root.push( &fullBake, data );
+    root.wait();
+}
+
+// ** Relight::rebake
+void Relight::rebake( const Scene* scene, Job* job, Worker* root, const Workers& workers, BakeScheduling scheduling, int tileSize )
+{
+    resetInvalidatedLumels( scene );
+
+    JobData* data   = new JobData;
+    data->m_scene   = scene;
+    data->m_relight = this;
+    data->m_job     = new FullBakeJob( job, workers, scheduling, tileSize, true );
+
+    root->push( data->m_job, data );
+}
+
+// ** Relight::rebake
+void Relight::rebake( const Scene* scene, Job* job, WorkerPool* pool, BakeScheduling scheduling, int tileSize )
+{
+    resetInvalidatedLumels( scene );
+
+    PooledWorker root( pool );
+    FullBakeJob  fullBake( job, pool->workers(), scheduling, tileSize, true );
+
+    JobData* data   = new JobData;
+    data->m_scene   = scene;
+    data->m_relight = this;
+    data->m_job     = &fullBake;
+
+    root.push( &fullBake, data );
+    root.wait();
+}
+
+// ** Relight::resetInvalidatedLumels
+void Relight::resetInvalidatedLumels( const Scene* scene ) const
+{
+    for( int i = 0, n = scene->invalidatedMeshCount(); i < n; i++ ) {
+        const Mesh* mesh = scene->invalidatedMesh( i );
+
+        if( Lightmap* lightmap = mesh->lightmap() ) {
+            lightmap->initializeLumels( mesh );
+        }
+    }
+}
+
 // ** Relight::bakeDirectLight
 RelightStatus Relight::bakeDirectLight( const Scene* scene, const Mesh* mesh, Progress* progress, bake::BakeIterator* iterator )
 {
+    return bakeDirectLight( scene, mesh, progress, DirectLightSettings::fast(), iterator );
+}
+
+// ** Relight::bakeDirectLight
+RelightStatus Relight::bakeDirectLight( const Scene* scene, const Mesh* mesh, Progress* progress, const DirectLightSettings& settings, bake::BakeIterator* iterator )
+{
+    Statistics::Stage stage( RayShadow );
+
     if( !iterator ) {
         iterator = new bake::LumelBakeIterator( 0, 1 );
     }
 
-    bake::DirectLight* direct = new bake::DirectLight( scene, progress, iterator );
+    bake::DirectLight* direct = new bake::DirectLight( scene, progress, iterator, settings.m_maxError, settings.m_threshold, settings.m_minContribution, settings.m_rayBatchSize, settings.m_areaSamples, settings.m_areaMinSamples );
     RelightStatus status = direct->bakeMesh( mesh );
     delete direct;
 
@@ -229,11 +408,13 @@ RelightStatus Relight::bakeDirectLight( const Scene* scene, const Mesh* mesh, Pr
 // ** Relight::bakeIndirectLight
 RelightStatus Relight::bakeIndirectLight( const Scene* scene, const Mesh* mesh, Progress* progress, const IndirectLightSettings& settings, bake::BakeIterator* iterator )
 {
+    Statistics::Stage stage( RayGather );
+
     if( !iterator ) {
         iterator = new bake::LumelBakeIterator( 0, 1 );
     }
 
-    bake::IndirectLight* indirect = new bake::IndirectLight( scene, progress, iterator, settings.m_finalGatherSamples, settings.m_finalGatherDistance, settings.m_finalGatherRadius, settings.m_skyColor, settings.m_ambientColor );
+    bake::IndirectLight* indirect = new bake::IndirectLight( scene, progress, iterator, settings.m_finalGatherSamples, settings.m_finalGatherDistance, settings.m_finalGatherRadius, settings.m_skyColor, settings.m_ambientColor, settings.m_rayBatchSize, settings.m_irradianceCacheSpacing, settings.m_irradianceCacheError, settings.m_finalGatherMinSamples, settings.m_finalGatherTolerance, settings.m_sampleSequence );
     RelightStatus status = indirect->bakeMesh( mesh );
     delete indirect;
 
@@ -243,13 +424,29 @@ RelightStatus Relight::bakeIndirectLight( const Scene* scene, const Mesh* mesh,
 // ** Relight::emitPhotons
 RelightStatus Relight::emitPhotons( const Scene* scene, const IndirectLightSettings& settings )
 {
-    bake::Photons* photons = new bake::Photons( scene, settings.m_photonPassCount, settings.m_photonBounceCount, settings.m_photonEnergyThreshold, settings.m_photonMaxDistance );
-    RelightStatus status = photons->emit();
+    Worker  worker;
+    Workers workers;
+    workers.push_back( &worker );
+
+    return emitPhotons( scene, settings, workers );
+}
+
+// ** Relight::emitPhotons
+RelightStatus Relight::emitPhotons( const Scene* scene, const IndirectLightSettings& settings, WorkerPool* pool )
+{
+    return emitPhotons( scene, settings, pool->workers() );
+}
+
+// ** Relight::emitPhotons
+RelightStatus Relight::emitPhotons( const Scene* scene, const IndirectLightSettings& settings, const Workers& workers )
+{
+    bake::Photons* photons = new bake::Photons( scene, settings.m_photonPassCount, settings.m_photonBounceCount, settings.m_photonEnergyThreshold, settings.m_photonMaxDistance, settings.m_sampleSequence );
+    RelightStatus status = photons->emit( workers );
     delete photons;
 
     for( int i = 0; i < scene->meshCount(); i++ ) {
         if( Photonmap* photons = scene->mesh( i )->photonmap() ) {
-            photons->gather( settings.m_finalGatherRadius );
+            photons->gather( settings.m_finalGatherRadius, settings.m_finalGatherPhotons, workers );
         }
     }
 
@@ -259,11 +456,13 @@ RelightStatus Relight::emitPhotons( const Scene* scene, const IndirectLightSetti
 // ** Relight::bakeAmbientOcclusion
 RelightStatus Relight::bakeAmbientOcclusion( const Scene* scene, const Mesh* mesh, Progress* progress, const AmbientOcclusionSettings& settings, bake::BakeIterator* iterator )
 {
+    Statistics::Stage stage( RayAmbientOcclusion );
+
     if( !iterator ) {
         iterator = new bake::LumelBakeIterator( 0, 1 );
     }
 
-    bake::AmbientOcclusion* ao = new bake::AmbientOcclusion( scene, progress, iterator, settings.m_samples, settings.m_occludedFraction, settings.m_maxDistance, settings.m_exponent );
+    bake::AmbientOcclusion* ao = new bake::AmbientOcclusion( scene, progress, iterator, settings.m_samples, settings.m_occludedFraction, settings.m_maxDistance, settings.m_exponent, settings.m_rayBatchSize, settings.m_minSamples, settings.m_tolerance, settings.m_sampleSequence );
     RelightStatus status = ao->bakeMesh( mesh );
     delete ao;
 
@@ -29,6 +29,16 @@
 
 #include "Types.h"
 
+//! Embree ray tracer backend is compiled in unless explicitly disabled.
+#ifndef RELIGHT_USE_EMBREE
+    #define RELIGHT_USE_EMBREE  1
+#endif
+
+//! Mesh indices are 16-bit wide unless 32-bit ones are requested, must be defined the same way for a library and it's clients.
+#ifndef RELIGHT_INDEX32
+    #define RELIGHT_INDEX32     0
+#endif
+
 namespace relight {
 
 	typedef Vec2 Uv;
@@ -36,11 +46,15 @@ namespace relight {
 
     class Scene;
     class Worker;
+    class WorkerPool;
+    class PooledWorker;
     class Job;
     class LightAttenuation;
     class LightCutoff;
     class LightInfluence;
     class LightVertexGenerator;
+    class LightAreaSampler;
+    class LightTree;
     class Light;
         class PointLight;
         class MeshLight;
@@ -56,7 +70,14 @@ namespace relight {
     struct Lumel;
 
     //! Mesh vertex index.
+#if RELIGHT_INDEX32
+    typedef unsigned int Index;
+#else
     typedef unsigned short Index;
+#endif
+
+    //! Maximum amount of vertices and faces in a single mesh, the largest index value is reserved for lumels with no face.
+    const unsigned int k_MaxMeshElements = static_cast<Index>( -1 );
 
     //! Mesh vertex buffer.
     typedef Array<struct Vertex>    VertexBuffer;
@@ -76,6 +97,7 @@ namespace relight {
 
     namespace bake {
         class BakeIterator;
+        class TileQueue;
     }
 
     //! Relight status codes.
@@ -85,6 +107,24 @@ namespace relight {
         RelightNotImplemented   //!< The method is not implemented.
     };
 
+    //! Scene bake scheduling modes.
+    enum BakeScheduling {
+        BakeMeshByMesh,         //!< Meshes are baked one by one, all workers are synchronized after each mesh.
+        BakeGlobalTaskSet,      //!< Jobs for all meshes are scheduled at once, workers are synchronized only when the whole scene is baked.
+    };
+
+    //! Scene ray tracer backends.
+    enum TracerBackend {
+        TracerEmbree,           //!< Intel Embree ray tracing kernels, falls back to TracerBvh if compiled without Embree.
+        TracerBvh,              //!< A built-in SSE bounding volume hierarchy.
+    };
+
+    //! Scene modes.
+    enum SceneMode {
+        SceneStatic,            //!< Scene objects are fixed once Scene::end is called.
+        SceneDynamic,           //!< Meshes and lights can be added, removed and moved after Scene::end, changes are applied by Scene::update.
+    };
+
     //! Lightmap storage file format.
     enum StorageFormat {
         RawHdr,
@@ -98,10 +138,46 @@ namespace relight {
 
                                 //! Constructs a Progress instance.
                                 Progress( void ) {}
-        virtual                 ~Progress( void ) { assert( false ); }
+        virtual                 ~Progress( void ) {}
 
         //! Notifies about a task progress.
         virtual void            notify( const Mesh* instance, int step, int stepCount ) {}
+
+        //! Notifies that all bake jobs of a mesh are completed.
+        /*!
+         These notifications are never issued concurrently and always follow the mesh bake order.
+         */
+        virtual void            notifyCompleted( const Mesh* instance, int index, int count ) {}
+
+        //! Notifies about an estimated time left to complete a scene bake.
+        /*!
+         \param elapsed Time in seconds elapsed since a bake was started.
+         \param remaining Estimated time in seconds left to complete the bake.
+         \param fraction A completed fraction of an estimated bake cost.
+         */
+        virtual void            notifyEta( float elapsed, float remaining, float fraction ) {}
+    };
+
+    //! Direct light settings.
+    struct DirectLightSettings {
+        float                           m_maxError;         //!< Maximum error of a light cluster relative to a total light received by a lumel.
+        float                           m_threshold;        //!< Light clusters with an error bound below this luminance are never refined.
+        float                           m_minContribution;  //!< Light contributions below this luminance are dropped by a russian roulette before a shadow ray is traced, zero traces all of them.
+        int                             m_rayBatchSize;     //!< Shadow rays are collected to batches of this size and traced sorted by coherence, zero traces rays of each lumel immediately.
+        int                             m_areaSamples;      //!< Maximum number of area light samples per lumel.
+        int                             m_areaMinSamples;   //!< Number of area light samples taken before a lumel is tested for a penumbra, fully lit and fully occluded lumels take no more samples.
+
+        //! Returns a draft quality settings.
+        static DirectLightSettings      draft( void );
+
+        //! Returns a fast quality settings.
+        static DirectLightSettings      fast( void );
+
+        //! Returns a best quality settings.
+        static DirectLightSettings      best( void );
+
+        //! Returns a production quality settings.
+        static DirectLightSettings      production( void );
     };
 
     //! Indirect light settings.
@@ -113,11 +189,20 @@ namespace relight {
 
         int                             m_finalGatherSamples;       //!< Number of final gather samples.
         float                           m_finalGatherDistance;      //!< Maximum distance to gather photons at.
-        int                             m_finalGatherRadius;        //!< A radius of circle in which samples are gathered from photon map.
+        int                             m_finalGatherRadius;        //!< A radius of square in which samples are gathered from photon map.
+        int                             m_finalGatherPhotons;       //!< When positive, the gather radius is reduced down to the smallest one that covers this amount of photons.
+        int                             m_finalGatherMinSamples;    //!< Number of final gather samples taken by a first adaptive sampling round, each next round takes a half of samples taken so far.
+        float                           m_finalGatherTolerance;     //!< Adaptive sampling stops once a 95% confidence interval of a gathered luminance relative to it's mean is below this value, zero always takes all samples.
+        Sampler::Sequence               m_sampleSequence;           //!< Sample sequence used to generate final gather ray directions and photon emission directions.
 
         Rgb                             m_skyColor;                 //!< A sky color is used when the ray didn't hit anything.
         Rgb                             m_ambientColor;             //!< Ambient color for any point in scene.
 
+        int                             m_rayBatchSize;             //!< Final gather rays are collected to batches of this size and traced sorted by coherence, zero traces rays of each lumel immediately.
+
+        int                             m_irradianceCacheSpacing;   //!< Maximum lightmap distance in lumels between irradiance cache records, zero runs a final gather at every lumel. Records are not shared between bakeIndirectLight calls, so tiles and workers gather their own ones and presets keep the cache disabled.
+        float                           m_irradianceCacheError;     //!< Maximum split sphere error at which lumels are interpolated from irradiance cache records.
+
         //! Returns a fast quality settings.
         static IndirectLightSettings    fast( const Rgb& skyColor = Rgb( 0.0f, 0.0f, 0.0f ), const Rgb& ambientColor = Rgb( 0.0f, 0.0f, 0.0f ), float photonMaxDistance = 10.0f, float finalGatherDistance = 50.0f );
 
@@ -134,9 +219,13 @@ namespace relight {
     //! Ambient occlusion settings.
     struct AmbientOcclusionSettings {
         int                             m_samples;          //!< Number of ambient occlusion samples.
+        int                             m_minSamples;       //!< Number of ambient occlusion samples taken by a first adaptive sampling round, each next round takes a half of samples taken so far.
+        float                           m_tolerance;        //!< Adaptive sampling stops once a 95% confidence interval of an occlusion is below this value, zero always takes all samples.
+        Sampler::Sequence               m_sampleSequence;   //!< Sample sequence used to generate occlusion ray directions.
         float                           m_occludedFraction; //!< Fraction of samples taken that must be occluded in order to reach full occlusion.
         float                           m_maxDistance;      //!< Maximum distance for an object to cause occlusion on another object.
         float                           m_exponent;         //!< Final occlusion value exponent.
+        int                             m_rayBatchSize;     //!< Occlusion rays are collected to batches of this size and traced sorted by coherence, zero traces rays of each lumel immediately.
 
         //! Returns a fast quality settings.
         static AmbientOcclusionSettings fast( float occludedFraction = 0.8f, float maxDistance = 0.6f, float exponent = 1.0f );
@@ -161,15 +250,38 @@ namespace relight {
         //! Creates a new photonmap instance.
         Photonmap*              createPhotonmap( int width, int height ) const;
 
-        //! Creates a new scene.
-        Scene*                  createScene( void ) const;
+        //! Creates a new scene that traces rays with a given backend.
+        Scene*                  createScene( TracerBackend backend = TracerEmbree, SceneMode mode = SceneStatic ) const;
 
         //! Performs a full scene bake.
-        void                    bake( const Scene* scene, Job* job, Worker* root, const Workers& workers );
+        /*!
+         \param tileSize Side size of lightmap tiles claimed by workers, zero (default) splits mesh faces statically between workers.
+         */
+        void                    bake( const Scene* scene, Job* job, Worker* root, const Workers& workers, BakeScheduling scheduling = BakeMeshByMesh, int tileSize = 0 );
+
+        //! Performs a full scene bake on all threads of a worker pool.
+        /*!
+         This method blocks until all scene meshes are baked, the calling thread
+         takes part in executing pool jobs while waiting.
+         */
+        void                    bake( const Scene* scene, Job* job, WorkerPool* pool, BakeScheduling scheduling = BakeMeshByMesh, int tileSize = 0 );
+
+        //! Rebakes meshes invalidated by the last Scene::update call.
+        /*!
+         Lightmap lumels of invalidated meshes are reset before baking, lumels of other meshes are left untouched.
+         Photon maps are not updated, so photons should be emitted to new photon maps before rebaking an indirect light.
+         */
+        void                    rebake( const Scene* scene, Job* job, Worker* root, const Workers& workers, BakeScheduling scheduling = BakeMeshByMesh, int tileSize = 0 );
+
+        //! Rebakes meshes invalidated by the last Scene::update call on all threads of a worker pool.
+        void                    rebake( const Scene* scene, Job* job, WorkerPool* pool, BakeScheduling scheduling = BakeMeshByMesh, int tileSize = 0 );
 
         //! Bakes direct lighting.
         RelightStatus           bakeDirectLight( const Scene* scene, const Mesh* mesh, Progress* progress, bake::BakeIterator* iterator = NULL );
 
+        //! Bakes direct lighting with given settings.
+        RelightStatus           bakeDirectLight( const Scene* scene, const Mesh* mesh, Progress* progress, const DirectLightSettings& settings, bake::BakeIterator* iterator = NULL );
+
         //! Bakes indirect light to a lightmap.
         RelightStatus           bakeIndirectLight( const Scene* scene, const Mesh* mesh, Progress* progress, const IndirectLightSettings& settings, bake::BakeIterator* iterator = NULL );
 
@@ -179,6 +291,12 @@ namespace relight {
         //! Emits photons from all lights to scene.
         RelightStatus           emitPhotons( const Scene* scene, const IndirectLightSettings& settings );
 
+        //! Emits photons from all lights to scene using a set of workers.
+        RelightStatus           emitPhotons( const Scene* scene, const IndirectLightSettings& settings, const Workers& workers );
+
+        //! Emits photons from all lights to scene on all threads of a worker pool.
+        RelightStatus           emitPhotons( const Scene* scene, const IndirectLightSettings& settings, WorkerPool* pool );
+
         //! Creates a new relight instance.
         static Relight*         create( void );
 
@@ -186,6 +304,9 @@ namespace relight {
 
                                 //! Constructs relight instance
                                 Relight( void );
+
+        //! Resets lumels of meshes invalidated by the last Scene::update call, so lights are accumulated from scratch.
+        void                    resetInvalidatedLumels( const Scene* scene ) const;
     };
 
 } // namespace relight
@@ -194,10 +315,13 @@ namespace relight {
     #include "scene/Scene.h"
     #include "scene/Mesh.h"
     #include "scene/Light.h"
+    #include "scene/LightTree.h"
     #include "scene/Material.h"
     #include "baker/Baker.h" 
     #include "Lightmap.h"
     #include "Worker.h"
+    #include "Statistics.h"
+    #include "Progressive.h"
 #endif
 
 #endif  /*  !defined( Relight ) */
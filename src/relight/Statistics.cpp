@@ -0,0 +1,324 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#include "BuildCheck.h"
+
+#include "Statistics.h"
+
+#include <mutex>
+
+namespace relight {
+
+//! Guards the thread slot registry and tracer build counters.
+static std::mutex s_mutex;
+
+//! Statistics slots of all threads that have recorded anything.
+static Array<ThreadStatistics*> s_threads;
+
+//! A report file name.
+static String s_reportFileName;
+
+//! Total time spent building ray tracers.
+static double s_buildTime = 0.0;
+
+//! Total memory used by ray tracers.
+static u64 s_buildMemory = 0;
+
+//! Statistics slot of a calling thread.
+static RELIGHT_THREAD_LOCAL ThreadStatistics* s_current = NULL;
+
+//! A kind of rays traced by a calling thread.
+static RELIGHT_THREAD_LOCAL int s_kind = RayOther;
+
+// ------------------------------------------------ RayStatistics ------------------------------------------------ //
+
+// ** RayStatistics::RayStatistics
+RayStatistics::RayStatistics( void ) : m_rays( 0 ), m_hits( 0 ), m_length( 0.0 ), m_traceTime( 0.0 ), m_decodeTime( 0.0 ), m_stageTime( 0.0 ), m_lumels( 0 ), m_samples( 0 )
+{
+
+}
+
+// ** RayStatistics::operator +=
+RayStatistics& RayStatistics::operator += ( const RayStatistics& other )
+{
+    m_rays       += other.m_rays;
+    m_hits       += other.m_hits;
+    m_length     += other.m_length;
+    m_traceTime  += other.m_traceTime;
+    m_decodeTime += other.m_decodeTime;
+    m_stageTime  += other.m_stageTime;
+    m_lumels     += other.m_lumels;
+    m_samples    += other.m_samples;
+
+    return *this;
+}
+
+// ** RayStatistics::hitRate
+double RayStatistics::hitRate( void ) const
+{
+    return m_rays ? static_cast<double>( m_hits ) / m_rays : 0.0;
+}
+
+// ** RayStatistics::averageLength
+double RayStatistics::averageLength( void ) const
+{
+    return m_rays ? m_length / m_rays : 0.0;
+}
+
+// ** RayStatistics::raysPerSecond
+double RayStatistics::raysPerSecond( void ) const
+{
+    return m_traceTime > 0.0 ? m_rays / m_traceTime : 0.0;
+}
+
+// ** RayStatistics::averageSamples
+double RayStatistics::averageSamples( void ) const
+{
+    return m_lumels ? static_cast<double>( m_samples ) / m_lumels : 0.0;
+}
+
+// ------------------------------------------------ Statistics::Stage ------------------------------------------------ //
+
+// ** Statistics::Stage::Stage
+Statistics::Stage::Stage( RayKind kind ) : m_previous( static_cast<RayKind>( s_kind ) ), m_enabled( Statistics::isEnabled() )
+{
+    if( !m_enabled ) {
+        return;
+    }
+
+    s_kind  = kind;
+    m_start = std::chrono::steady_clock::now();
+}
+
+// ** Statistics::Stage::~Stage
+Statistics::Stage::~Stage( void )
+{
+    if( !m_enabled ) {
+        return;
+    }
+
+    current()->m_rays[s_kind].m_stageTime += std::chrono::duration<double>( std::chrono::steady_clock::now() - m_start ).count();
+    s_kind = m_previous;
+}
+
+// ------------------------------------------------ Statistics ------------------------------------------------ //
+
+bool Statistics::s_enabled = false;
+
+// ** Statistics::enable
+void Statistics::enable( const String& reportFileName )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    s_reportFileName = reportFileName;
+    s_enabled        = true;
+}
+
+// ** Statistics::disable
+void Statistics::disable( void )
+{
+    s_enabled = false;
+}
+
+// ** Statistics::reset
+void Statistics::reset( void )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+
+    // ** Slots are not freed, because threads keep pointers to them
+    for( int i = 0, n = ( int )s_threads.size(); i < n; i++ ) {
+        *s_threads[i] = ThreadStatistics();
+    }
+
+    s_buildTime   = 0.0;
+    s_buildMemory = 0;
+}
+
+// ** Statistics::current
+ThreadStatistics* Statistics::current( void )
+{
+    if( s_current ) {
+        return s_current;
+    }
+
+    std::lock_guard<std::mutex> lock( s_mutex );
+    s_current = new ThreadStatistics;
+    s_threads.push_back( s_current );
+
+    return s_current;
+}
+
+// ** Statistics::recordRays
+void Statistics::recordRays( int rays, int hits, double length, double time )
+{
+    RayStatistics& stats = current()->m_rays[s_kind];
+
+    stats.m_rays      += rays;
+    stats.m_hits      += hits;
+    stats.m_length    += length;
+    stats.m_traceTime += time;
+}
+
+// ** Statistics::recordSamples
+void Statistics::recordSamples( int lumels, int samples )
+{
+    RayStatistics& stats = current()->m_rays[s_kind];
+
+    stats.m_lumels  += lumels;
+    stats.m_samples += samples;
+}
+
+// ** Statistics::recordDecode
+void Statistics::recordDecode( double time )
+{
+    current()->m_rays[s_kind].m_decodeTime += time;
+}
+
+// ** Statistics::recordBuild
+void Statistics::recordBuild( double time, u64 memory )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    s_buildTime   += time;
+    s_buildMemory += memory;
+}
+
+// ** Statistics::threadCount
+int Statistics::threadCount( void )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    return ( int )s_threads.size();
+}
+
+// ** Statistics::thread
+ThreadStatistics Statistics::thread( int index )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    assert( index >= 0 && index < ( int )s_threads.size() );
+    return *s_threads[index];
+}
+
+// ** Statistics::total
+RayStatistics Statistics::total( RayKind kind )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    RayStatistics result;
+
+    for( int i = 0, n = ( int )s_threads.size(); i < n; i++ ) {
+        result += s_threads[i]->m_rays[kind];
+    }
+
+    return result;
+}
+
+// ** Statistics::buildTime
+double Statistics::buildTime( void )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    return s_buildTime;
+}
+
+// ** Statistics::buildMemory
+u64 Statistics::buildMemory( void )
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    return s_buildMemory;
+}
+
+// ** Statistics::kindName
+const char* Statistics::kindName( RayKind kind )
+{
+    switch( kind ) {
+    case RayShadow:             return "shadow";
+    case RayAmbientOcclusion:   return "ambientOcclusion";
+    case RayGather:             return "gather";
+    case RayPhoton:             return "photon";
+    case RayFormFactor:         return "formFactor";
+    case RayOther:              return "other";
+    default:                    break;
+    }
+
+    return "";
+}
+
+// ** Statistics::json
+String Statistics::json( void )
+{
+    //! Formats ray statistics of all kinds as a JSON object.
+    struct Format {
+        static String object( const RayStatistics* rays, const char* indent )
+        {
+            String result = "{";
+            char   buffer[512];
+
+            for( int i = 0; i < TotalRayKinds; i++ ) {
+                const RayStatistics& stats = rays[i];
+
+                sprintf( buffer, "%s\n%s    \"%s\": { \"rays\": %llu, \"hits\": %llu, \"hitRate\": %g, \"averageLength\": %g, \"raysPerSecond\": %g, \"traceTime\": %g, \"decodeTime\": %g, \"stageTime\": %g, \"lumels\": %llu, \"averageSamples\": %g }"
+                        , i ? "," : "", indent, kindName( static_cast<RayKind>( i ) ), stats.m_rays, stats.m_hits, stats.hitRate(), stats.averageLength(), stats.raysPerSecond(), stats.m_traceTime, stats.m_decodeTime, stats.m_stageTime, stats.m_lumels, stats.averageSamples() );
+                result += buffer;
+            }
+
+            return result + "\n" + indent + "}";
+        }
+    };
+
+    int           count = threadCount();
+    RayStatistics totals[TotalRayKinds];
+    char          buffer[128];
+
+    for( int i = 0; i < TotalRayKinds; i++ ) {
+        totals[i] = total( static_cast<RayKind>( i ) );
+    }
+
+    String result = "{\n    \"total\": " + Format::object( totals, "    " ) + ",\n    \"threads\": [";
+
+    for( int i = 0; i < count; i++ ) {
+        result += String( i ? "," : "" ) + "\n        " + Format::object( thread( i ).m_rays, "        " );
+    }
+
+    sprintf( buffer, "\n    ],\n    \"build\": { \"time\": %g, \"memory\": %llu }\n}\n", buildTime(), buildMemory() );
+
+    return result + buffer;
+}
+
+// ** Statistics::report
+void Statistics::report( void )
+{
+    if( !isEnabled() || s_reportFileName.empty() ) {
+        return;
+    }
+
+    FILE* file = fopen( s_reportFileName.c_str(), "wt" );
+
+    if( !file ) {
+        return;
+    }
+
+    String text = json();
+    fwrite( text.c_str(), 1, text.size(), file );
+    fclose( file );
+}
+
+} // namespace relight
@@ -0,0 +1,176 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#ifndef __Relight_Statistics_H__
+#define __Relight_Statistics_H__
+
+#include "Relight.h"
+
+#include <chrono>
+
+//! Thread local storage qualifier, older MSVC versions don't support a C++11 keyword.
+#if defined( _MSC_VER ) && _MSC_VER < 1900
+    #define RELIGHT_THREAD_LOCAL    __declspec( thread )
+#else
+    #define RELIGHT_THREAD_LOCAL    thread_local
+#endif
+
+namespace relight {
+
+    //! Kinds of rays traced while baking, each bake stage traces a single kind of rays.
+    enum RayKind {
+        RayShadow,              //!< Direct light visibility rays.
+        RayAmbientOcclusion,    //!< Ambient occlusion rays.
+        RayGather,              //!< Final gather rays.
+        RayPhoton,              //!< Photon tracing rays.
+        RayFormFactor,          //!< Radiosity form factor visibility rays.
+        RayOther,               //!< Rays traced outside of bake stages.
+        TotalRayKinds
+    };
+
+    //! Ray tracing counters of a single bake stage.
+    struct RayStatistics {
+        u64                 m_rays;         //!< Amount of rays traced.
+        u64                 m_hits;         //!< Amount of rays that hit a surface or were occluded.
+        double              m_length;       //!< Total length of traced segments.
+        double              m_traceTime;    //!< Time in seconds spent inside a tracer.
+        double              m_decodeTime;   //!< Time in seconds spent on hit attribute decoding.
+        double              m_stageTime;    //!< Time in seconds spent inside a bake stage.
+        u64                 m_lumels;       //!< Amount of lumels sampled by a bake stage.
+        u64                 m_samples;      //!< Amount of samples taken for sampled lumels.
+
+                            //! Constructs a RayStatistics instance.
+                            RayStatistics( void );
+
+        //! Accumulates counters.
+        RayStatistics&      operator += ( const RayStatistics& other );
+
+        //! Returns a fraction of rays that hit a surface.
+        double              hitRate( void ) const;
+
+        //! Returns an average length of traced segments.
+        double              averageLength( void ) const;
+
+        //! Returns an amount of rays traced per second of a tracer time.
+        double              raysPerSecond( void ) const;
+
+        //! Returns an average amount of samples taken per lumel.
+        double              averageSamples( void ) const;
+    };
+
+    //! Statistics collected by a single thread.
+    struct ThreadStatistics {
+        RayStatistics       m_rays[TotalRayKinds];  //!< Counters for each kind of rays.
+    };
+
+    // ** class Statistics
+    /*!
+     An opt-in instrumentation of ray tracers and bakers. Each thread accumulates counters to it's own slot,
+     so threads never contend while baking. A bake stage is marked with a Stage scope that selects a kind of
+     rays traced by a calling thread. Statistics are collected process wide and should be enabled before a
+     scene is ended, because a scene tracer is wrapped by a profiling one only when statistics are enabled.
+     When disabled, bake stages and hit decoding check a single flag and tracers are not wrapped at all.
+     */
+    class Statistics {
+    public:
+
+        //! Marks a bake stage executed by a calling thread.
+        class Stage {
+        public:
+
+                            //! Starts a stage that traces a given kind of rays.
+                            Stage( RayKind kind );
+                            ~Stage( void );
+
+        private:
+
+            RayKind         m_previous; //!< A ray kind of an enclosing stage.
+            bool            m_enabled;  //!< Were statistics enabled when a stage was started.
+            std::chrono::steady_clock::time_point   m_start;    //!< Stage start time.
+        };
+
+        //! Enables statistics, a JSON report is written to a given file at the end of each bake if a file name is not empty.
+        static void         enable( const String& reportFileName = "" );
+
+        //! Disables statistics.
+        static void         disable( void );
+
+        //! Returns true if statistics are enabled.
+        static bool         isEnabled( void ) { return s_enabled; }
+
+        //! Resets all collected counters.
+        static void         reset( void );
+
+        //! Records a batch of rays traced by a calling thread.
+        static void         recordRays( int rays, int hits, double length, double time );
+
+        //! Records an amount of lumels sampled and samples taken by a calling thread.
+        static void         recordSamples( int lumels, int samples );
+
+        //! Records a time spent on hit attribute decoding by a calling thread.
+        static void         recordDecode( double time );
+
+        //! Records a ray tracer build.
+        static void         recordBuild( double time, u64 memory );
+
+        //! Returns an amount of threads that have recorded statistics.
+        static int          threadCount( void );
+
+        //! Returns statistics recorded by a thread.
+        static ThreadStatistics thread( int index );
+
+        //! Returns statistics of a given kind of rays accumulated over all threads.
+        static RayStatistics total( RayKind kind );
+
+        //! Returns a time in seconds spent building ray tracers.
+        static double       buildTime( void );
+
+        //! Returns an amount of memory in bytes used by ray tracers.
+        static u64        buildMemory( void );
+
+        //! Returns a JSON report.
+        static String       json( void );
+
+        //! Writes a JSON report to a file specified on enable, does nothing if statistics are disabled.
+        static void         report( void );
+
+        //! Returns a name of a ray kind used by a JSON report.
+        static const char*  kindName( RayKind kind );
+
+    private:
+
+        //! Returns statistics slot of a calling thread, a slot is allocated on a first call.
+        static ThreadStatistics*    current( void );
+
+    private:
+
+        //! Are statistics enabled.
+        static bool         s_enabled;
+    };
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_Statistics_H__ ) */
@@ -64,6 +64,7 @@ namespace relight {
 	typedef unsigned short	u16;
 	typedef int				s32;
 	typedef unsigned int	u32;
+	typedef unsigned long long u64;
 	typedef std::string		String;
 
 	template<typename T> class Array : public std::vector<T> {};
@@ -112,6 +113,86 @@ namespace relight {
         return rand() * invRAND_MAX;
     }
 
+    //! A PCG32 pseudo random number generator.
+    /*!
+     Unlike a global libc rand() state a generator instance is owned by a single thread,
+     and it's cheap to reseed, so random sequences may be bound to a lumel or a photon
+     index to make bake results independent from a thread count and an execution order.
+     */
+    class Random {
+    public:
+
+                        //! Constructs a Random instance.
+                        Random( u64 seed = 0, u64 stream = 0 );
+
+        //! Reseeds a generator.
+        void            seed( u64 seed, u64 stream = 0 );
+
+        //! Generates a random 32-bit integer.
+        u32             next( void );
+
+        //! Generates a random integer in a [0, count) range.
+        s32             next( s32 count );
+
+        //! Generates a random value in a [0, 1) range.
+        f32             next0to1( void );
+
+    private:
+
+        u64             m_state;        //!< Generator state.
+        u64             m_increment;    //!< Stream selector, always odd.
+    };
+
+    // ** Random::Random
+    inline Random::Random( u64 seed, u64 stream )
+    {
+        this->seed( seed, stream );
+    }
+
+    // ** Random::seed
+    inline void Random::seed( u64 seed, u64 stream )
+    {
+        // ** Scramble the seed, so subsequent seeds produce uncorrelated sequences
+        seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+        seed =  seed ^ (seed >> 31);
+
+        m_state     = 0;
+        m_increment = (stream << 1) | 1;
+        next();
+        m_state += seed;
+        next();
+    }
+
+    // ** Random::next
+    inline u32 Random::next( void )
+    {
+        u64 state = m_state;
+        m_state   = state * 6364136223846793005ULL + m_increment;
+
+        u32 xorshifted = static_cast<u32>( ((state >> 18) ^ state) >> 27 );
+        u32 rotation   = static_cast<u32>( state >> 59 );
+
+        return (xorshifted >> rotation) | (xorshifted << ((0u - rotation) & 31));
+    }
+
+    // ** Random::next
+    inline s32 Random::next( s32 count )
+    {
+        return static_cast<s32>( (static_cast<u64>( next() ) * static_cast<u32>( count )) >> 32 );
+    }
+
+    // ** Random::next0to1
+    inline f32 Random::next0to1( void )
+    {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    //! Generates a random value in a [0, 1) range using a given generator.
+    inline float rand0to1( Random& random ) {
+        return random.next0to1();
+    }
+
 	//! Returns true if an argument is not a number.
 	inline bool isNaN( float value )
 	{
@@ -351,6 +432,12 @@ namespace relight {
 
     }
 
+    // ** Rgb::Rgb
+    inline Rgb::Rgb( const Rgba& other ) : r( other.r ), g( other.g ), b( other.b )
+    {
+
+    }
+
     // ** Rgba::operator ==
     inline bool Rgba::operator == ( const Rgba& other ) const {
         return r == other.r && g == other.g && b == other.b && a == other.a;
@@ -448,6 +535,7 @@ namespace relight {
 
 		//! Returns the random direction vector.
 		static Vec2 randDirection( void );
+		static Vec2 randDirection( Random& random );
 
 		//! Returns the vector by a clock-wise angle
 		static Vec2 fromAngle( float angle );
@@ -614,6 +702,13 @@ namespace relight {
         return fromAngle( angle );
     }
 
+    // ** Vec2::randDirection
+    inline Vec2 Vec2::randDirection( Random& random )
+    {
+        float angle = float( random.next( 360 ) );
+        return fromAngle( angle );
+    }
+
     // ** Vec2::fromAngle
     //inline Vec2 Vec2::fromAngle( float angle )
     //{
@@ -685,15 +780,31 @@ namespace relight {
 
         //! Returns a random point in sphere.
         static Vec3 randomInSphere( const Vec3& center, float radius );
+        static Vec3 randomInSphere( const Vec3& center, float radius, Random& random );
 
         //! Returns a random direction.
         static Vec3 randomDirection( void );
+        static Vec3 randomDirection( Random& random );
 
         //! Returns a random direction on hemisphere.
         static Vec3 randomHemisphereDirection( const Vec3& normal );
+        static Vec3 randomHemisphereDirection( const Vec3& normal, Random& random );
 
 		//! Returns a random cosine weighted direcion on hemisphere.
 		static Vec3 randomHemisphereDirectionCosine( const Vec3& normal );
+		static Vec3 randomHemisphereDirectionCosine( const Vec3& normal, Random& random );
+
+        //! Maps a point of a unit square to a uniformly distributed direction on a unit sphere.
+        static Vec3 sphereDirection( const Vec2& sample );
+
+        //! Maps a point of a unit square to a uniformly distributed direction on hemisphere.
+        static Vec3 hemisphereDirection( const Vec3& normal, const Vec2& sample );
+
+        //! Maps a point of a unit square to a cosine weighted direction on hemisphere.
+        static Vec3 hemisphereDirectionCosine( const Vec3& normal, const Vec2& sample );
+
+        //! Constructs an orthonormal basis around a unit vector.
+        static void orthonormalBasis( const Vec3& normal, Vec3& tangent, Vec3& bitangent );
 
         //! Returns a normalized vector.
         static Vec3 normalize( const Vec3& v );
@@ -920,6 +1031,12 @@ namespace relight {
         return center + Vec3::randomDirection() * radius;
     }
 
+    // ** Vec3::randomInSphere
+    inline Vec3 Vec3::randomInSphere( const Vec3& center, float radius, Random& random )
+    {
+        return center + Vec3::randomDirection( random ) * radius;
+    }
+
     // ** Vec3::randomDirection
     inline Vec3 Vec3::randomDirection( void )
     {
@@ -936,6 +1053,22 @@ namespace relight {
 		return dir / len;
     }
 
+    // ** Vec3::randomDirection
+    inline Vec3 Vec3::randomDirection( Random& random )
+    {
+		Vec3 dir;
+		f32  len;
+
+		do {
+		   dir.x = (random.next0to1() * 2.0f - 1.0f);
+		   dir.y = (random.next0to1() * 2.0f - 1.0f);
+		   dir.z = (random.next0to1() * 2.0f - 1.0f);
+		   len   = dir.length();
+		} while( len > 1.0f || len == 0.0f );
+
+		return dir / len;
+    }
+
     // ** Vec3::randomHemisphereDirection
     inline Vec3 Vec3::randomHemisphereDirection( const Vec3& normal )
     {
@@ -948,40 +1081,97 @@ namespace relight {
         return dir;
     }
 
+    // ** Vec3::randomHemisphereDirection
+    inline Vec3 Vec3::randomHemisphereDirection( const Vec3& normal, Random& random )
+    {
+        Vec3 dir = randomDirection( random );
+
+        if( dir * normal < 0 ) {
+            dir = -dir;
+        }
+
+        return dir;
+    }
+
+	// ** Vec3::randomHemisphereDirectionCosine
+	inline Vec3 Vec3::randomHemisphereDirectionCosine( const Vec3& normal, Random& random )
+	{
+		f32 x = random.next0to1();
+		f32 y = random.next0to1();
+		return hemisphereDirectionCosine( normal, Vec2( x, y ) );
+	}
+
 	// ** Vec3::randomHemisphereDirectionCosine
 	inline Vec3 Vec3::randomHemisphereDirectionCosine( const Vec3& normal )
 	{
-		f32 Xi1 = (f32)rand()/(f32)RAND_MAX;
-		f32 Xi2 = (f32)rand()/(f32)RAND_MAX;
+		f32 x = rand0to1();
+		f32 y = rand0to1();
+		return hemisphereDirectionCosine( normal, Vec2( x, y ) );
+	}
 
-		f32  theta = acosf(sqrtf(1.0f-Xi1));
-		f32  phi = 2.0f * 3.1415926535897932384626433832795f * Xi2;
+    // ** Vec3::sphereDirection
+    inline Vec3 Vec3::sphereDirection( const Vec2& sample )
+    {
+        f32 z   = 1.0f - 2.0f * sample.x;
+        f32 r   = sqrtf( max2( 0.0f, 1.0f - z * z ) );
+        f32 phi = 2.0f * Pi * sample.y;
 
-		f32 xs = sinf(theta) * cosf(phi);
-		f32 ys = cosf(theta);
-		f32 zs = sinf(theta) * sinf(phi);
+        return Vec3( r * cosf( phi ), r * sinf( phi ), z );
+    }
 
-		Vec3 d( xs, ys, zs );
-		return d * normal < 0 ? -d : d;
+    // ** Vec3::hemisphereDirection
+    inline Vec3 Vec3::hemisphereDirection( const Vec3& normal, const Vec2& sample )
+    {
+        f32 z   = sample.x;
+        f32 r   = sqrtf( max2( 0.0f, 1.0f - z * z ) );
+        f32 phi = 2.0f * Pi * sample.y;
 
-	/*
-		Vec3 y = normal;
-		Vec3 h = y;
-		if (fabs(h.x)<=fabs(h.y) && fabs(h.x)<=fabs(h.z))
-			h.x= 1.0;
-		else if (fabs(h.y)<=fabs(h.x) && fabs(h.y)<=fabs(h.z))
-			h.y= 1.0;
-		else
-			h.z= 1.0;
+        Vec3 tangent, bitangent;
+        orthonormalBasis( normal, tangent, bitangent );
 
+        return tangent * (r * cosf( phi )) + bitangent * (r * sinf( phi )) + normal * z;
+    }
 
-		Vec3 x = (h % y); x.normalize();
-		Vec3 z = (x % y); y.normalize();
+    // ** Vec3::hemisphereDirectionCosine
+    inline Vec3 Vec3::hemisphereDirectionCosine( const Vec3& normal, const Vec2& sample )
+    {
+        // ** Map a square to a unit disk with a concentric mapping (Shirley and Chiu), that keeps strata of a sample set compact
+        f32 u = 2.0f * sample.x - 1.0f;
+        f32 v = 2.0f * sample.y - 1.0f;
+        f32 r, phi;
+
+        if( u == 0.0f && v == 0.0f ) {
+            return normal;
+        } else if( fabsf( u ) > fabsf( v ) ) {
+            r   = u;
+            phi = (Pi * 0.25f) * (v / u);
+        } else {
+            r   = v;
+            phi = (Pi * 0.5f) - (Pi * 0.25f) * (u / v);
+        }
 
-		Vec3 direction = x * xs + y * ys + z * zs;
-		direction.normalize();
-		return direction;*/
-	}
+        // ** Project a disk point up to a hemisphere (Malley's method)
+        f32 x = r * cosf( phi );
+        f32 y = r * sinf( phi );
+        f32 z = sqrtf( max2( 0.0f, 1.0f - x * x - y * y ) );
+
+        Vec3 tangent, bitangent;
+        orthonormalBasis( normal, tangent, bitangent );
+
+        return tangent * x + bitangent * y + normal * z;
+    }
+
+    // ** Vec3::orthonormalBasis
+    inline void Vec3::orthonormalBasis( const Vec3& normal, Vec3& tangent, Vec3& bitangent )
+    {
+        // ** Duff et al., "Building an Orthonormal Basis, Revisited"
+        f32 sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+        f32 a    = -1.0f / (sign + normal.z);
+        f32 b    = normal.x * normal.y * a;
+
+        tangent   = Vec3( 1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x );
+        bitangent = Vec3( b, sign + normal.y * normal.y * a, -normal.y );
+    }
 
     // ** Vec3::normalize
     inline Vec3 Vec3::normalize( const Vec3& v ) {
@@ -990,6 +1180,194 @@ namespace relight {
         return result;
     }
 
+    //! Generates sample points of a low discrepancy sequence.
+    /*!
+     Points of a low discrepancy sequence cover a sampling domain much more evenly than
+     independent random points, so an estimate converges with fewer samples. A sample set is
+     randomized by a generator passed to start, so neighbouring lumels get decorrelated sets
+     and the noise is not replaced by a structured aliasing pattern. Consecutive points of
+     a started set stay stratified, so adaptive sampling rounds may keep drawing from it.
+     */
+    class Sampler {
+    public:
+
+        //! Available sample sequences.
+        enum Sequence {
+            WhiteNoise,         //!< Independent pseudo random points drawn from a generator.
+            Halton,             //!< Halton sequence in bases 2 and 3 randomized by a Cranley-Patterson rotation.
+            Sobol,              //!< Sobol (0,2)-sequence randomized by a random digit scrambling.
+        };
+
+                        //! Constructs a Sampler instance.
+                        Sampler( Sequence sequence = Sobol );
+
+        //! Returns a sample sequence.
+        Sequence        sequence( void ) const;
+
+        //! Starts a new sample set randomized by a given generator.
+        /*!
+         \param random Random number generator used to randomize a sequence, white noise points are drawn from it directly.
+         */
+        void            start( Random& random );
+
+        //! Sets an index of a next sequence point.
+        void            setIndex( u32 value );
+
+        //! Returns a next point in a [0, 1) square.
+        Vec2            next2D( void );
+
+        //! Returns a next uniformly distributed direction on a unit sphere.
+        Vec3            sphereDirection( void );
+
+        //! Returns a next uniformly distributed direction on hemisphere.
+        Vec3            hemisphereDirection( const Vec3& normal );
+
+        //! Returns a next cosine weighted direction on hemisphere.
+        Vec3            hemisphereDirectionCosine( const Vec3& normal );
+
+    private:
+
+        //! Reverses bits of a 32-bit integer, this is a base 2 radical inverse.
+        static u32      reverseBits( u32 value );
+
+        //! Returns a second dimension of a Sobol sequence as a 32-bit fixed point value.
+        static u32      sobol( u32 index );
+
+        //! Returns a base 3 radical inverse of an integer as a 32-bit fixed point value.
+        static u32      radicalInverse3( u32 index );
+
+        //! Converts a 32-bit fixed point value to a float in a [0, 1) range.
+        static f32      toUnit( u32 value );
+
+    private:
+
+        Sequence        m_sequence;     //!< Sample sequence.
+        Random*         m_random;       //!< Generator used by a white noise sequence.
+        u32             m_index;        //!< Index of a next sequence point.
+        u32             m_scramble[2];  //!< Per-dimension randomization, a digit scrambling mask or a rotation offset.
+    };
+
+    // ** Sampler::Sampler
+    inline Sampler::Sampler( Sequence sequence ) : m_sequence( sequence ), m_random( NULL ), m_index( 0 )
+    {
+        m_scramble[0] = m_scramble[1] = 0;
+    }
+
+    // ** Sampler::sequence
+    inline Sampler::Sequence Sampler::sequence( void ) const
+    {
+        return m_sequence;
+    }
+
+    // ** Sampler::start
+    inline void Sampler::start( Random& random )
+    {
+        m_random = &random;
+        m_index  = 0;
+
+        if( m_sequence != WhiteNoise ) {
+            m_scramble[0] = random.next();
+            m_scramble[1] = random.next();
+        }
+    }
+
+    // ** Sampler::setIndex
+    inline void Sampler::setIndex( u32 value )
+    {
+        m_index = value;
+    }
+
+    // ** Sampler::next2D
+    inline Vec2 Sampler::next2D( void )
+    {
+        u32 index = m_index++;
+
+        switch( m_sequence ) {
+        case Sobol:     return Vec2( toUnit( reverseBits( index ) ^ m_scramble[0] ), toUnit( sobol( index ) ^ m_scramble[1] ) );
+        case Halton:    {
+                            // ** Cranley-Patterson rotation is an addition modulo one, that wraps around in a fixed point
+                            u32 x = reverseBits( index ) + m_scramble[0];
+                            u32 y = radicalInverse3( index ) + m_scramble[1];
+                            return Vec2( toUnit( x ), toUnit( y ) );
+                        }
+        default:        break;
+        }
+
+        f32 x = m_random->next0to1();
+        f32 y = m_random->next0to1();
+        return Vec2( x, y );
+    }
+
+    // ** Sampler::sphereDirection
+    inline Vec3 Sampler::sphereDirection( void )
+    {
+        if( m_sequence == WhiteNoise ) {
+            return Vec3::randomDirection( *m_random );
+        }
+
+        return Vec3::sphereDirection( next2D() );
+    }
+
+    // ** Sampler::hemisphereDirection
+    inline Vec3 Sampler::hemisphereDirection( const Vec3& normal )
+    {
+        if( m_sequence == WhiteNoise ) {
+            return Vec3::randomHemisphereDirection( normal, *m_random );
+        }
+
+        return Vec3::hemisphereDirection( normal, next2D() );
+    }
+
+    // ** Sampler::hemisphereDirectionCosine
+    inline Vec3 Sampler::hemisphereDirectionCosine( const Vec3& normal )
+    {
+        return Vec3::hemisphereDirectionCosine( normal, next2D() );
+    }
+
+    // ** Sampler::reverseBits
+    inline u32 Sampler::reverseBits( u32 value )
+    {
+        value = (value << 16) | (value >> 16);
+        value = ((value & 0x00ff00ff) << 8) | ((value & 0xff00ff00) >> 8);
+        value = ((value & 0x0f0f0f0f) << 4) | ((value & 0xf0f0f0f0) >> 4);
+        value = ((value & 0x33333333) << 2) | ((value & 0xcccccccc) >> 2);
+        value = ((value & 0x55555555) << 1) | ((value & 0xaaaaaaaa) >> 1);
+        return value;
+    }
+
+    // ** Sampler::sobol
+    inline u32 Sampler::sobol( u32 index )
+    {
+        u32 result = 0;
+
+        for( u32 v = 1u << 31; index; index >>= 1, v ^= v >> 1 ) {
+            if( index & 1 ) {
+                result ^= v;
+            }
+        }
+
+        return result;
+    }
+
+    // ** Sampler::radicalInverse3
+    inline u32 Sampler::radicalInverse3( u32 index )
+    {
+        double result = 0.0;
+        double digit  = 1.0 / 3.0;
+
+        for( ; index; index /= 3, digit /= 3.0 ) {
+            result += (index % 3) * digit;
+        }
+
+        return static_cast<u32>( result * 4294967296.0 );
+    }
+
+    // ** Sampler::toUnit
+    inline f32 Sampler::toUnit( u32 value )
+    {
+        return (value >> 8) * (1.0f / 16777216.0f);
+    }
+
 	//! A 2d bounding rectangle class.
 	class Rect {
 	public:
@@ -1421,8 +1799,15 @@ namespace relight {
 		//! Returns true if the point is inside the bounding box.
 		bool			contains( const Vec3& point ) const;
 
+		//! Returns true if two bounding boxes overlap.
+		bool			intersects( const Bounds& other ) const;
+
+		//! Returns a bounding box extended by a specified distance in all directions.
+		Bounds			expanded( f32 distance ) const;
+
         //! Returns a random point in bounding box.
         Vec3            randomPointInside( void ) const;
+        Vec3            randomPointInside( Random& random ) const;
 
 		//! Constructs bounding box from an array of points.
 		static Bounds	fromPoints( const Vec3* points, s32 count );
@@ -1449,6 +1834,14 @@ namespace relight {
                     , lerp( m_min.z, m_max.z, rand0to1() ) );
     }
 
+    // ** Bounds::randomPointInside
+    inline Vec3 Bounds::randomPointInside( Random& random ) const
+    {
+        return Vec3(  lerp( m_min.x, m_max.x, random.next0to1() )
+                    , lerp( m_min.y, m_max.y, random.next0to1() )
+                    , lerp( m_min.z, m_max.z, random.next0to1() ) );
+    }
+
     // ** Bounds::volume
     inline f32 Bounds::volume( void ) const {
         return (m_max.x - m_min.x) * (m_max.y - m_min.y) * (m_max.z - m_min.z);
@@ -1530,6 +1923,25 @@ namespace relight {
 		return true;
     }
 
+    // ** Bounds::intersects
+    inline bool Bounds::intersects( const Bounds& other ) const
+    {
+        for( int i = 0; i < 3; i++ ) {
+            if( m_max[i] < other.m_min[i] || m_min[i] > other.m_max[i] ) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // ** Bounds::expanded
+    inline Bounds Bounds::expanded( f32 distance ) const
+    {
+        Vec3 offset( distance, distance, distance );
+        return Bounds( m_min - offset, m_max + offset );
+    }
+
     // ** Bounds::operator <<
     inline Bounds& Bounds::operator << ( const Vec3& point ) {
         for( int i = 0; i < 3; i++ ) {
@@ -2024,6 +2436,9 @@ namespace relight {
 		//! Appends a new sample to the set.
 		Samples&		operator << ( const T& sample );
 
+		//! Removes all samples from the set.
+		void			clear( void );
+
 		//! Returns the sample with a specified index.
 		const T&		operator[]( s32 index ) const;
 
@@ -2109,6 +2524,14 @@ namespace relight {
 		return *this;
 	}
 
+	// ** Samples::clear
+	template<typename T>
+	void Samples<T>::clear( void )
+	{
+		m_state.set( State::RecomputeAll );
+		m_samples.clear();
+	}
+
 	// ** Samples::at
 	template<typename T>
 	const T& Samples<T>::at( s32 index ) const
@@ -2535,7 +2958,8 @@ namespace relight {
         if( i != m_cache.end() ) {
             idx = i->second;
         } else {
-            idx = m_vertexBuffer.size();
+            assert( m_vertexBuffer.size() < static_cast<TIndex>( -1 ) );
+            idx = static_cast<TIndex>( m_vertexBuffer.size() );
             m_cache[vertex] = idx;
             m_vertexBuffer.push_back( vertex );
         }
@@ -2604,8 +3028,8 @@ namespace relight {
 		//! Alias this type.
 		typedef TriMesh<TVertex, TIndex, TVertexCompare> Mesh;
 
-		//! Alias the indexer type.
-		typedef MeshIndexer<TVertex, TVertexCompare> Indexer;
+		//! Alias the indexer type, it produces indices of the same width as a mesh.
+		typedef MeshIndexer<TVertex, TVertexCompare, TIndex> Indexer;
 
 		//! Alias the vertex type.
 		typedef TVertex Vertex;
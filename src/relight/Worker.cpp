@@ -30,58 +30,329 @@
 #include "scene/Mesh.h"
 #include "baker/Baker.h"
 #include "Lightmap.h"
+#include "Statistics.h"
+#include "scene/Light.h"
 
 namespace relight {
 
-// ** FullBakeJob::FullBakeJob
-FullBakeJob::FullBakeJob( Job* job, const Workers& workers ) : m_workers( workers ), m_job( job )
+//! An amount of jobs each worker gets on average when a scene is split into mesh jobs.
+const int k_JobsPerWorker = 4;
+
+// ------------------------------------------ BakeCostEstimator ------------------------------------------ //
+
+// ** BakeCostEstimator::BakeCostEstimator
+BakeCostEstimator::BakeCostEstimator( void ) : m_directLight( true ), m_areaSamples( DirectLightSettings::fast().m_areaSamples ), m_gatherSamples( 0 ), m_occlusionSamples( 0 )
+{
+
+}
+
+// ** BakeCostEstimator::setDirectLight
+void BakeCostEstimator::setDirectLight( bool value )
+{
+    m_directLight = value;
+}
+
+// ** BakeCostEstimator::setDirectLight
+void BakeCostEstimator::setDirectLight( const DirectLightSettings& settings )
+{
+    m_directLight = true;
+    m_areaSamples = settings.m_areaSamples;
+}
+
+// ** BakeCostEstimator::setIndirectLight
+void BakeCostEstimator::setIndirectLight( const IndirectLightSettings& settings )
 {
+    m_gatherSamples = settings.m_finalGatherSamples;
+}
 
+// ** BakeCostEstimator::setAmbientOcclusion
+void BakeCostEstimator::setAmbientOcclusion( const AmbientOcclusionSettings& settings )
+{
+    m_occlusionSamples = settings.m_samples;
+}
+
+// ** BakeCostEstimator::raysPerLumel
+int BakeCostEstimator::raysPerLumel( const Scene* scene ) const
+{
+    int rays = m_gatherSamples + m_occlusionSamples;
+
+    if( m_directLight ) {
+        for( int i = 0, n = scene->lightCount(); i < n; i++ ) {
+            const Light*          light           = scene->light( i );
+            LightVertexGenerator* vertexGenerator = light->vertexGenerator();
+
+            if( light->areaSampler() ) {
+                rays += max2( m_areaSamples, 1 );
+            } else {
+                rays += vertexGenerator ? max2( vertexGenerator->vertexCount(), 1 ) : 1;
+            }
+        }
+    }
+
+    // ** Even if nothing is traced a lumel still has a processing cost
+    return max2( rays, 1 );
+}
+
+// ** BakeCostEstimator::estimate
+double BakeCostEstimator::estimate( const Scene* scene, const Mesh* mesh ) const
+{
+    return static_cast<double>( validLumelCount( mesh ) ) * raysPerLumel( scene );
+}
+
+// ** BakeCostEstimator::validLumelCount
+int BakeCostEstimator::validLumelCount( const Mesh* mesh )
+{
+    const Lightmap* lightmap = mesh->lightmap();
+
+    if( !lightmap ) {
+        return 0;
+    }
+
+    int count = 0;
+
+    for( int i = 0, n = mesh->faceCount(); i < n; i++ ) {
+        int uStart, uEnd, vStart, vEnd;
+        lightmap->rect( mesh->face( i ).uvRect(), uStart, vStart, uEnd, vEnd );
+
+        for( int v = max2( vStart, 0 ); v <= min2( vEnd, lightmap->height() - 1 ); v++ ) {
+            for( int u = max2( uStart, 0 ); u <= min2( uEnd, lightmap->width() - 1 ); u++ ) {
+                const Lumel& lumel = lightmap->lumel( u, v );
+
+                if( lumel && lumel.m_faceIdx == i ) {
+                    count++;
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+// ----------------------------------------------- Job ----------------------------------------------- //
+
+// ** Job::costEstimator
+BakeCostEstimator Job::costEstimator( void ) const
+{
+    return BakeCostEstimator();
+}
+
+// ------------------------------------------- FullBakeJob ------------------------------------------- //
+
+// ** FullBakeJob::FullBakeJob
+FullBakeJob::FullBakeJob( Job* job, const Workers& workers, BakeScheduling scheduling, int tileSize, bool invalidatedOnly )
+    : m_workers( workers ), m_job( job ), m_scheduling( scheduling ), m_tileSize( tileSize ), m_invalidatedOnly( invalidatedOnly ), m_nextCompleted( 0 ), m_progress( NULL ), m_totalCost( 0.0 ), m_completedCost( 0.0 ), m_nextWorker( 0 )
+{
+    // ** Mesh jobs are distributed between workers, a root worker is busy executing this job
+    assert( !workers.empty() );
 }
 
 // ** FullBakeJob::execute
 void FullBakeJob::execute( JobData* data )
 {
     int                 numWorkers = ( int )m_workers.size();
-    Array<const Mesh*>  meshes;
+    BakeCostEstimator   estimator  = m_job->costEstimator();
 
-    for( int i = 0; i < data->m_scene->meshCount(); i++ ) {
-        meshes.push_back( data->m_scene->mesh( i ) );
-    }
+    struct MeshCost {
+        const Mesh*     m_mesh;
+        double          m_cost;
+        int             m_index;
 
-    struct SortMesh {
-        static bool predicate( const Mesh* a, const Mesh* b ) { return a->bounds().volume() > b->bounds().volume(); }
+        static bool predicate( const MeshCost& a, const MeshCost& b ) { return a.m_cost != b.m_cost ? a.m_cost > b.m_cost : a.m_index < b.m_index; }
     };
 
-    std::sort( meshes.begin(), meshes.end(), SortMesh::predicate );
+    // ** Estimate mesh bake costs
+    const Scene*    scene     = data->m_scene;
+    int             meshCount = m_invalidatedOnly ? scene->invalidatedMeshCount() : scene->meshCount();
+    Array<MeshCost> costs;
+    m_totalCost = 0.0;
 
-    for( int i = 0; i < ( int )meshes.size(); i++ ) {
-        for( int j = 0, n = numWorkers; j < n; j++ ) {
-            JobData* instanceData       = new JobData;
-            instanceData->m_job         = m_job;
-            instanceData->m_scene       = data->m_scene;
-            instanceData->m_relight     = data->m_relight;
-            instanceData->m_mesh        = meshes[i];
+    for( int i = 0; i < meshCount; i++ ) {
+        MeshCost cost;
+        cost.m_mesh  = m_invalidatedOnly ? scene->invalidatedMesh( i ) : scene->mesh( i );
+        cost.m_cost  = estimator.estimate( scene, cost.m_mesh );
+        cost.m_index = i;
 
-            if( instanceData->m_mesh->faceCount() >= numWorkers ) {
-                instanceData->m_iterator = new bake::FaceBakeIterator( j, numWorkers );
-            } else {
-                instanceData->m_iterator = new bake::LumelBakeIterator( j, numWorkers );
-            }
+        costs.push_back( cost );
+        m_totalCost += cost.m_cost;
+    }
 
-            m_workers[j]->push( m_job, instanceData );
-        }
+    // ** Bake the most expensive meshes first
+    std::sort( costs.begin(), costs.end(), MeshCost::predicate );
+
+    // ** Initialize the completion state
+    m_progress      = data->m_worker;
+    m_nextCompleted = 0;
+    m_nextWorker    = 0;
+    m_completedCost = 0.0;
+    m_startTime     = std::chrono::steady_clock::now();
+    m_meshes.clear();
+    m_completed.assign( costs.size(), false );
+    m_meshJobs.resize( costs.size() );
+
+    // ** Split meshes into jobs, so each worker gets a few jobs of a similar cost
+    double jobCost = m_totalCost / (numWorkers * k_JobsPerWorker);
+
+    for( int i = 0; i < ( int )costs.size(); i++ ) {
+        int jobCount = jobCost > 0.0 ? static_cast<int>( ceil( costs[i].m_cost / jobCost ) ) : 1;
+        jobCount     = min2( max2( jobCount, 1 ), numWorkers );
 
-        for( int j = 0; j < numWorkers; j++ ) {
-            m_workers[j]->wait();
+        m_meshes.push_back( costs[i].m_mesh );
+        m_meshJobs[i] = new MeshJob( this, i, jobCount, costs[i].m_cost / jobCount, m_tileSize );
+    }
+
+    // ** Schedule mesh jobs
+    for( int i = 0; i < ( int )m_meshes.size(); i++ ) {
+        push( data, i );
+
+        if( m_scheduling == BakeMeshByMesh ) {
+            wait();
         }
+    }
+
+    wait();
 
-        printf( "%d/%d\n", i, data->m_scene->meshCount() );
+    for( int i = 0; i < ( int )m_meshJobs.size(); i++ ) {
+        delete m_meshJobs[i];
     }
+    m_meshJobs.clear();
+
+    // ** Write a statistics report of this bake
+    Statistics::report();
 
     printf( "All done\n" );
 }
 
+// ** FullBakeJob::push
+void FullBakeJob::push( const JobData* data, int index )
+{
+    MeshJob* meshJob  = m_meshJobs[index];
+    int      jobCount = meshJob->jobCount();
+
+    for( int j = 0; j < jobCount; j++ ) {
+        JobData* instanceData       = new JobData;
+        instanceData->m_job         = m_job;
+        instanceData->m_scene       = data->m_scene;
+        instanceData->m_relight     = data->m_relight;
+        instanceData->m_mesh        = m_meshes[index];
+
+        if( bake::TileQueue* tiles = meshJob->tiles() ) {
+            instanceData->m_iterator = new bake::TileBakeIterator( tiles );
+        } else if( instanceData->m_mesh->faceCount() >= jobCount ) {
+            instanceData->m_iterator = new bake::FaceBakeIterator( j, jobCount );
+        } else {
+            instanceData->m_iterator = new bake::LumelBakeIterator( j, jobCount );
+        }
+
+        // ** Distribute jobs between workers in a round robin manner
+        m_workers[m_nextWorker]->push( meshJob, instanceData );
+        m_nextWorker = (m_nextWorker + 1) % ( int )m_workers.size();
+    }
+}
+
+// ** FullBakeJob::wait
+void FullBakeJob::wait( void )
+{
+    for( int j = 0; j < ( int )m_workers.size(); j++ ) {
+        m_workers[j]->wait();
+    }
+}
+
+// ** FullBakeJob::complete
+void FullBakeJob::complete( int index )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_completed[index] = true;
+
+    // ** Issue notifications for all completed meshes that follow in a bake order
+    int count = ( int )m_meshes.size();
+
+    while( m_nextCompleted < count && m_completed[m_nextCompleted] ) {
+        printf( "%d/%d\n", m_nextCompleted, count );
+
+        if( m_progress ) {
+            m_progress->notifyCompleted( m_meshes[m_nextCompleted], m_nextCompleted, count );
+        }
+
+        m_nextCompleted++;
+    }
+}
+
+// ** FullBakeJob::progress
+void FullBakeJob::progress( double cost )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    m_completedCost += cost;
+
+    if( !m_progress || m_totalCost <= 0.0 || m_completedCost <= 0.0 ) {
+        return;
+    }
+
+    // ** Extrapolate the elapsed time by a completed cost fraction
+    float elapsed  = std::chrono::duration<float>( std::chrono::steady_clock::now() - m_startTime ).count();
+    float fraction = static_cast<float>( min2( m_completedCost / m_totalCost, 1.0 ) );
+
+    m_progress->notifyEta( elapsed, elapsed * (1.0f - fraction) / fraction, fraction );
+}
+
+// ** FullBakeJob::MeshJob::MeshJob
+FullBakeJob::MeshJob::MeshJob( FullBakeJob* parent, int index, int jobCount, double cost, int tileSize )
+    : m_parent( parent ), m_index( index ), m_jobCount( jobCount ), m_pending( jobCount ), m_cost( cost ), m_tiles( NULL )
+{
+    if( tileSize > 0 ) {
+        m_tiles = new bake::TileQueue( tileSize );
+    }
+}
+
+// ** FullBakeJob::MeshJob::~MeshJob
+FullBakeJob::MeshJob::~MeshJob( void )
+{
+    delete m_tiles;
+}
+
+// ** FullBakeJob::MeshJob::jobCount
+int FullBakeJob::MeshJob::jobCount( void ) const
+{
+    return m_jobCount;
+}
+
+// ** FullBakeJob::MeshJob::tiles
+bake::TileQueue* FullBakeJob::MeshJob::tiles( void ) const
+{
+    return m_tiles;
+}
+
+// ** FullBakeJob::MeshJob::execute
+void FullBakeJob::MeshJob::execute( JobData* data )
+{
+    m_parent->m_job->execute( data );
+    m_parent->progress( m_cost );
+
+    // ** The last completed job marks the mesh as baked
+    bool completed = false;
+    {
+        std::lock_guard<std::mutex> lock( m_parent->m_mutex );
+        completed = --m_pending == 0;
+    }
+
+    if( completed ) {
+        m_parent->complete( m_index );
+    }
+}
+
+// ** JobData::JobData
+JobData::JobData( void ) : m_worker( NULL ), m_job( NULL ), m_relight( NULL ), m_scene( NULL ), m_mesh( NULL ), m_iterator( NULL )
+{
+
+}
+
+// ** JobData::~JobData
+JobData::~JobData( void )
+{
+    delete m_iterator;
+}
+
 // ** Worker::Worker
 Worker::Worker( void )
 {
@@ -97,6 +368,7 @@ void Worker::push( Job* job, JobData* data )
 {
     data->m_worker = this;
     job->execute( data );
+    delete data;
 }
 
 // ** Worker::wait
@@ -105,4 +377,184 @@ void Worker::wait( void )
 
 }
 
-} // namespace relight
\ No newline at end of file
+// ------------------------------------------------ WorkerPool ------------------------------------------------ //
+
+// ** WorkerPool::WorkerPool
+WorkerPool::WorkerPool( int threadCount, Progress* progress ) : m_pending( 0 ), m_quit( false ), m_progress( progress )
+{
+    if( threadCount <= 0 ) {
+        threadCount = max2( ( int )std::thread::hardware_concurrency(), 1 );
+    }
+
+    for( int i = 0; i < threadCount; i++ ) {
+        m_workers.push_back( new PooledWorker( this ) );
+        m_threads.push_back( new std::thread( &WorkerPool::threadMain, this ) );
+    }
+}
+
+WorkerPool::~WorkerPool( void )
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_quit = true;
+    }
+    m_queued.notify_all();
+
+    for( int i = 0, n = threadCount(); i < n; i++ ) {
+        m_threads[i]->join();
+        delete m_threads[i];
+        delete m_workers[i];
+    }
+}
+
+// ** WorkerPool::threadCount
+int WorkerPool::threadCount( void ) const
+{
+    return ( int )m_threads.size();
+}
+
+// ** WorkerPool::workers
+const Workers& WorkerPool::workers( void ) const
+{
+    return m_workers;
+}
+
+// ** WorkerPool::progress
+Progress* WorkerPool::progress( void ) const
+{
+    return m_progress;
+}
+
+// ** WorkerPool::push
+void WorkerPool::push( const Task& task )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_queue.push_back( task );
+        task.m_owner->m_pending++;
+        m_pending++;
+    }
+
+    m_queued.notify_one();
+}
+
+// ** WorkerPool::wait
+void WorkerPool::wait( void )
+{
+    waitFor( m_pending );
+}
+
+// ** WorkerPool::waitFor
+void WorkerPool::waitFor( const int& pending )
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+
+    while( pending > 0 ) {
+        // ** Nothing to help with - sleep until any task is completed
+        if( m_queue.empty() ) {
+            m_completed.wait( lock );
+            continue;
+        }
+
+        // ** Help the pool by executing a queued task on this thread
+        Task task = m_queue.front();
+        m_queue.pop_front();
+
+        lock.unlock();
+        run( task );
+        lock.lock();
+    }
+}
+
+// ** WorkerPool::run
+void WorkerPool::run( const Task& task )
+{
+    task.m_job->execute( task.m_data );
+    delete task.m_data;
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        task.m_owner->m_pending--;
+        m_pending--;
+    }
+
+    m_completed.notify_all();
+}
+
+// ** WorkerPool::threadMain
+void WorkerPool::threadMain( void )
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+
+    while( true ) {
+        while( !m_quit && m_queue.empty() ) {
+            m_queued.wait( lock );
+        }
+
+        if( m_queue.empty() ) {
+            break;
+        }
+
+        Task task = m_queue.front();
+        m_queue.pop_front();
+
+        lock.unlock();
+        run( task );
+        lock.lock();
+    }
+}
+
+// ----------------------------------------------- PooledWorker ----------------------------------------------- //
+
+// ** PooledWorker::PooledWorker
+PooledWorker::PooledWorker( WorkerPool* pool ) : m_pool( pool ), m_pending( 0 )
+{
+
+}
+
+// ** PooledWorker::push
+void PooledWorker::push( Job* job, JobData* data )
+{
+    data->m_worker = this;
+
+    WorkerPool::Task task;
+    task.m_job   = job;
+    task.m_data  = data;
+    task.m_owner = this;
+
+    m_pool->push( task );
+}
+
+// ** PooledWorker::wait
+void PooledWorker::wait( void )
+{
+    m_pool->waitFor( m_pending );
+}
+
+// ** PooledWorker::notify
+void PooledWorker::notify( const Mesh* instance, int step, int stepCount )
+{
+    if( Progress* progress = m_pool->progress() ) {
+        progress->notify( instance, step, stepCount );
+    }
+}
+
+// ** PooledWorker::notifyEta
+void PooledWorker::notifyEta( float elapsed, float remaining, float fraction )
+{
+    if( Progress* progress = m_pool->progress() ) {
+        progress->notifyEta( elapsed, remaining, fraction );
+    }
+}
+
+// ** PooledWorker::notifyCompleted
+void PooledWorker::notifyCompleted( const Mesh* instance, int index, int count )
+{
+    if( Progress* progress = m_pool->progress() ) {
+        progress->notifyCompleted( instance, index, count );
+    }
+}
+
+} // namespace relight
@@ -29,36 +29,148 @@
 
 #include "Relight.h"
 
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
 namespace relight {
 
     //! Job data.
     struct JobData {
+                            //! Constructs a JobData instance.
+                            JobData( void );
+                            ~JobData( void );
+
         Worker*             m_worker;   //!< Parent worker.
         Job*                m_job;      //!< Parent job.
         Relight*            m_relight;  //!< Relight instance.
         const Scene*        m_scene;    //!< Scene instance to be processed.
         const Mesh*         m_mesh;     //!< Mesh instance from a scene.
-        bake::BakeIterator* m_iterator; //!< Bake iterator.
+        bake::BakeIterator* m_iterator; //!< Bake iterator, owned by job data.
+    };
+
+    //! Estimates a relative cost of baking a mesh.
+    /*!
+     A cost is measured in rays traced per a mesh: the amount of valid lumels multiplied by
+     the amount of shadow rays to all scene lights (area lights take a maximum amount of samples),
+     final gather and ambient occlusion samples.
+     */
+    class BakeCostEstimator {
+    public:
+
+                        //! Constructs a BakeCostEstimator instance that estimates a direct light cost.
+                        BakeCostEstimator( void );
+
+        //! Sets a direct light baking flag.
+        void            setDirectLight( bool value );
+
+        //! Sets direct light settings used for baking.
+        void            setDirectLight( const DirectLightSettings& settings );
+
+        //! Sets indirect light settings used for baking.
+        void            setIndirectLight( const IndirectLightSettings& settings );
+
+        //! Sets ambient occlusion settings used for baking.
+        void            setAmbientOcclusion( const AmbientOcclusionSettings& settings );
+
+        //! Returns an amount of rays traced per a single lumel.
+        int             raysPerLumel( const Scene* scene ) const;
+
+        //! Estimates a cost of baking a mesh.
+        double          estimate( const Scene* scene, const Mesh* mesh ) const;
+
+        //! Returns an amount of valid lightmap lumels that belong to a mesh.
+        static int      validLumelCount( const Mesh* mesh );
+
+    private:
+
+        bool            m_directLight;          //!< Is direct light baked.
+        int             m_areaSamples;          //!< Maximum amount of area light samples.
+        int             m_gatherSamples;        //!< Amount of final gather samples.
+        int             m_occlusionSamples;     //!< Amount of ambient occlusion samples.
     };
 
     //! Relight job.
     class Job {
     public:
 
+        virtual         ~Job( void ) {}
+
         //! Executes a job.
         virtual void    execute( JobData* data ) = 0;
+
+        //! Returns a cost estimator used to schedule this job, the default one estimates a direct light cost.
+        virtual BakeCostEstimator   costEstimator( void ) const;
     };
 
     //! A job that bakes all scene objects.
+    /*!
+     Each mesh is split into a set of jobs, one per worker. With a BakeGlobalTaskSet
+     scheduling jobs for all meshes are pushed at once and workers are waited only
+     after the whole scene is processed, so no worker idles at the tail of each mesh.
+     Mesh completion notifications are still delivered to a root worker in a bake order.
+
+     When a positive tile size is passed, workers claim lightmap tiles of a mesh dynamically,
+     otherwise each worker bakes a static subset of faces or lumels.
+
+     Meshes are baked in a longest job first order according to a job cost estimator,
+     cheap meshes are split into fewer jobs than expensive ones.
+     */
     class FullBakeJob : public Job {
     public:
 
                         //! Constructs a FullBakeJob instance.
-                        FullBakeJob( Job* job, const Workers& workers );
+                        /*!
+                         \param invalidatedOnly Bake only meshes invalidated by the last Scene::update call.
+                         */
+                        FullBakeJob( Job* job, const Workers& workers, BakeScheduling scheduling = BakeMeshByMesh, int tileSize = 0, bool invalidatedOnly = false );
 
         //! Executes a job.
         virtual void    execute( JobData* data );
 
+    private:
+
+        //! Wraps a user job to track the completion of a single mesh.
+        class MeshJob : public Job {
+        public:
+
+                        //! Constructs a MeshJob instance.
+                        MeshJob( FullBakeJob* parent, int index, int jobCount, double cost, int tileSize );
+                        ~MeshJob( void );
+
+            //! Executes a user job and notifies the parent job when all mesh jobs are done.
+            virtual void execute( JobData* data );
+
+            //! Returns a tile queue shared by all mesh jobs.
+            bake::TileQueue* tiles( void ) const;
+
+            //! Returns an amount of jobs the mesh is split into.
+            int             jobCount( void ) const;
+
+        private:
+
+            FullBakeJob*    m_parent;   //!< Parent bake job.
+            int             m_index;    //!< Mesh index in a bake order.
+            int             m_jobCount; //!< Amount of jobs the mesh is split into.
+            int             m_pending;  //!< Amount of mesh jobs not completed yet.
+            double          m_cost;     //!< Estimated cost of a single mesh job.
+            bake::TileQueue* m_tiles;   //!< Shared tile queue, NULL if tiles are not used.
+        };
+
+        //! Marks the mesh as baked and issues all ordered completion notifications.
+        void            complete( int index );
+
+        //! Accumulates a cost of a completed job and issues an ETA notification.
+        void            progress( double cost );
+
+        //! Pushes jobs that bake a single mesh to all workers.
+        void            push( const JobData* data, int index );
+
+        //! Waits for all workers.
+        void            wait( void );
+
     private:
 
         //! Array of available workers.
@@ -66,9 +178,51 @@ namespace relight {
 
         //! A job to push to workers.
         Job*            m_job;
+
+        //! Mesh scheduling mode.
+        BakeScheduling  m_scheduling;
+
+        //! Lightmap tile size, zero means static face or lumel striding.
+        int             m_tileSize;
+
+        //! Only invalidated scene meshes are baked.
+        bool            m_invalidatedOnly;
+
+        //! Meshes sorted in a bake order.
+        Array<const Mesh*>  m_meshes;
+
+        //! Per-mesh completion jobs.
+        Array<MeshJob*>     m_meshJobs;
+
+        //! Per-mesh completion flags.
+        Array<bool>         m_completed;
+
+        //! Index of a next mesh to issue a completion notification for.
+        int                 m_nextCompleted;
+
+        //! Progress callback to issue completion notifications to.
+        Progress*           m_progress;
+
+        //! Total estimated scene bake cost.
+        double              m_totalCost;
+
+        //! Estimated cost of completed jobs.
+        double              m_completedCost;
+
+        //! Time point the bake was started at.
+        std::chrono::steady_clock::time_point   m_startTime;
+
+        //! Index of a next worker to push a job to.
+        int                 m_nextWorker;
+
+        //! Guards the completion state.
+        std::mutex          m_mutex;
     };
 
     //! Relight basic worker.
+    /*!
+     A basic worker executes all pushed jobs synchronously on a caller's thread.
+     */
     class Worker : public Progress {
     public:
 
@@ -77,12 +231,133 @@ namespace relight {
         virtual         ~Worker( void );
 
         //! Pushes a new job to this worker.
+        /*!
+         The worker takes an ownership of a job data and destroys it once the job is executed.
+         */
         virtual void    push( Job* job, JobData* data );
 
         //! Waits for completion of this worker.
         virtual void    wait( void );
     };
 
+    //! A pool of persistent threads sharing a single job queue.
+    /*!
+     Threads are spawned once at construction and are joined on destruction, so
+     scheduling a job costs a queue insertion instead of an OS thread creation.
+     Jobs are pushed through PooledWorker instances, one is created for each pool
+     thread and is accessible by the WorkerPool::workers method.
+     */
+    class WorkerPool {
+    friend class PooledWorker;
+    public:
+
+                        //! Constructs a WorkerPool instance.
+                        /*!
+                         \param threadCount Amount of threads to spawn, zero means one thread per hardware core.
+                         \param progress Optional progress callback, all pooled worker notifications are forwarded to it.
+                         */
+                        WorkerPool( int threadCount = 0, Progress* progress = NULL );
+                        ~WorkerPool( void );
+
+        //! Returns an amount of pool threads.
+        int             threadCount( void ) const;
+
+        //! Returns an array of pooled workers, one per each pool thread.
+        const Workers&  workers( void ) const;
+
+        //! Returns a progress callback.
+        Progress*       progress( void ) const;
+
+        //! Waits until all queued jobs are completed.
+        void            wait( void );
+
+    private:
+
+        //! A queued job.
+        struct Task {
+            Job*            m_job;      //!< Job to be executed.
+            JobData*        m_data;     //!< Job data.
+            PooledWorker*   m_owner;    //!< Worker that has pushed this job.
+        };
+
+        //! Pushes a new task to a queue.
+        void            push( const Task& task );
+
+        //! Waits until a given counter is zero, executes queued tasks while waiting.
+        void            waitFor( const int& pending );
+
+        //! Executes a single task and decreases pending counters.
+        void            run( const Task& task );
+
+        //! Thread entry point.
+        void            threadMain( void );
+
+    private:
+
+        //! Pool threads.
+        Array<std::thread*>         m_threads;
+
+        //! Pooled workers.
+        Workers                     m_workers;
+
+        //! Queued tasks.
+        std::deque<Task>            m_queue;
+
+        //! Queue mutex, also guards all pending counters.
+        std::mutex                  m_mutex;
+
+        //! Signaled when a new task is queued or a pool is shutting down.
+        std::condition_variable     m_queued;
+
+        //! Signaled each time a task is completed.
+        std::condition_variable     m_completed;
+
+        //! Amount of pushed but not completed tasks.
+        int                         m_pending;
+
+        //! The flag indicating that pool threads should exit.
+        bool                        m_quit;
+
+        //! Progress callback.
+        Progress*                   m_progress;
+    };
+
+    //! A worker that executes jobs on a WorkerPool threads.
+    class PooledWorker : public Worker {
+    friend class WorkerPool;
+    public:
+
+                        //! Constructs a PooledWorker instance.
+                        PooledWorker( WorkerPool* pool );
+
+        //! Queues a job to a parent pool.
+        virtual void    push( Job* job, JobData* data );
+
+        //! Waits for completion of all jobs pushed by this worker.
+        /*!
+         While waiting the calling thread executes queued jobs, so it's safe to
+         wait from inside a job running on the same pool.
+         */
+        virtual void    wait( void );
+
+        //! Forwards the notification to a pool progress callback.
+        virtual void    notify( const Mesh* instance, int step, int stepCount );
+
+        //! Forwards the notification to a pool progress callback.
+        virtual void    notifyCompleted( const Mesh* instance, int index, int count );
+
+        //! Forwards the notification to a pool progress callback.
+        virtual void    notifyEta( float elapsed, float remaining, float fraction );
+
+    private:
+
+        //! Parent pool.
+        WorkerPool*     m_pool;
+
+        //! Amount of jobs pushed by this worker but not completed yet.
+        int             m_pending;
+    };
+
 } // namespace relight
 
 #endif /* defined(__Relight_Worker_H__) */
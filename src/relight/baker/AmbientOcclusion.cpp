@@ -30,39 +30,123 @@
 #include "../rt/Tracer.h"
 #include "../scene/Scene.h"
 #include "../Lightmap.h"
+#include "../Statistics.h"
 
 namespace relight {
 
 namespace bake {
 
 // ** AmbientOcclusion::AmbientOcclusion
-AmbientOcclusion::AmbientOcclusion( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float occludedFraction, float maxDistance, float exponent )
-    : Baker( scene, progress, iterator ), m_samples( samples ), m_occludedFraction( occludedFraction ), m_maxDistance( maxDistance ), m_exponent( exponent )
+AmbientOcclusion::AmbientOcclusion( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float occludedFraction, float maxDistance, float exponent, int batchSize, int minSamples, float tolerance, Sampler::Sequence sequence )
+    : Baker( scene, progress, iterator ), m_samples( samples ), m_minSamples( max2( minSamples, 1 ) ), m_tolerance( tolerance ), m_occludedFraction( occludedFraction ), m_maxDistance( maxDistance ), m_exponent( exponent ), m_batchSize( batchSize )
 {
-
+    m_sampler = Sampler( sequence );
 }
 
 // ** AmbientOcclusion::bakeLumel
 void AmbientOcclusion::bakeLumel( Lumel& lumel )
 {
-    rt::ITracer* tracer   = m_scene->tracer();
-    int          occluded = 0;
+    if( m_samples == 0 ) {
+        return;
+    }
+
+    // ** Adaptive sampling depends on results of each round, so it's rays are not deferred
+    if( m_tolerance > 0.0f ) {
+        sample( lumel );
+        return;
+    }
+
+    generate( lumel, m_rays.allocate( m_samples ), m_samples );
+    m_lumels.push_back( &lumel );
+
+    if( m_rays.size() >= m_batchSize ) {
+        flush();
+    }
+}
+
+// ** AmbientOcclusion::flush
+void AmbientOcclusion::flush( void )
+{
+    if( m_lumels.empty() ) {
+        return;
+    }
+
+    // ** Rays of a single lumel are already coherent, so only batches are reordered
+    m_rays.test( m_scene->tracer(), m_batchSize > 0 );
+
+    for( int i = 0, n = ( int )m_lumels.size(); i < n; i++ ) {
+        int occluded = 0;
+
+        for( int j = 0; j < m_samples; j++ ) {
+            if( m_rays.segment( i * m_samples + j ).m_occluded ) {
+                occluded++;
+            }
+        }
+
+        occlude( *m_lumels[i], occluded, m_samples );
+    }
+
+    m_rays.clear();
+    m_lumels.clear();
+}
+
+// ** AmbientOcclusion::generate
+void AmbientOcclusion::generate( const Lumel& lumel, rt::Segment* segments, int count )
+{
+    for( int i = 0; i < count; i++ ) {
+        Vec3 dir = m_sampler.hemisphereDirection( lumel.m_normal );
+        segments[i] = rt::Segment( lumel.m_position, lumel.m_position + dir * m_maxDistance, 0 );
+    }
+}
+
+// ** AmbientOcclusion::sample
+void AmbientOcclusion::sample( Lumel& lumel )
+{
+    int occluded = 0;
+    int taken    = 0;
+
+    // ** A prior of one open and one occluded sample, so a lumel does not stop at a zero variance of a first round
+    m_occlusion.clear();
+    m_occlusion << 0.0f << 1.0f;
+
+    // ** Each round takes a half of samples taken so far, so the convergence is checked a logarithmic amount of times
+    while( taken < m_samples ) {
+        int count = min2( taken ? max2( m_minSamples, taken / 2 ) : m_minSamples, m_samples - taken );
 
-    for( int i = 0; i < m_samples; i++ ) {
-        Vec3 dir = Vec3::randomHemisphereDirection( lumel.m_normal );
+        generate( lumel, m_rays.allocate( count ), count );
+        m_rays.test( m_scene->tracer(), false );
 
-        if( tracer->traceSegment( lumel.m_position, lumel.m_position + dir * m_maxDistance, 0 ) ) {
-            occluded++;
+        for( int i = 0; i < count; i++ ) {
+            bool isOccluded = m_rays.segment( i ).m_occluded;
+
+            occluded    += isOccluded ? 1 : 0;
+            m_occlusion << (isOccluded ? 1.0f : 0.0f);
+        }
+
+        m_rays.clear();
+        taken += count;
+
+        if( isConverged( m_occlusion, m_tolerance ) ) {
+            break;
         }
     }
 
-    float value = 1.0f - occluded / (m_samples * m_occludedFraction);
+    occlude( lumel, occluded, taken );
+}
+
+// ** AmbientOcclusion::occlude
+void AmbientOcclusion::occlude( Lumel& lumel, int occluded, int samples ) const
+{
+    float value = 1.0f - occluded / (samples * m_occludedFraction);
     if( fabs( 1.0f - m_exponent ) > 0.01f ) {
         value = powf( value, m_exponent );
     }
 
-//    lumel.m_color = Color( value, value, value );
     lumel.m_color *= value;
+
+    if( Statistics::isEnabled() ) {
+        Statistics::recordSamples( 1, samples );
+    }
 }
 
 } // namespace bake
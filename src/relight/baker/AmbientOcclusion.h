@@ -28,6 +28,7 @@
 #define __Relight_Bake_AmbientOcclusion_H__
 
 #include "Baker.h"
+#include "../rt/RayBuffer.h"
 
 namespace relight {
 
@@ -46,19 +47,46 @@ namespace bake {
                              \param occludedFraction Fraction of samples taken that must be occluded in order to reach full occlusion.
                              \param maxDistance Maximum distance for an object to cause occlusion on another object.
                              \param exponent Final occlusion value exponent.
+                             \param batchSize Occlusion rays of lumels are deferred until this amount is collected, zero traces rays of each lumel immediately.
+                             \param minSamples Amount of samples taken by a first adaptive sampling round, each next round takes a half of samples taken so far.
+                             \param tolerance Maximum confidence interval half width of an occlusion at which adaptive sampling stops, zero always takes all samples.
+                             \param sequence Sample sequence used to generate occlusion ray directions.
                              */
-                            AmbientOcclusion( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float occludedFraction, float maxDistance, float exponent );
+                            AmbientOcclusion( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float occludedFraction, float maxDistance, float exponent, int batchSize = 0, int minSamples = 0, float tolerance = 0.0f, Sampler::Sequence sequence = Sampler::Sobol );
 
     protected:
 
-        //! Bakes an ambient occlusion to a single lightmap pixel.
+        //! Generates occlusion rays of a single lightmap pixel.
         virtual void        bakeLumel( Lumel& lumel );
 
+        //! Tests all deferred occlusion rays and applies an occlusion to their lumels.
+        virtual void        flush( void );
+
+    private:
+
+        //! Generates a given amount of occlusion rays for a lumel.
+        void                generate( const Lumel& lumel, rt::Segment* segments, int count );
+
+        //! Samples an occlusion in rounds until it converges or all samples are taken.
+        void                sample( Lumel& lumel );
+
+        //! Applies an occlusion to a lumel by an amount of occluded samples.
+        void                occlude( Lumel& lumel, int occluded, int samples ) const;
+
     private:
 
-        //! Amount of samples.
+        //! Maximum amount of samples.
         int                 m_samples;
 
+        //! Amount of samples taken by a first adaptive sampling round.
+        int                 m_minSamples;
+
+        //! Adaptive sampling tolerance.
+        float               m_tolerance;
+
+        //! Occlusion samples of a lumel being adaptively sampled.
+        Samples<float>      m_occlusion;
+
         //! Occluded fraction.
         float               m_occludedFraction;
 
@@ -67,6 +95,15 @@ namespace bake {
 
         //! Occlusion exponent.
         float               m_exponent;
+
+        //! Amount of rays collected before they are traced.
+        int                 m_batchSize;
+
+        //! Occlusion rays of deferred lumels, each lumel owns m_samples continuous rays.
+        rt::RayBuffer       m_rays;
+
+        //! Lumels waiting for their rays to be traced.
+        Array<Lumel*>       m_lumels;
     };
 
 } // namespace bake
@@ -38,7 +38,7 @@ namespace bake {
 // --------------------------------------------- Baker --------------------------------------------- //
 
 // ** Baker::Baker
-Baker::Baker( const Scene* scene, Progress* progress, BakeIterator* iterator ) : m_scene( scene ), m_progress( progress ), m_iterator( iterator )
+Baker::Baker( const Scene* scene, Progress* progress, BakeIterator* iterator ) : m_scene( scene ), m_progress( progress ), m_iterator( iterator ), m_meshId( 0 )
 {
 
 }
@@ -64,6 +64,9 @@ RelightStatus Baker::bakeMesh( const Mesh* mesh )
         return RelightInvalidCall;
     }
 
+    // ** Lumel samples are seeded with a mesh id, so they don't change when other meshes are removed
+    m_meshId = mesh->id();
+
     int progress = 0;
 
     m_iterator->begin( this, lightmap, mesh );
@@ -71,6 +74,9 @@ RelightStatus Baker::bakeMesh( const Mesh* mesh )
     while( m_iterator->next() ) {
         if( m_progress ) m_progress->notify( mesh, ++progress, m_iterator->itemCount() );
     }
+
+    flush();
+
     if( m_progress ) m_progress->notify( mesh, m_iterator->itemCount(), m_iterator->itemCount() );
 
     return RelightSuccess;
@@ -101,6 +107,7 @@ void Baker::bakeFace( const Mesh* mesh, Index index )
                 continue;
             }
 
+            seed( lightmap, lumel );
             bakeLumel( lumel );
         }
     }
@@ -122,10 +129,35 @@ void Baker::bakeLumel( Lumel& lumel )
 
 }
 
+// ** Baker::flush
+void Baker::flush( void )
+{
+
+}
+
+// ** Baker::seed
+void Baker::seed( Lightmap* lightmap, const Lumel& lumel )
+{
+    u64 index = static_cast<u64>( &lumel - lightmap->lumels() );
+    m_random.seed( (static_cast<u64>( m_meshId ) << 32) | index, m_iterator->pass() );
+    m_sampler.start( m_random );
+}
+
+// ** Baker::isConverged
+bool Baker::isConverged( const Samples<float>& samples, float tolerance )
+{
+    if( samples.size() < 2 ) {
+        return false;
+    }
+
+    // ** A half width of the interval, 1.96 is a standard normal quantile for a 95% confidence
+    return 1.96f * samples.sdev() / sqrtf( static_cast<float>( samples.size() ) ) <= tolerance;
+}
+
 // ---------------------------------------------- BakeIterator ---------------------------------------------- //
 
 // ** BakeIterator::BakeIterator
-BakeIterator::BakeIterator( int first, int step ) : m_baker( NULL ), m_lightmap( NULL ), m_index( 0 ), m_firstIndex( first ), m_step( step )
+BakeIterator::BakeIterator( int first, int step ) : m_baker( NULL ), m_lightmap( NULL ), m_index( 0 ), m_firstIndex( first ), m_step( step ), m_pass( 0 )
 {
 
 }
@@ -152,9 +184,22 @@ int BakeIterator::itemCount( void ) const
     return 0;
 }
 
+// ** BakeIterator::pass
+int BakeIterator::pass( void ) const
+{
+    return m_pass;
+}
+
+// ** BakeIterator::setPass
+void BakeIterator::setPass( int value )
+{
+    m_pass = value;
+}
+
 // ** BakeIterator::bake
 void BakeIterator::bake( Lumel& lumel )
 {
+    m_baker->seed( m_lightmap, lumel );
     m_baker->bakeLumel( lumel );
 }
 
@@ -233,6 +278,160 @@ bool FaceBakeIterator::next( void )
     return BakeIterator::next();
 }
 
+// ------------------------------------------------ TileQueue ------------------------------------------------ //
+
+// ** TileQueue::TileQueue
+TileQueue::TileQueue( int tileSize ) : m_tileSize( max2( tileSize, 1 ) ), m_pass( 0 ), m_next( 0 ), m_active( 0 )
+{
+
+}
+
+// ** TileQueue::tileSize
+int TileQueue::tileSize( void ) const
+{
+    return m_tileSize;
+}
+
+// ** TileQueue::claim
+int TileQueue::claim( int pass, int count, bool& active )
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+
+    // ** A worker gets to a next pass after all tiles of a current one are claimed, so only active workers are waited for
+    while( pass > m_pass && m_active > 0 ) {
+        m_finished.wait( lock );
+    }
+
+    if( pass > m_pass ) {
+        m_pass = pass;
+        m_next = 0;
+    }
+
+    // ** Workers that started late skip passes already completed by others
+    if( pass < m_pass || m_next >= count ) {
+        return -1;
+    }
+
+    if( !active ) {
+        active = true;
+        m_active++;
+    }
+
+    return m_next++;
+}
+
+// ** TileQueue::finish
+void TileQueue::finish( void )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_active--;
+    }
+
+    m_finished.notify_all();
+}
+
+// --------------------------------------------- TileBakeIterator --------------------------------------------- //
+
+// ** TileBakeIterator::TileBakeIterator
+TileBakeIterator::TileBakeIterator( TileQueue* queue ) : BakeIterator( 0, 1 ), m_queue( queue ), m_tilePass( -1 ), m_active( false ), m_columns( 0 ), m_rows( 0 )
+{
+
+}
+
+TileBakeIterator::~TileBakeIterator( void )
+{
+    finish();
+}
+
+// ** TileBakeIterator::begin
+void TileBakeIterator::begin( Baker* baker, Lightmap* lightmap, const Mesh* mesh )
+{
+    BakeIterator::begin( baker, lightmap, mesh );
+
+    // ** Each begin call starts a next bake pass, a previous one is completed including lumels deferred until a baker flush
+    finish();
+    m_tilePass++;
+
+    // ** Calculate the lumel bounds of a mesh
+    m_x1 = lightmap->width();
+    m_y1 = lightmap->height();
+    m_x2 = -1;
+    m_y2 = -1;
+
+    for( int i = 0, n = mesh->faceCount(); i < n; i++ ) {
+        int uStart, uEnd, vStart, vEnd;
+        lightmap->rect( mesh->face( i ).uvRect(), uStart, vStart, uEnd, vEnd );
+
+        m_x1 = min2( m_x1, uStart );
+        m_y1 = min2( m_y1, vStart );
+        m_x2 = max2( m_x2, uEnd );
+        m_y2 = max2( m_y2, vEnd );
+    }
+
+    m_x1 = max2( m_x1, 0 );
+    m_y1 = max2( m_y1, 0 );
+    m_x2 = min2( m_x2, lightmap->width()  - 1 );
+    m_y2 = min2( m_y2, lightmap->height() - 1 );
+
+    // ** Split the bounds into tiles
+    int tileSize = m_queue->tileSize();
+
+    m_columns = m_x2 >= m_x1 ? (m_x2 - m_x1 + tileSize) / tileSize : 0;
+    m_rows    = m_y2 >= m_y1 ? (m_y2 - m_y1 + tileSize) / tileSize : 0;
+
+    m_index = claim();
+}
+
+// ** TileBakeIterator::itemCount
+int TileBakeIterator::itemCount( void ) const
+{
+    return m_columns * m_rows;
+}
+
+// ** TileBakeIterator::claim
+int TileBakeIterator::claim( void )
+{
+    return m_queue->claim( m_tilePass, itemCount(), m_active );
+}
+
+// ** TileBakeIterator::finish
+void TileBakeIterator::finish( void )
+{
+    if( m_active ) {
+        m_queue->finish();
+        m_active = false;
+    }
+}
+
+// ** TileBakeIterator::next
+bool TileBakeIterator::next( void )
+{
+    if( m_index < 0 ) {
+        return false;
+    }
+
+    int tileSize = m_queue->tileSize();
+    int x1       = m_x1 + (m_index % m_columns) * tileSize;
+    int y1       = m_y1 + (m_index / m_columns) * tileSize;
+    int x2       = min2( x1 + tileSize - 1, m_x2 );
+    int y2       = min2( y1 + tileSize - 1, m_y2 );
+
+    // ** Process tile lumels
+    for( int v = y1; v <= y2; v++ ) {
+        for( int u = x1; u <= x2; u++ ) {
+            Lumel& lumel = m_lightmap->lumel( u, v );
+
+            if( lumel ) {
+                bake( lumel );
+            }
+        }
+    }
+
+    m_index = claim();
+    return m_index >= 0;
+}
+
 } // namespace bake
 
 } // namespace relight
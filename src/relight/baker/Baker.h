@@ -29,6 +29,9 @@
 
 #include "../Relight.h"
 
+#include <mutex>
+#include <condition_variable>
+
 namespace relight {
 
 namespace bake {
@@ -56,9 +59,18 @@ namespace bake {
         //! Bakes a data to a given lumel.
         virtual void            bakeLumel( Lumel& lumel );
 
+        //! Completes lumels deferred by bakeLumel, called once all mesh lumels are processed.
+        virtual void            flush( void );
+
         //! Bakes a data to lumels corresponding to this face.
         void                    bakeFace( const Mesh* mesh, Index index );
 
+        //! Reseeds a random number generator and restarts a sample sequence for a given lumel.
+        void                    seed( Lightmap* lightmap, const Lumel& lumel );
+
+        //! Returns true if a 95% confidence interval of a sample mean is narrower than a given tolerance.
+        static bool             isConverged( const Samples<float>& samples, float tolerance );
+
     protected:
 
         //! Baking progress
@@ -69,6 +81,15 @@ namespace bake {
 
         //! Bake iterator.
         BakeIterator*           m_iterator;
+
+        //! Random number generator, reseeded for each lumel, so baked samples don't depend on a bake order.
+        Random                  m_random;
+
+        //! Sample sequence generator, restarted for each lumel with a scrambling drawn from a lumel random generator.
+        Sampler                 m_sampler;
+
+        //! Scene id of a mesh being baked.
+        int                     m_meshId;
     };
 
     //! Bake iterator is used to iterate over lightmap lumels and bake data into them.
@@ -82,6 +103,7 @@ namespace bake {
                                  \param step Iteration step.
                                  */
                                 BakeIterator( int first, int step );
+        virtual                 ~BakeIterator( void ) {}
 
         //! Begins iteration process.
         /*!
@@ -100,6 +122,12 @@ namespace bake {
         //! Returns a total amount of items to process.
         virtual int             itemCount( void ) const;
 
+        //! Returns a progressive bake pass index.
+        int                     pass( void ) const;
+
+        //! Sets a progressive bake pass index, each pass samples lumels with a separate random stream.
+        void                    setPass( int value );
+
     protected:
 
         //! Processes a single lumel.
@@ -124,6 +152,9 @@ namespace bake {
 
         //! Iteration elements step.
         int                     m_step;
+
+        //! Progressive bake pass index.
+        int                     m_pass;
     };
 
     //! LumelBakeIterator is used to bake lightmap lumels one by one.
@@ -154,6 +185,109 @@ namespace bake {
         virtual int             itemCount( void ) const;
     };
 
+    //! TileQueue is shared by all tile bake iterators that process the same mesh.
+    /*!
+     The queue is reused by several subsequent bake passes (direct light, indirect light, etc.),
+     tiles of a next pass are claimed only after all workers that claimed tiles of a current pass finished it,
+     so different passes never write the same lumels at once.
+     */
+    class TileQueue {
+    public:
+
+                                //! Constructs a TileQueue instance.
+                                /*!
+                                 \param tileSize Tile side size in lumels.
+                                 */
+                                TileQueue( int tileSize = 16 );
+
+        //! Returns a tile side size in lumels.
+        int                     tileSize( void ) const;
+
+        //! Claims a next tile of a given pass.
+        /*!
+         Waits for workers that still bake a previous pass before claiming a first tile of a next one.
+         \param pass Bake pass index.
+         \param count Amount of mesh tiles.
+         \param active Set to true once a worker claims a tile, it should call finish after completing a pass.
+         \return A tile index or -1 if all tiles of a given pass are already claimed.
+         */
+        int                     claim( int pass, int count, bool& active );
+
+        //! Marks a pass as completed by a worker that claimed any of it's tiles.
+        void                    finish( void );
+
+    private:
+
+        //! Tile side size in lumels.
+        int                     m_tileSize;
+
+        //! Bake pass tiles are claimed for.
+        int                     m_pass;
+
+        //! Next tile index of a current pass.
+        int                     m_next;
+
+        //! Amount of workers that claimed tiles of a current pass and did not finish it yet.
+        int                     m_active;
+
+        //! Guards the queue state.
+        std::mutex              m_mutex;
+
+        //! Signaled when a worker finishes a pass.
+        std::condition_variable m_finished;
+    };
+
+    //! TileBakeIterator is used to bake square lightmap tiles dynamically claimed from a shared queue.
+    /*!
+     Workers that bake the same mesh claim tiles until none are left, so the load is
+     balanced regardless of a face size and neighbouring lumels are written by a single thread.
+     */
+    class TileBakeIterator : public BakeIterator {
+    public:
+
+                                //! Constructs a TileBakeIterator instance.
+                                /*!
+                                 \param queue Shared tile queue, should outlive the iterator.
+                                 */
+                                TileBakeIterator( TileQueue* queue );
+                                ~TileBakeIterator( void );
+
+        //! Begins iteration process.
+        virtual void            begin( Baker* baker, Lightmap* lightmap, const Mesh* mesh );
+
+        //! Processes a next lightmap tile.
+        virtual bool            next( void );
+
+        //! Returns a total amount of items to process.
+        virtual int             itemCount( void ) const;
+
+    private:
+
+        //! Claims a tile for a current pass, returns -1 if all tiles of this pass are already claimed.
+        int                     claim( void );
+
+        //! Notifies the queue that a previous pass is completed, if this iterator claimed any of it's tiles.
+        void                    finish( void );
+
+    private:
+
+        //! Shared tile queue.
+        TileQueue*              m_queue;
+
+        //! Index of a bake pass over a mesh, incremented by each begin call. Unlike a progressive pass returned
+        //! by BakeIterator::pass, it's only used to order tile claims and does not affect a sampler stream.
+        int                     m_tilePass;
+
+        //! This iterator claimed tiles of a current pass.
+        bool                    m_active;
+
+        //! Mesh lumel bounds.
+        int                     m_x1, m_y1, m_x2, m_y2;
+
+        //! Amount of tiles along each axis.
+        int                     m_columns, m_rows;
+    };
+
 } // namespace bake
 
 } // namespacce relight
@@ -37,64 +37,347 @@ namespace relight {
 namespace bake {
 
 // ** DirectLight::DirectLight
-DirectLight::DirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator ) : Baker( scene, progress, iterator )
+DirectLight::DirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator, float maxError, float threshold, float minContribution, int batchSize, int areaSamples, int areaMinSamples )
+    : Baker( scene, progress, iterator ), m_lightTree( scene->lightTree() ), m_maxError( maxError ), m_threshold( threshold ), m_minContribution( minContribution ), m_batchSize( batchSize )
+    , m_areaSamples( areaSamples ), m_areaMinSamples( max2( min2( areaMinSamples, areaSamples ), 1 ) )
 {
 
 }
 
+// ** DirectLight::bakeMesh
+RelightStatus DirectLight::bakeMesh( const Mesh* mesh )
+{
+    m_culled.assign( m_lightTree->nodeCount(), false );
+
+    // ** Walk the tree top-down and cull subtrees, that are too weak or face away with their spot cones for the whole mesh
+    Array<int> stack;
+
+    if( m_lightTree->nodeCount() ) {
+        stack.push_back( 0 );
+    }
+
+    while( !stack.empty() ) {
+        int                     index = stack.back();
+        const LightTree::Node&  node  = m_lightTree->node( index );
+        stack.pop_back();
+
+        if( m_lightTree->bound( node, mesh->bounds() ) < m_threshold ) {
+            m_culled[index] = true;
+            continue;
+        }
+
+        if( !node.isLeaf() ) {
+            stack.push_back( node.m_children[0] );
+            stack.push_back( node.m_children[1] );
+        }
+    }
+
+    return Baker::bakeMesh( mesh );
+}
+
 // ** DirectLight::bakeLumel
 void DirectLight::bakeLumel( Lumel& lumel )
 {
-    for( int l = 0, n = m_scene->lightCount(); l < n; l++ ) {
-        const Light* light = m_scene->light( l );
-        Rgb          influence;
+    for( int l = 0, n = m_lightTree->unclusteredLightCount(); l < n; l++ ) {
+        const Light* light = m_lightTree->unclusteredLight( l );
 
-        if( light->vertexGenerator() ) {
-            influence = lightFromPointSet( lumel, light );
+        if( light->areaSampler() ) {
+            lightFromArea( lumel, light );
+        } else if( light->vertexGenerator() ) {
+            lightFromPointSet( lumel, light );
         } else {
-            influence = lightFromPoint( lumel, light );
+            lightFromPoint( lumel, light );
+        }
+    }
+
+    if( m_lightTree->nodeCount() ) {
+        lightFromTree( lumel );
+    }
+
+    if( m_rays.size() >= m_batchSize ) {
+        flush();
+    }
+}
+
+// ** DirectLight::flush
+void DirectLight::flush( void )
+{
+    if( m_shadows.empty() ) {
+        return;
+    }
+
+    // ** Shadow rays of a single lumel are already coherent, so only batches are reordered
+    m_rays.test( m_scene->tracer(), m_batchSize > 0 );
+
+    for( int i = 0, n = ( int )m_shadows.size(); i < n; i++ ) {
+        if( !m_rays.segment( i ).m_occluded ) {
+            m_shadows[i].m_lumel->m_color += m_shadows[i].m_color;
+        }
+    }
+
+    m_rays.clear();
+    m_shadows.clear();
+}
+
+// ** DirectLight::addLight
+void DirectLight::addLight( Lumel& lumel, const Light* light, const Vec3& point, const Rgb& color )
+{
+    float luminance = color.luminance();
+
+    if( luminance <= 0.0f ) {
+        return;
+    }
+
+    // ** Weak contributions are dropped by a russian roulette, so most of them trace no shadow ray and the sum stays unbiased
+    float survival = 1.0f;
+
+    if( luminance < m_minContribution ) {
+        survival = luminance / m_minContribution;
+
+        if( m_random.next0to1() >= survival ) {
+            return;
         }
+    }
+
+    const LightInfluence* influence = light->influence();
 
-        lumel.m_color += influence;
+    if( !influence || !light->castsShadow() ) {
+        lumel.m_color += color / survival;
+        return;
     }
+
+    Shadow shadow;
+    shadow.m_lumel = &lumel;
+    shadow.m_color = color / survival;
+
+    *m_rays.allocate( 1 ) = rt::Segment( lumel.m_position, influence->shadowRayEnd( point, lumel.m_position ), rt::HitUseAlpha );
+    m_shadows.push_back( shadow );
+}
+
+// ** DirectLight::lightFromTree
+void DirectLight::lightFromTree( Lumel& lumel )
+{
+    float total = 0.0f;
+
+    m_cut.clear();
+
+    if( !m_culled[0] ) {
+        m_cut.push_back( cluster( lumel, 0 ) );
+        total = estimate( m_cut.back() ).luminance();
+    }
+
+    // ** Refine a cluster with the largest error bound until all bounds are small enough
+    while( !m_cut.empty() && ( int )m_cut.size() < MaxCutSize ) {
+        if( m_cut.front().m_error <= max2( total * m_maxError, m_threshold ) ) {
+            break;
+        }
+
+        Cluster                 parent = m_cut.front();
+        const LightTree::Node&  node   = m_lightTree->node( parent.m_node );
+
+        std::pop_heap( m_cut.begin(), m_cut.end() );
+        m_cut.pop_back();
+        total -= estimate( parent ).luminance();
+
+        // ** A light sampled from a parent stays a valid sample of a child it belongs to, children are stored in a depth-first order
+        int   split = node.m_children[1];
+        float p0    = probability( lumel, node );
+
+        for( int i = 0; i < 2; i++ ) {
+            int child = node.m_children[i];
+
+            if( m_culled[child] ) {
+                continue;
+            }
+
+            const LightTree::Node&  childNode = m_lightTree->node( child );
+            Cluster                 entry;
+
+            if( (parent.m_leaf < split) == (i == 0) ) {
+                entry         = parent;
+                entry.m_node  = child;
+                entry.m_error = childNode.isLeaf() ? 0.0f : m_lightTree->bound( childNode, lumel.m_position, lumel.m_normal );
+                entry.m_pdf   = parent.m_pdf / (i == 0 ? p0 : 1.0f - p0);
+            } else {
+                entry = cluster( lumel, child );
+            }
+
+            m_cut.push_back( entry );
+            std::push_heap( m_cut.begin(), m_cut.end() );
+            total += estimate( entry ).luminance();
+        }
+    }
+
+    // ** Shadow each light sampled by the final cut, a running total luminance is only used as a refinement criterion
+    for( int i = 0, n = ( int )m_cut.size(); i < n; i++ ) {
+        const Light* light = m_lightTree->node( m_cut[i].m_leaf ).m_light;
+        addLight( lumel, light, light->position(), estimate( m_cut[i] ) );
+    }
+}
+
+// ** DirectLight::cluster
+DirectLight::Cluster DirectLight::cluster( const Lumel& lumel, int index )
+{
+    const LightTree::Node& node = m_lightTree->node( index );
+    Cluster                result;
+
+    result.m_node  = index;
+    result.m_error = node.isLeaf() ? 0.0f : m_lightTree->bound( node, lumel.m_position, lumel.m_normal );
+    result.m_pdf   = 1.0f;
+
+    // ** Descend to a leaf choosing children proportionally to their contribution bounds
+    int leaf = index;
+
+    while( !m_lightTree->node( leaf ).isLeaf() ) {
+        const LightTree::Node& current = m_lightTree->node( leaf );
+        float                  p0      = probability( lumel, current );
+
+        if( m_random.next0to1() < p0 ) {
+            leaf          = current.m_children[0];
+            result.m_pdf *= p0;
+        } else {
+            leaf          = current.m_children[1];
+            result.m_pdf *= 1.0f - p0;
+        }
+    }
+
+    const Light* light = m_lightTree->node( leaf ).m_light;
+
+    result.m_leaf      = leaf;
+    result.m_influence = influenceFromPoint( lumel, light->position(), light );
+
+    return result;
+}
+
+// ** DirectLight::probability
+float DirectLight::probability( const Lumel& lumel, const LightTree::Node& node ) const
+{
+    const LightTree::Node& a = m_lightTree->node( node.m_children[0] );
+    const LightTree::Node& b = m_lightTree->node( node.m_children[1] );
+
+    float wa = m_lightTree->bound( a, lumel.m_position, lumel.m_normal );
+    float wb = m_lightTree->bound( b, lumel.m_position, lumel.m_normal );
+
+    // ** Both children face away from a lumel, so any choice gives a zero light
+    if( wa + wb <= 0.0f ) {
+        wa = a.m_intensity.luminance();
+        wb = b.m_intensity.luminance();
+    }
+
+    return wa / (wa + wb);
+}
+
+// ** DirectLight::estimate
+Rgb DirectLight::estimate( const Cluster& cluster ) const
+{
+    return m_lightTree->node( cluster.m_leaf ).m_intensity * (cluster.m_influence / cluster.m_pdf);
 }
 
 // ** DirectLight::lightFromPoint
-Rgb DirectLight::lightFromPoint( const Lumel& lumel, const Light* light ) const
+void DirectLight::lightFromPoint( Lumel& lumel, const Light* light )
 {
     float influence = influenceFromPoint( lumel, light->position(), light );
 
     if( influence > 0.0f ) {
-        return light->color() * light->intensity() * influence;
+        addLight( lumel, light, light->position(), light->color() * light->intensity() * influence );
     }
-
-    return Rgb( 0, 0, 0 );
 }
 
 // ** DirectLight::lightFromPointSet
-Rgb DirectLight::lightFromPointSet( const Lumel& lumel, const Light* light ) const
+void DirectLight::lightFromPointSet( Lumel& lumel, const Light* light )
 {
     LightVertexGenerator* vertexGenerator = light->vertexGenerator();
 
     // ** No light vertices generated - just exit
     if( vertexGenerator->vertexCount() == 0 ) {
-        return Rgb( 0, 0, 0 );
+        return;
     }
 
     const LightVertexBuffer& vertices = vertexGenerator->vertices();
-    Rgb                      color    = Rgb( 0, 0, 0 );
+    float                    weight   = 1.0f / static_cast<float>( vertexGenerator->vertexCount() );
 
     for( int i = 0, n = vertexGenerator->vertexCount(); i < n; i++ ) {
-        const LightVertex&  vertex    = vertices[i];
-        float               influence = influenceFromPoint( lumel, vertex.m_position + light->position(), light );
+        Vec3  point     = vertices[i].m_position + light->position();
+        float influence = influenceFromPoint( lumel, point, light );
 
         // ** We have a non-zero light influence - add a light color to final result
         if( influence > 0.0f ) {
-            color += light->color() * light->intensity() * influence;
+            addLight( lumel, light, point, light->color() * light->intensity() * (influence * weight) );
+        }
+    }
+}
+
+// ** DirectLight::lightFromArea
+void DirectLight::lightFromArea( Lumel& lumel, const Light* light )
+{
+    const LightAreaSampler* sampler = light->areaSampler();
+    float                   sum     = 0.0f;
+    int                     taken   = 0;
+    int                     visible = 0;
+    int                     hidden  = 0;
+    int                     count   = m_areaMinSamples;
+    bool                    shadows = light->castsShadow();
+
+    if( m_areaSamples <= 0 ) {
+        return;
+    }
+
+    sampler->solidAngles( light->position(), lumel.m_position, m_areaDistribution );
+
+    while( count > 0 ) {
+        m_areaRays.clear();
+        m_areaWeights.clear();
+
+        for( int i = 0; i < count; i++ ) {
+            Vec3  point;
+            float weight = sampler->sample( light->position(), lumel.m_position, lumel.m_normal, m_areaDistribution, m_sampler.next2D(), m_random, point );
+
+            if( weight <= 0.0f ) {
+                continue;
+            }
+
+            if( const LightCutoff* cutoff = light->cutoff() ) {
+                weight *= cutoff->calculate( lumel.m_position );
+            }
+
+            if( const LightAttenuation* attenuation = light->attenuation() ) {
+                weight *= attenuation->calculate( (point - lumel.m_position).length() );
+            }
+
+            if( shadows ) {
+                *m_areaRays.allocate( 1 ) = rt::Segment( lumel.m_position, point, rt::HitUseAlpha );
+                m_areaWeights.push_back( weight );
+            } else {
+                sum += weight;
+                visible++;
+            }
         }
+
+        taken += count;
+
+        // ** A penumbra test depends on each round, so area light shadow rays are traced immediately
+        m_areaRays.test( m_scene->tracer(), false );
+
+        for( int i = 0, n = ( int )m_areaWeights.size(); i < n; i++ ) {
+            if( m_areaRays.segment( i ).m_occluded ) {
+                hidden++;
+            } else {
+                sum += m_areaWeights[i];
+                visible++;
+            }
+        }
+
+        // ** A fully occluded lumel stops, a fully lit one takes the rest of samples with no shadow rays and a penumbra traces them
+        if( hidden > 0 && visible == 0 ) {
+            break;
+        }
+
+        // ** Zero weight samples trace no rays, so a lumel with no other samples keeps shadow rays for the rest
+        shadows = shadows && (hidden > 0 || visible == 0);
+        count   = m_areaSamples - taken;
     }
 
-    return color / static_cast<float>( vertexGenerator->vertexCount() );
+    lumel.m_color += light->color() * light->intensity() * (sum / taken);
 }
 
 // ** DirectLight::influenceFromPoint
@@ -105,9 +388,13 @@ float DirectLight::influenceFromPoint( const Lumel& lumel, const Vec3& point, co
     float cut       = 1.0f;
     float distance  = 0.0f;
 
-    // ** Calculate light influence.
+    // ** Calculate light influence, shadows are traced later for contributions that are large enough.
     if( const LightInfluence* influence = light->influence() ) {
-        inf = influence->calculate( m_scene->tracer(), point, lumel.m_position, lumel.m_normal, distance );
+        inf = influence->unshadowed( point, lumel.m_position, lumel.m_normal, distance );
+
+        if( inf <= 0.0f ) {
+            return 0.0f;
+        }
     }
 
     // ** Calculate light cutoff.
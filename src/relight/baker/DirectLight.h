@@ -28,33 +28,152 @@
 #define __Relight_Bake_DirectLight_H__
 
 #include "Baker.h"
+#include "../rt/RayBuffer.h"
+#include "../scene/LightTree.h"
 
 namespace relight {
 
 namespace bake {
 
     //! Bakes a direct light to a lightmap texture.
+    /*!
+     Directional and area lights are evaluated at each lumel, while point and spot lights are
+     taken from a scene light tree. For each lumel a cut of light clusters is chosen, so that an
+     error bound of each cluster stays below a fraction of a total light, or below an absolute
+     threshold. Each cluster is estimated by a single light sampled proportionally to contribution
+     bounds of it's subtrees, so the estimate is unbiased (Yuksel, "Stochastic Lightcuts"). Light
+     clusters that can't reach a threshold anywhere on a mesh are culled once per mesh.
+
+     An unshadowed contribution of each light is evaluated first, contributions below a minimum
+     are dropped by a russian roulette and shadow rays of the remaining ones are deferred and
+     traced in batches.
+
+     Lights with an area sampler take a few surface samples first. A lumel stops if all of them are
+     occluded, takes the rest of samples without shadow rays if all of them are visible and traces
+     shadow rays for the rest of samples only in a penumbra.
+     */
     class DirectLight : public Baker {
     public:
 
                                 //! Constructs a DirectLight instance.
-                                DirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator );
+                                /*!
+                                 \param scene Scene to be baked.
+                                 \param progress Progress callback.
+                                 \param iterator Bake iterator.
+                                 \param maxError Maximum error of a light cluster relative to a total light received by a lumel.
+                                 \param threshold Light clusters with an error bound below this luminance are never refined.
+                                 \param minContribution Unshadowed light contributions with a luminance below this value are dropped with a probability inversely proportional to it, survived ones are scaled up.
+                                 \param batchSize Amount of shadow rays collected before they are traced, zero traces shadow rays of each lumel immediately.
+                                 \param areaSamples Maximum amount of area light samples taken per lumel.
+                                 \param areaMinSamples Amount of area light samples taken before a lumel is tested for a penumbra.
+                                 */
+                                DirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator, float maxError = 0.02f, float threshold = 0.001f, float minContribution = 0.0f, int batchSize = 0, int areaSamples = 32, int areaMinSamples = 8 );
+
+        //! Culls light clusters for a mesh and bakes a direct light to it.
+        virtual RelightStatus   bakeMesh( const Mesh* mesh );
 
     protected:
 
         // ** Baker
         virtual void            bakeLumel( Lumel& lumel );
 
+        // ** Baker
+        virtual void            flush( void );
+
     private:
 
+        enum {
+            MaxCutSize = 1000,  //!< Maximum amount of light clusters evaluated per lumel.
+        };
+
+        //! A light cluster evaluated for a lumel.
+        struct Cluster {
+            int                 m_node;         //!< Light tree node index.
+            int                 m_leaf;         //!< Leaf node index of a light sampled from a cluster.
+            float               m_influence;    //!< Sampled light influence.
+            float               m_pdf;          //!< Probability of sampling a light from a cluster.
+            float               m_error;        //!< Cluster error bound.
+
+            //! Orders clusters by an error bound for a max heap.
+            bool                operator < ( const Cluster& other ) const { return m_error < other.m_error; }
+        };
+
+        //! A light contribution waiting for a shadow ray to be traced.
+        struct Shadow {
+            Lumel*              m_lumel;        //!< Lumel that receives a light.
+            Rgb                 m_color;        //!< Unshadowed light contribution.
+        };
+
+        //! Adds an unshadowed light contribution to a lumel, a shadow ray is deferred if a light casts shadows.
+        void                    addLight( Lumel& lumel, const Light* light, const Vec3& point, const Rgb& color );
+
+        //! Calculates a direct light from clustered lights.
+        void                    lightFromTree( Lumel& lumel );
+
+        //! Evaluates a light cluster for a lumel by sampling one of it's lights.
+        Cluster                 cluster( const Lumel& lumel, int node );
+
+        //! Returns a probability of sampling a light from the first child of a node.
+        float                   probability( const Lumel& lumel, const LightTree::Node& node ) const;
+
+        //! Returns a cluster light estimate.
+        Rgb                     estimate( const Cluster& cluster ) const;
+
         //! Calculates a direct light from a point light source.
-        Rgb                     lightFromPoint( const Lumel& lumel, const Light* light ) const;
+        void                    lightFromPoint( Lumel& lumel, const Light* light );
 
-        //! Calculates a direct light from an area light source.
-        Rgb                     lightFromPointSet( const Lumel& lumel, const Light* light ) const;
+        //! Calculates a direct light from an area light source approximated by a set of points.
+        void                    lightFromPointSet( Lumel& lumel, const Light* light );
 
-        //! Calculates a direct light from a given point.
+        //! Calculates a direct light from an area light source by sampling it's surface.
+        void                    lightFromArea( Lumel& lumel, const Light* light );
+
+        //! Calculates an unshadowed direct light from a given point.
         float                   influenceFromPoint( const Lumel& lumel, const Vec3& point, const Light* light ) const;
+
+    private:
+
+        //! Scene light clusters.
+        const LightTree*        m_lightTree;
+
+        //! Maximum relative cluster error.
+        float                   m_maxError;
+
+        //! Absolute cluster error threshold.
+        float                   m_threshold;
+
+        //! Light tree nodes culled for a mesh being baked.
+        Array<bool>             m_culled;
+
+        //! A light cut of a lumel being baked.
+        Array<Cluster>          m_cut;
+
+        //! Luminance below which light contributions are dropped by a russian roulette.
+        float                   m_minContribution;
+
+        //! Amount of shadow rays collected before they are traced.
+        int                     m_batchSize;
+
+        //! Deferred shadow rays.
+        rt::RayBuffer           m_rays;
+
+        //! Light contributions of deferred shadow rays.
+        Array<Shadow>           m_shadows;
+
+        //! Maximum amount of area light samples.
+        int                     m_areaSamples;
+
+        //! Amount of area light samples taken by a first round.
+        int                     m_areaMinSamples;
+
+        //! Shadow rays of an area light sampling round.
+        rt::RayBuffer           m_areaRays;
+
+        //! Unshadowed contributions of area light samples.
+        Array<float>            m_areaWeights;
+
+        //! Cumulative solid angles of area light triangles seen from a lumel being baked.
+        Array<float>            m_areaDistribution;
     };
 
 } // namespace bake
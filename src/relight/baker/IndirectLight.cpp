@@ -31,47 +31,274 @@
 #include "../scene/Scene.h"
 #include "../scene/Mesh.h"
 #include "../rt/Tracer.h"
+#include "../Statistics.h"
 
 namespace relight {
 
 namespace bake {
 
 // ** IndirectLight::IndirectLight
-IndirectLight::IndirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float maxDistance, int radius, const Rgb& skyColor, const Rgb& ambientColor )
-    : Baker( scene, progress, iterator ), m_samples( samples ), m_maxDistance( maxDistance ), m_radius( radius ), m_skyColor( skyColor ), m_ambientColor( ambientColor )
+IndirectLight::IndirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float maxDistance, int radius, const Rgb& skyColor, const Rgb& ambientColor, int batchSize, int cacheSpacing, float cacheError, int minSamples, float tolerance, Sampler::Sequence sequence )
+    : Baker( scene, progress, iterator ), m_samples( samples ), m_minSamples( max2( minSamples, 1 ) ), m_tolerance( tolerance ), m_maxDistance( maxDistance ), m_radius( radius ), m_skyColor( skyColor ), m_ambientColor( ambientColor ), m_batchSize( batchSize )
+    , m_cacheSpacing( cacheSpacing ), m_cacheError( cacheError ), m_lightmap( NULL )
 {
+    m_sampler = Sampler( sequence );
+}
+
+// ** IndirectLight::bakeMesh
+RelightStatus IndirectLight::bakeMesh( const Mesh* mesh )
+{
+    m_lightmap = mesh->lightmap();
+    m_records.clear();
 
+    return Baker::bakeMesh( mesh );
 }
 
 // ** IndirectLight::bakeLumel
 void IndirectLight::bakeLumel( Lumel& lumel )
 {
-    Rgb          gathered( 0, 0, 0 );
-    rt::ITracer* tracer = m_scene->tracer();
+    if( m_samples == 0 ) {
+        return;
+    }
+
+    // ** Interpolate from the coarsest grid of cache records that is valid at this lumel
+    if( m_cacheSpacing > 0 ) {
+        int   index = static_cast<int>( &lumel - m_lightmap->lumels() );
+        int   x     = index % m_lightmap->width();
+        int   y     = index / m_lightmap->width();
+        Rgb   irradiance;
+
+        if( Statistics::isEnabled() ) {
+            Statistics::recordSamples( 1, 0 );
+        }
+
+        for( int spacing = m_cacheSpacing; spacing > 1; spacing /= 2 ) {
+            if( interpolate( lumel, x, y, spacing, irradiance ) ) {
+                lumel.m_color += irradiance;
+                return;
+            }
+        }
+
+        if( const Record* cached = record( x, y ) ) {
+            lumel.m_color += cached->m_irradiance;
+        }
+
+        return;
+    }
+
+    // ** Adaptive sampling depends on results of each round, so it's rays are not deferred
+    if( m_tolerance > 0.0f ) {
+        float distance;
+
+        if( Statistics::isEnabled() ) {
+            Statistics::recordSamples( 1, 0 );
+        }
+
+        lumel.m_color += gather( lumel, distance );
+        return;
+    }
+
+    generate( lumel, m_rays.allocate( m_samples ), m_samples );
+    m_lumels.push_back( &lumel );
+
+    if( m_rays.size() >= m_batchSize ) {
+        flush();
+    }
+}
+
+// ** IndirectLight::flush
+void IndirectLight::flush( void )
+{
+    if( m_lumels.empty() ) {
+        return;
+    }
+
+    m_rays.trace( m_scene->tracer(), m_batchSize > 0 );
+
+    for( int i = 0, n = ( int )m_lumels.size(); i < n; i++ ) {
+        Lumel& lumel           = *m_lumels[i];
+        Rgb    gathered( 0, 0, 0 );
+        float  inverseDistance = 0.0f;
+
+        for( int k = 0; k < m_samples; k++ ) {
+            gathered += sample( lumel, m_rays.segment( i * m_samples + k ), inverseDistance );
+        }
+
+        lumel.m_color += gathered / static_cast<float>( m_samples );
+    }
+
+    if( Statistics::isEnabled() ) {
+        Statistics::recordSamples( ( int )m_lumels.size(), ( int )m_lumels.size() * m_samples );
+    }
+
+    m_rays.clear();
+    m_lumels.clear();
+}
+
+// ** IndirectLight::generate
+void IndirectLight::generate( const Lumel& lumel, rt::Segment* segments, int count )
+{
+    int flags = rt::HitUv | rt::HitNormal;
+
+    if( m_cacheSpacing > 0 ) {
+        flags |= rt::HitPoint;
+    }
+
+    for( int k = 0; k < count; k++ ) {
+        Vec3 dir = m_sampler.hemisphereDirectionCosine( lumel.m_normal );
+        segments[k] = rt::Segment( lumel.m_position, lumel.m_position + dir * m_maxDistance, flags );
+    }
+}
 
-    for( int k = 0; k < m_samples; k++ ) {
-        Vec3    dir       = Vec3::randomHemisphereDirection( lumel.m_normal );
+// ** IndirectLight::sample
+Rgb IndirectLight::sample( const Lumel& /*lumel*/, const rt::Segment& segment, float& inverseDistance ) const
+{
+    const rt::Hit& hit = segment.m_hit;
+    Vec3           dir = segment.m_end - segment.m_start;
+
+    // ** Rays are cosine distributed, so a cosine term cancels out with a sample PDF, and a constant
+    //    weight of one half keeps the scale of an average cosine weighted light over a uniform hemisphere
+    const float influence = 0.5f;
+
+    if( !hit ) {
+        inverseDistance += 1.0f / m_maxDistance;
+        return m_skyColor * influence + m_ambientColor;
+    }
 
-        float   influence = max2( lumel.m_normal * dir, 0.0f );
-		DC_BREAK_IF( influence > 1.0f );
+    inverseDistance += 1.0f / max2( (hit.m_point - segment.m_start).length(), 0.001f );
 
-        rt::Hit hit       = tracer->traceSegment( lumel.m_position, lumel.m_position + dir * m_maxDistance, rt::HitUv | rt::HitNormal );
+    if( dir * hit.m_normal >= 0.0f ) {
+        return Rgb( 0, 0, 0 );
+    }
 
-        if( !hit ) {
-            gathered += m_skyColor * influence + m_ambientColor;
+    if( const Photonmap* photons = hit.m_mesh->photonmap() ) {
+        return photons->lumel( hit.m_uv ).m_gathered * influence + m_ambientColor;
+    }
+
+    return Rgb( 0, 0, 0 );
+}
+
+// ** IndirectLight::gather
+Rgb IndirectLight::gather( const Lumel& lumel, float& distance )
+{
+    Rgb   gathered( 0, 0, 0 );
+    float inverseDistance = 0.0f;
+    int   taken           = 0;
+    int   first           = m_tolerance > 0.0f ? m_minSamples : m_samples;
+
+    m_luminance.clear();
+
+    // ** Each round takes a half of samples taken so far, so the convergence is checked a logarithmic amount of times
+    while( taken < m_samples ) {
+        int count = min2( taken ? max2( m_minSamples, taken / 2 ) : first, m_samples - taken );
+
+        generate( lumel, m_rays.allocate( count ), count );
+        m_rays.trace( m_scene->tracer(), false );
+
+        for( int k = 0; k < count; k++ ) {
+            Rgb color = sample( lumel, m_rays.segment( k ), inverseDistance );
+
+            gathered    += color;
+            m_luminance << color.luminance();
+        }
+
+        m_rays.clear();
+        taken += count;
+
+        // ** The tolerance is relative to a gathered light, so dark and bright lumels converge alike,
+        //    a first round is never final, because few rays may see no light at all in a dim lumel
+        if( m_tolerance > 0.0f && taken > m_minSamples && isConverged( m_luminance, m_tolerance * m_luminance.mean() ) ) {
+            break;
+        }
+    }
+
+    if( Statistics::isEnabled() ) {
+        Statistics::recordSamples( 0, taken );
+    }
+
+    if( taken == 0 ) {
+        distance = m_maxDistance;
+        return gathered;
+    }
+
+    distance = taken / inverseDistance;
+
+    return gathered / static_cast<float>( taken );
+}
+
+// ** IndirectLight::record
+const IndirectLight::Record* IndirectLight::record( int x, int y )
+{
+    int index = y * m_lightmap->width() + x;
+
+    Records::const_iterator i = m_records.find( index );
+
+    if( i != m_records.end() ) {
+        return &i->second;
+    }
+
+    const Lumel& lumel = m_lightmap->lumels()[index];
+
+    if( !lumel ) {
+        return NULL;
+    }
+
+    // ** Records are seeded by their own lumels, so a record equals a plain final gather at it's lumel
+    seed( m_lightmap, lumel );
+
+    Record& record = m_records[index];
+
+    record.m_position   = lumel.m_position;
+    record.m_normal     = lumel.m_normal;
+    record.m_irradiance = gather( lumel, record.m_distance );
+
+    return &record;
+}
+
+// ** IndirectLight::interpolate
+bool IndirectLight::interpolate( const Lumel& lumel, int x, int y, int spacing, Rgb& irradiance )
+{
+    int   x0          = x - x % spacing;
+    int   y0          = y - y % spacing;
+    Rgb   sum( 0, 0, 0 );
+    float totalWeight = 0.0f;
+
+    for( int i = 0; i < 4; i++ ) {
+        int cx = x0 + (i & 1) * spacing;
+        int cy = y0 + (i >> 1) * spacing;
+
+        if( cx >= m_lightmap->width() || cy >= m_lightmap->height() ) {
+            continue;
+        }
+
+        const Record* cached = record( cx, cy );
+
+        if( !cached ) {
             continue;
         }
 
-		if( dir * hit.m_normal >= 0.0f ) {
-			continue;
-		}
+        // ** Ward's split sphere error of a record at this lumel
+        float error = (lumel.m_position - cached->m_position).length() / cached->m_distance + sqrtf( max2( 1.0f - lumel.m_normal * cached->m_normal, 0.0f ) );
 
-        if( const Photonmap* photons = hit.m_mesh->photonmap() ) {
-            gathered += photons->lumel( hit.m_uv ).m_gathered * influence + m_ambientColor;
+        if( error >= m_cacheError ) {
+            return false;
         }
+
+        if( error < 0.0001f ) {
+            irradiance = cached->m_irradiance;
+            return true;
+        }
+
+        sum         += cached->m_irradiance * (1.0f / error);
+        totalWeight += 1.0f / error;
+    }
+
+    if( totalWeight == 0.0f ) {
+        return false;
     }
 
-    lumel.m_color += gathered / static_cast<float>( m_samples );
+    irradiance = sum / totalWeight;
+    return true;
 }
 
 } // namespace bake
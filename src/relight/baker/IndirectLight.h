@@ -28,6 +28,7 @@
 #define __Relight_Bake_IndirectLight_H__
 
 #include "Baker.h"
+#include "../rt/RayBuffer.h"
 
 namespace relight {
 
@@ -46,22 +47,83 @@ namespace bake {
                                  \param maxDistance Maximum distance to gather photons at.
                                  \param radius Final gather radius.
                                  \param skyColor A sky color.
+                                 \param batchSize Final gather rays of lumels are deferred until this amount is collected, zero traces rays of each lumel immediately.
+                                 \param cacheSpacing Maximum lightmap distance in lumels between irradiance cache records, zero gathers at every lumel.
+                                 \param cacheError Maximum irradiance cache interpolation error.
+                                 \param minSamples Amount of samples taken by a first adaptive sampling round, each next round takes a half of samples taken so far.
+                                 \param tolerance Maximum confidence interval half width of a gathered luminance relative to it's mean at which adaptive sampling stops, zero always takes all samples.
+                                 \param sequence Sample sequence used to generate final gather ray directions.
                                  */
-                                IndirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float maxDistance, int radius, const Rgb& skyColor, const Rgb& ambientColor );
+                                IndirectLight( const Scene* scene, Progress* progress, BakeIterator* iterator, int samples, float maxDistance, int radius, const Rgb& skyColor, const Rgb& ambientColor, int batchSize = 0, int cacheSpacing = 0, float cacheError = 0.0f, int minSamples = 0, float tolerance = 0.0f, Sampler::Sequence sequence = Sampler::Sobol );
+
+        //! Bakes an indirect light to a mesh, irradiance cache records are kept until the next mesh baked by this instance.
+        virtual RelightStatus   bakeMesh( const Mesh* mesh );
 
     protected:
 
-        //! Bakes an indirect light to a given lumel.
+        //! Generates final gather rays of a given lumel.
         virtual void            bakeLumel( Lumel& lumel );
 
+        //! Traces all deferred final gather rays and adds a gathered light to their lumels.
+        virtual void            flush( void );
+
         //! Geathers photons at a given point with radius.
         Rgb                     geather( const Lightmap* lightmap, int x, int y ) const;
 
     private:
 
-        //! Final gather samples.
+        //! An irradiance cache record, gathered at a single lumel and reused by lumels around it.
+        struct Record {
+            Vec3                m_position;     //!< Record world space position.
+            Vec3                m_normal;       //!< Record world space normal.
+            Rgb                 m_irradiance;   //!< Gathered irradiance.
+            float               m_distance;     //!< Harmonic mean distance to surfaces seen from a record.
+        };
+
+        //! Irradiance cache records indexed by a lumel index.
+        typedef Map<int, Record> Records;
+
+        //! Generates a given amount of cosine weighted final gather rays for a lumel.
+        void                    generate( const Lumel& lumel, rt::Segment* segments, int count );
+
+        //! Returns a light gathered by a single traced ray and accumulates an inverse distance to a hit surface.
+        Rgb                     sample( const Lumel& lumel, const rt::Segment& segment, float& inverseDistance ) const;
+
+        //! Runs an immediate final gather at a lumel and returns a harmonic mean distance to hit surfaces.
+        /*!
+         When an adaptive sampling is enabled, rays are traced in rounds until a gathered luminance converges or all samples are taken.
+         */
+        Rgb                     gather( const Lumel& lumel, float& distance );
+
+        //! Returns an irradiance cache record at a given lightmap lumel, gathering it on a first request.
+        /*!
+         Records only depend on a lumel they are gathered at, so a bake result does not depend on a lumel order.
+         \return A cache record or NULL if there is no valid lumel at a given point.
+         */
+        const Record*           record( int x, int y );
+
+        //! Interpolates an irradiance at a lumel from records at corners of a lightmap grid cell it belongs to.
+        /*!
+         A split sphere error of each valid corner record should be below a cache error,
+         otherwise a lumel is not interpolated and a finer grid should be used.
+         \return True if an irradiance was interpolated, otherwise false.
+         */
+        bool                    interpolate( const Lumel& lumel, int x, int y, int spacing, Rgb& irradiance );
+
+    private:
+
+        //! Maximum amount of final gather samples.
         int                     m_samples;
 
+        //! Amount of samples taken by a first adaptive sampling round.
+        int                     m_minSamples;
+
+        //! Adaptive sampling tolerance.
+        float                   m_tolerance;
+
+        //! Luminance samples of a lumel being adaptively gathered.
+        Samples<float>          m_luminance;
+
         //! Final gather distance.
         float                   m_maxDistance;
 
@@ -73,6 +135,27 @@ namespace bake {
 
         //! Ambient scene color.
         Rgb                     m_ambientColor;
+
+        //! Amount of rays collected before they are traced.
+        int                     m_batchSize;
+
+        //! Final gather rays of deferred lumels, each lumel owns m_samples continuous rays.
+        rt::RayBuffer           m_rays;
+
+        //! Lumels waiting for their rays to be traced.
+        Array<Lumel*>           m_lumels;
+
+        //! Maximum lightmap distance between irradiance cache records.
+        int                     m_cacheSpacing;
+
+        //! Maximum irradiance cache interpolation error.
+        float                   m_cacheError;
+
+        //! Lightmap of a mesh being baked.
+        Lightmap*               m_lightmap;
+
+        //! Irradiance cache records of a mesh being baked.
+        Records                 m_records;
     };
 
 } // namespace bake
@@ -34,14 +34,18 @@
 #include "../scene/Mesh.h"
 #include "../Lightmap.h"
 #include "../rt/Tracer.h"
+#include "../Statistics.h"
 
 namespace relight {
 
 namespace bake {
 
+//! Amount of photons emitted by a single chunk.
+const int k_PhotonChunkSize = 1024;
+
 // ** Photons::Photons
-Photons::Photons( const Scene* scene, int passCount, int maxDepth, float energyThreshold, float maxDistance )
-    : m_scene( scene ), m_passCount( passCount ), m_maxDepth( maxDepth ), m_energyThreshold( energyThreshold ), m_maxDistance( maxDistance ), m_photonCount( 0 )
+Photons::Photons( const Scene* scene, int passCount, int maxDepth, float energyThreshold, float maxDistance, Sampler::Sequence sequence )
+    : m_scene( scene ), m_passCount( passCount ), m_maxDepth( maxDepth ), m_energyThreshold( energyThreshold ), m_maxDistance( maxDistance ), m_photonCount( 0 ), m_sequence( sequence )
 {
 
 }
@@ -49,6 +53,20 @@ Photons::Photons( const Scene* scene, int passCount, int maxDepth, float energyT
 // ** Photons::emit
 RelightStatus Photons::emit( void )
 {
+    Worker  worker;
+    Workers workers;
+    workers.push_back( &worker );
+
+    return emit( workers );
+}
+
+// ** Photons::emit
+RelightStatus Photons::emit( const Workers& workers )
+{
+    Array<Chunk*> chunks;
+    int           first = 0;
+
+    // ** Split emitted photons into chunks
     for( int j = 0; j < m_passCount; j++ ) {
         for( int i = 0, n = m_scene->lightCount(); i < n; i++ ) {
             const Light* light = m_scene->light( i );
@@ -57,23 +75,54 @@ RelightStatus Photons::emit( void )
                 continue;
             }
 
-            emitPhotons( light );
+            for( int k = 0, count = light->photonEmitter()->photonCount(); k < count; k += k_PhotonChunkSize ) {
+                chunks.push_back( new Chunk( this, light, first, min2( k_PhotonChunkSize, count - k ) ) );
+                first += chunks.back()->m_count;
+            }
         }
     }
 
+    // ** Trace chunks on all workers
+    for( int i = 0; i < ( int )chunks.size(); i++ ) {
+        JobData* data   = new JobData;
+        data->m_scene   = m_scene;
+        data->m_job     = chunks[i];
+
+        workers[i % workers.size()]->push( chunks[i], data );
+    }
+
+    for( int i = 0; i < ( int )workers.size(); i++ ) {
+        workers[i]->wait();
+    }
+
+    // ** Merge chunks in the emission order
+    for( int i = 0; i < ( int )chunks.size(); i++ ) {
+        merge( chunks[i] );
+        delete chunks[i];
+    }
+
     return RelightSuccess;
 }
 
 // ** Photons::emitPhotons
-void Photons::emitPhotons( const Light* light )
+void Photons::emitPhotons( Chunk* chunk )
 {
+    const Light*   light     = chunk->m_light;
     PhotonEmitter* emitter   = light->photonEmitter();
     Vec3           direction;
     Vec3           position;
 
-    for( int i = 0, n = emitter->photonCount(); i < n; i++ ) {
+    // ** All chunks share a sequence scrambling drawn from a separate stream, so emitted photons form a single sequence
+    chunk->m_random.seed( 0, 1 );
+    chunk->m_sampler.start( chunk->m_random );
+
+    for( int i = 0; i < chunk->m_count; i++ ) {
+        // ** Photon path samples depend only on a photon index
+        chunk->m_random.seed( chunk->m_first + i );
+        chunk->m_sampler.setIndex( chunk->m_first + i );
+
         // ** Emit photon
-        emitter->emit( m_scene, position, direction );
+        emitter->emit( m_scene, position, direction, chunk->m_sampler, chunk->m_random );
 
         // ** Calculate light cutoff
         float cut = 1.0f;
@@ -87,19 +136,19 @@ void Photons::emitPhotons( const Light* light )
         }
 
         // ** Trace photon
-        trace( light->attenuation(), position, direction, light->color() * light->intensity() * cut, 0 );
+        trace( light->attenuation(), position, direction, light->color() * light->intensity() * cut, 0, chunk );
     }
 }
 
 // ** Photons::trace
-void Photons::trace( const LightAttenuation* attenuation, const Vec3& position, const Vec3& direction, const Rgb& color, int depth )
+void Photons::trace( const LightAttenuation* attenuation, const Vec3& position, const Vec3& direction, const Rgb& color, int depth, Chunk* chunk )
 {
     // ** Maximum depth or energy threshold exceeded
     if( depth > m_maxDepth || color.luminance() < m_energyThreshold ) {
         return;
     }
 
-    rt::Hit hit = m_scene->tracer()->traceSegment( position, position + direction * m_maxDistance );
+    rt::Hit hit = m_scene->tracer()->traceSegment( position, position + direction * m_maxDistance, rt::HitAll );
 
     // ** The photon didn't hit anything
     if( !hit ) {
@@ -119,14 +168,14 @@ void Photons::trace( const LightAttenuation* attenuation, const Vec3& position,
     Rgb hitColor = color * Rgb( hit.m_color ) * influence;
 
     // ** Store photon energy
-    store( hit.m_mesh->photonmap(), hitColor, hit.m_uv );
+    store( chunk, hit.m_mesh->photonmap(), hitColor, hit.m_uv );
 
-    // ** Keep tracing
-    trace( attenuation, hit.m_point, Vec3::randomHemisphereDirection( hit.m_normal ), hitColor, depth + 1 );
+    // ** Keep tracing, a diffuse reflection scatters photons by a cosine term
+    trace( attenuation, hit.m_point, Vec3::randomHemisphereDirectionCosine( hit.m_normal, chunk->m_random ), hitColor, depth + 1, chunk );
 }
 
 // ** Photons::store
-void Photons::store( Photonmap* photonmap, const Rgb& color, const Uv& uv )
+void Photons::store( Chunk* chunk, Photonmap* photonmap, const Rgb& color, const Uv& uv )
 {
     if( !photonmap ) {
         return;
@@ -137,10 +186,39 @@ void Photons::store( Photonmap* photonmap, const Rgb& color, const Uv& uv )
         return;
     }
 
-    lumel.m_color += color;
-    lumel.m_photons++;
+    StoredPhoton photon;
+    photon.m_photonmap = photonmap;
+    photon.m_lumel     = static_cast<int>( &lumel - photonmap->lumels() );
+    photon.m_color     = color;
+
+    chunk->m_photons.push_back( photon );
+}
+
+// ** Photons::merge
+void Photons::merge( const Chunk* chunk )
+{
+    for( int i = 0, n = ( int )chunk->m_photons.size(); i < n; i++ ) {
+        const StoredPhoton& photon = chunk->m_photons[i];
+        Lumel&              lumel  = photon.m_photonmap->lumels()[photon.m_lumel];
+
+        lumel.m_color += photon.m_color;
+        lumel.m_photons++;
+    }
 
-    m_photonCount++;
+    m_photonCount += ( int )chunk->m_photons.size();
+}
+
+// ** Photons::Chunk::Chunk
+Photons::Chunk::Chunk( Photons* photons, const Light* light, int first, int count ) : m_parent( photons ), m_light( light ), m_first( first ), m_count( count ), m_sampler( photons->m_sequence )
+{
+
+}
+
+// ** Photons::Chunk::execute
+void Photons::Chunk::execute( JobData* )
+{
+    Statistics::Stage stage( RayPhoton );
+    m_parent->emitPhotons( this );
 }
 
 } // namespace bake
@@ -28,12 +28,22 @@
 #define __Relight_Bake_Photons_H__
 
 #include "Baker.h"
+#include "../Worker.h"
 
 namespace relight {
 
 namespace bake {
 
     // ** class Photons
+    /*!
+     Photons are emitted in fixed size chunks that are traced in parallel. Each chunk
+     stores photon bounces to its own buffer, and buffers are merged to photon maps in
+     a chunk order once all of them are traced, so no locking is required and the result
+     does not depend on a thread count. Each photon path is sampled by a random number
+     generator seeded by a photon index, so the result is reproducible as well. Emission
+     directions are points of a single sample sequence indexed by a photon index, so they
+     are stratified over all photons of a light, while bounces stay pseudo random.
+     */
     class Photons {
     public:
 
@@ -44,16 +54,46 @@ namespace bake {
                                  \param maxDepth Maximum photon tracing depth (number of light bounces).
                                  \param energyThreshold The minimum energy that photon should have to continue tracing.
                                  \param maxDistance The reflected light maximum distance. All intersections above this value will be ignored.
+                                 \param sequence Sample sequence used to generate photon emission samples.
                                  */
-                                Photons( const Scene* scene, int passCount, int maxDepth, float energyThreshold, float maxDistance );
+                                Photons( const Scene* scene, int passCount, int maxDepth, float energyThreshold, float maxDistance, Sampler::Sequence sequence = Sampler::Sobol );
 
         //! Emits photons from all scene lights.
         virtual RelightStatus   emit( void );
 
+        //! Emits photons from all scene lights using a set of workers.
+        virtual RelightStatus   emit( const Workers& workers );
+
     private:
 
-        //! Emits photons from a given light.
-        void                    emitPhotons( const Light* light );
+        //! A photon bounce stored by a chunk.
+        struct StoredPhoton {
+            Photonmap*          m_photonmap;    //!< Target photon map.
+            int                 m_lumel;        //!< Target lumel index.
+            Rgb                 m_color;        //!< Photon color.
+        };
+
+        //! A range of photons emitted from a single light that is traced by a single job.
+        class Chunk : public Job {
+        public:
+
+                                //! Constructs a Chunk instance.
+                                Chunk( Photons* photons, const Light* light, int first, int count );
+
+            //! Traces all chunk photons.
+            virtual void        execute( JobData* data );
+
+            Photons*            m_parent;   //!< Parent photon tracer.
+            const Light*        m_light;    //!< Light to emit photons from.
+            int                 m_first;    //!< Index of the first chunk photon among all emitted photons.
+            int                 m_count;    //!< Amount of photons to emit.
+            Array<StoredPhoton> m_photons;  //!< Stored photon bounces.
+            Random              m_random;   //!< Random number generator, reseeded for each photon.
+            Sampler             m_sampler;  //!< Emission sample sequence, shared by all chunks.
+        };
+
+        //! Emits a chunk of photons.
+        void                    emitPhotons( Chunk* chunk );
 
         //! Traces a photon path for a given depth.
         /*!
@@ -66,11 +106,15 @@ namespace bake {
          \param color Photon's color.
          \param energy Photon's energy.
          \param depth Current trace depth.
+         \param chunk A chunk to store photon bounces to.
          */
-        void                    trace( const LightAttenuation* attenuation, const Vec3& position, const Vec3& direction, const Rgb& color, int depth );
+        void                    trace( const LightAttenuation* attenuation, const Vec3& position, const Vec3& direction, const Rgb& color, int depth, Chunk* chunk );
 
-        //! Stores a photon bounce.
-        void                    store( Photonmap* photonmap, const Rgb& color, const Uv& uv );
+        //! Stores a photon bounce to a chunk buffer.
+        void                    store( Chunk* chunk, Photonmap* photonmap, const Rgb& color, const Uv& uv );
+
+        //! Merges stored photon bounces to photon maps.
+        void                    merge( const Chunk* chunk );
 
     private:
 
@@ -91,6 +135,9 @@ namespace bake {
 
         //! Total amount of photons stored.
         int                     m_photonCount;
+
+        //! Emission sample sequence.
+        Sampler::Sequence       m_sequence;
     };
 
 } // namespace bake
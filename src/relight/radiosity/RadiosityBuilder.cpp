@@ -31,6 +31,7 @@
 #include "../scene/Mesh.h"
 #include "../rt/Tracer.h"
 #include "../Lightmap.h"
+#include "../Statistics.h"
 
 namespace relight {
 
@@ -96,15 +97,17 @@ void RadiosityBuilder::createPatches( Radiosity& radiosity )
 }
 
 // ** RadiosityBuilder::refineFormFactors
-void RadiosityBuilder::refineFormFactors( Radiosity::Patch& sample )
+void RadiosityBuilder::refineFormFactors( Radiosity::Patch& sample, s32 index )
 {
 	if( sample.m_ff.empty() ) {
 		return;
 	}
 
 	if( m_maxFormFactors ) {
+		Random random( index );
+
 		while( sample.m_ff.size() > m_maxFormFactors ) {
-			sample.m_ff.erase( sample.m_ff.begin() + rand() % sample.m_ff.size() );
+			sample.m_ff.erase( sample.m_ff.begin() + random.next( ( s32 )sample.m_ff.size() ) );
 		}
 	}
 
@@ -125,6 +128,7 @@ void RadiosityBuilder::refineFormFactors( Radiosity::Patch& sample )
 // ** RadiosityBuilder::ComputeFormFactors
 void RadiosityBuilder::computeFormFactors( Radiosity& radiosity )
 {
+	Statistics::Stage stage( RayFormFactor );
 	s32 n = radiosity.patchCount();
 
 	for( s32 i = 0; i < n; i++ ) {
@@ -134,7 +138,7 @@ void RadiosityBuilder::computeFormFactors( Radiosity& radiosity )
 			distanceFormFactor( m_scene, patch, radiosity.patch( j ), m_formFactorThreshold );
 		}
 
-		refineFormFactors( patch );
+		refineFormFactors( patch, i );
 	}
 }
 
@@ -165,8 +169,7 @@ void RadiosityBuilder::distanceFormFactor( Scene* scene, Radiosity::Patch& recei
 	}
 
 	// ** Trace scene
-	rt::Hit hit = scene->tracer()->traceSegment( rPos, sPos );
-	if( hit ) {
+	if( scene->tracer()->test( rPos, sPos ) ) {
 		return;
 	}
 
@@ -201,8 +204,7 @@ void RadiosityBuilder::distanceSqAreaFormFactor( Scene* scene, Radiosity::Patch&
 	}
 
 	// ** Trace scene
-	rt::Hit hit = scene->tracer()->traceSegment( rPos, sPos );
-	if( hit ) {
+	if( scene->tracer()->test( rPos, sPos ) ) {
 		return;
 	}
 
@@ -50,7 +50,7 @@ namespace relight {
 		void					computeFormFactors( Radiosity& radiosity );
 
 		//! Refines produced form factors
-		void					refineFormFactors( Radiosity::Patch& sample );
+		void					refineFormFactors( Radiosity::Patch& sample, s32 index );
 
 		//! Computes a distance-based form factor between patches.
 		static void				distanceFormFactor( Scene* scene, Radiosity::Patch& receiver, Radiosity::Patch& sender, f32 threshold );
@@ -0,0 +1,651 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+#include "../BuildCheck.h"
+
+#include "Bvh.h"
+#include "../scene/Mesh.h"
+
+#include <xmmintrin.h>
+
+namespace relight {
+
+namespace rt {
+
+// ** binIndex
+static int binIndex( float value, float min, float scale, int count )
+{
+    int index = static_cast<int>( (value - min) * scale );
+    return index < 0 ? 0 : (index >= count ? count - 1 : index);
+}
+
+// ** Bvh::Bvh
+Bvh::Bvh( void ) : m_rebuild( false ), m_refit( false )
+{
+
+}
+
+// ** Bvh::begin
+void Bvh::begin( void )
+{
+    m_meshes.clear();
+    m_decoder.clear();
+    m_triangles.clear();
+    m_nodes.clear();
+    m_rebuild = false;
+    m_refit   = false;
+}
+
+// ** Bvh::addMesh
+void Bvh::addMesh( const Mesh* mesh )
+{
+    m_meshes.push_back( mesh );
+    m_rebuild = true;
+}
+
+// ** Bvh::end
+void Bvh::end( void )
+{
+    rebuild();
+}
+
+// ** Bvh::removeMesh
+void Bvh::removeMesh( const Mesh* mesh )
+{
+    int index = meshIndex( mesh );
+
+    m_meshes[index] = NULL;
+    m_decoder.setMesh( index, NULL );
+
+    // ** Collapse triangles of a removed mesh to degenerate ones, so they are never hit
+    for( int i = 0, n = ( int )m_triangles.size(); i < n; i++ ) {
+        Triangle& triangle = m_triangles[i];
+
+        if( triangle.m_mesh == index ) {
+            triangle.m_e1 = Vec3( 0.0f, 0.0f, 0.0f );
+            triangle.m_e2 = Vec3( 0.0f, 0.0f, 0.0f );
+        }
+    }
+
+    m_refit = true;
+}
+
+// ** Bvh::updateMesh
+void Bvh::updateMesh( const Mesh* mesh )
+{
+    int index = meshIndex( mesh );
+
+    for( int i = 0, n = ( int )m_triangles.size(); i < n; i++ ) {
+        Triangle& triangle = m_triangles[i];
+
+        if( triangle.m_mesh == index ) {
+            initializeTriangle( triangle, index, triangle.m_face );
+        }
+    }
+
+    m_refit = true;
+}
+
+// ** Bvh::update
+void Bvh::update( void )
+{
+    if( m_rebuild ) {
+        rebuild();
+    } else if( m_refit ) {
+        refit();
+    }
+}
+
+// ** Bvh::meshIndex
+int Bvh::meshIndex( const Mesh* mesh ) const
+{
+    Array<const Mesh*>::const_iterator i = std::find( m_meshes.begin(), m_meshes.end(), mesh );
+    assert( i != m_meshes.end() );
+    return static_cast<int>( i - m_meshes.begin() );
+}
+
+// ** Bvh::initializeTriangle
+void Bvh::initializeTriangle( Triangle& triangle, int mesh, int face ) const
+{
+    const Mesh* instance = m_meshes[mesh];
+
+    // ** Vertices follow an index buffer order, so barycentric coordinates match Embree ones
+    Vec3 a = instance->worldPosition( instance->vertex( instance->index( face * 3 + 0 ) ).position );
+    Vec3 b = instance->worldPosition( instance->vertex( instance->index( face * 3 + 1 ) ).position );
+    Vec3 c = instance->worldPosition( instance->vertex( instance->index( face * 3 + 2 ) ).position );
+
+    triangle.m_v0    = a;
+    triangle.m_e1    = b - a;
+    triangle.m_e2    = c - a;
+    triangle.m_mesh  = mesh;
+    triangle.m_face  = face;
+    triangle.m_alpha = instance->hasAlpha();
+}
+
+// ** Bvh::rebuild
+void Bvh::rebuild( void )
+{
+    Array<Triangle>  triangles;
+    Array<Primitive> primitives;
+
+    // ** Drop removed meshes, so mesh indices are continuous again
+    m_meshes.erase( std::remove( m_meshes.begin(), m_meshes.end(), ( const Mesh* )NULL ), m_meshes.end() );
+    m_decoder.clear();
+    m_triangles.clear();
+    m_nodes.clear();
+    m_rebuild = false;
+    m_refit   = false;
+
+    // ** Transform all mesh triangles to a world space
+    for( int i = 0, n = ( int )m_meshes.size(); i < n; i++ ) {
+        const Mesh* mesh = m_meshes[i];
+        m_decoder.addMesh( mesh );
+
+        for( int j = 0, nfaces = mesh->faceCount(); j < nfaces; j++ ) {
+            Triangle triangle;
+            initializeTriangle( triangle, i, j );
+
+            Primitive primitive;
+            primitive.m_bounds << triangle.m_v0 << triangle.m_v0 + triangle.m_e1 << triangle.m_v0 + triangle.m_e2;
+            primitive.m_centroid = primitive.m_bounds.center();
+            primitive.m_index    = ( int )triangles.size();
+
+            triangles.push_back( triangle );
+            primitives.push_back( primitive );
+        }
+    }
+
+    if( primitives.empty() ) {
+        return;
+    }
+
+    build( primitives, 0, ( int )primitives.size() );
+
+    // ** Reorder triangles, so each leaf references a continuous range
+    m_triangles.reserve( triangles.size() );
+
+    for( int i = 0, n = ( int )primitives.size(); i < n; i++ ) {
+        m_triangles.push_back( triangles[primitives[i].m_index] );
+    }
+}
+
+// ** Bvh::refit
+void Bvh::refit( void )
+{
+    m_refit = false;
+
+    // ** Child nodes are always stored after their parents, so a reverse order visits children first
+    for( int i = ( int )m_nodes.size() - 1; i >= 0; i-- ) {
+        Node& node = m_nodes[i];
+
+        for( int j = 0; j < node.m_size; j++ ) {
+            Bounds childBounds;
+
+            if( node.m_count[j] ) {
+                for( int k = node.m_child[j], end = node.m_child[j] + node.m_count[j]; k < end; k++ ) {
+                    const Triangle& triangle = m_triangles[k];
+                    childBounds << triangle.m_v0 << triangle.m_v0 + triangle.m_e1 << triangle.m_v0 + triangle.m_e2;
+                }
+            } else {
+                const Node& child = m_nodes[node.m_child[j]];
+
+                for( int k = 0; k < child.m_size; k++ ) {
+                    childBounds << Vec3( child.m_min[0][k], child.m_min[1][k], child.m_min[2][k] );
+                    childBounds << Vec3( child.m_max[0][k], child.m_max[1][k], child.m_max[2][k] );
+                }
+            }
+
+            for( int axis = 0; axis < 3; axis++ ) {
+                node.m_min[axis][j] = childBounds.min()[axis];
+                node.m_max[axis][j] = childBounds.max()[axis];
+            }
+        }
+    }
+}
+
+// ** Bvh::memoryUsage
+u64 Bvh::memoryUsage( void ) const
+{
+    return m_nodes.capacity() * sizeof( Node ) + m_triangles.capacity() * sizeof( Triangle ) + m_decoder.memoryUsage();
+}
+
+// ** Bvh::build
+int Bvh::build( Array<Primitive>& primitives, int first, int count )
+{
+    int index = ( int )m_nodes.size();
+    m_nodes.push_back( Node() );
+
+    // ** Split a primitive range into up to 4 child ranges, the largest range is split first
+    int rangeFirst[4] = { first };
+    int rangeCount[4] = { count };
+    int size          = 1;
+
+    while( size < 4 ) {
+        int   best     = -1;
+        float bestArea = -1.0f;
+
+        for( int i = 0; i < size; i++ ) {
+            if( rangeCount[i] <= MaxLeafSize ) {
+                continue;
+            }
+
+            float rangeArea = area( bounds( primitives, rangeFirst[i], rangeCount[i] ) );
+
+            if( rangeArea > bestArea ) {
+                best     = i;
+                bestArea = rangeArea;
+            }
+        }
+
+        if( best < 0 ) {
+            break;
+        }
+
+        int mid = split( primitives, rangeFirst[best], rangeCount[best] );
+
+        rangeFirst[size]  = mid;
+        rangeCount[size]  = rangeFirst[best] + rangeCount[best] - mid;
+        rangeCount[best]  = mid - rangeFirst[best];
+        size++;
+    }
+
+    // ** Fill node slots, inner nodes are built recursively
+    Node node;
+    memset( &node, 0, sizeof( node ) );
+    node.m_size = size;
+
+    for( int i = 0; i < size; i++ ) {
+        Bounds childBounds = bounds( primitives, rangeFirst[i], rangeCount[i] );
+
+        for( int axis = 0; axis < 3; axis++ ) {
+            node.m_min[axis][i] = childBounds.min()[axis];
+            node.m_max[axis][i] = childBounds.max()[axis];
+        }
+
+        if( rangeCount[i] <= MaxLeafSize ) {
+            node.m_child[i] = rangeFirst[i];
+            node.m_count[i] = rangeCount[i];
+        } else {
+            node.m_child[i] = build( primitives, rangeFirst[i], rangeCount[i] );
+            node.m_count[i] = 0;
+        }
+    }
+
+    m_nodes[index] = node;
+
+    return index;
+}
+
+// ** Bvh::split
+int Bvh::split( Array<Primitive>& primitives, int first, int count ) const
+{
+    // ** Tests if a primitive centroid falls to the left of a split bin
+    struct IsLeft {
+        int     m_axis;
+        float   m_min;
+        float   m_scale;
+        int     m_bin;
+
+        bool operator()( const Primitive& primitive ) const { return binIndex( primitive.m_centroid[m_axis], m_min, m_scale, BinCount ) < m_bin; }
+    };
+
+    Bounds centroids;
+
+    for( int i = first; i < first + count; i++ ) {
+        centroids << primitives[i].m_centroid;
+    }
+
+    float  bestCost  = FLT_MAX;
+    IsLeft bestSplit = { -1, 0.0f, 0.0f, 0 };
+
+    for( int axis = 0; axis < 3; axis++ ) {
+        float min    = centroids.min()[axis];
+        float extent = centroids.max()[axis] - min;
+
+        if( extent <= 0.0f ) {
+            continue;
+        }
+
+        // ** Bin primitives by their centroids
+        float  scale = BinCount / extent;
+        Bounds binBounds[BinCount];
+        int    binCount[BinCount] = { 0 };
+
+        for( int i = first; i < first + count; i++ ) {
+            int bin = binIndex( primitives[i].m_centroid[axis], min, scale, BinCount );
+            binBounds[bin] += primitives[i].m_bounds;
+            binCount[bin]++;
+        }
+
+        // ** Sweep bins from the left to accumulate areas and counts of left parts
+        float  leftArea[BinCount];
+        int    leftCount[BinCount];
+        Bounds accumulated;
+        int    accumulatedCount = 0;
+
+        for( int i = 0; i < BinCount; i++ ) {
+            if( binCount[i] ) {
+                accumulated += binBounds[i];
+                accumulatedCount += binCount[i];
+            }
+
+            leftArea[i]  = accumulatedCount ? area( accumulated ) : 0.0f;
+            leftCount[i] = accumulatedCount;
+        }
+
+        // ** Sweep bins from the right and evaluate a cost of each split
+        accumulated      = Bounds();
+        accumulatedCount = 0;
+
+        for( int i = BinCount - 1; i > 0; i-- ) {
+            if( binCount[i] ) {
+                accumulated += binBounds[i];
+                accumulatedCount += binCount[i];
+            }
+
+            if( !accumulatedCount || !leftCount[i - 1] ) {
+                continue;
+            }
+
+            float cost = leftArea[i - 1] * leftCount[i - 1] + area( accumulated ) * accumulatedCount;
+
+            if( cost < bestCost ) {
+                IsLeft split = { axis, min, scale, i };
+                bestCost  = cost;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // ** All centroids are at the same point, split a range in half
+    if( bestSplit.m_axis < 0 ) {
+        return first + count / 2;
+    }
+
+    Primitive* begin = &primitives[0] + first;
+    Primitive* mid   = std::partition( begin, begin + count, bestSplit );
+
+    return first + static_cast<int>( mid - begin );
+}
+
+// ** Bvh::bounds
+Bounds Bvh::bounds( const Array<Primitive>& primitives, int first, int count )
+{
+    Bounds result;
+
+    for( int i = first; i < first + count; i++ ) {
+        result += primitives[i].m_bounds;
+    }
+
+    return result;
+}
+
+// ** Bvh::area
+float Bvh::area( const Bounds& bounds )
+{
+    float width  = bounds.width();
+    float height = bounds.height();
+    float depth  = bounds.depth();
+
+    return 2.0f * (width * height + height * depth + depth * width);
+}
+
+// ** Bvh::initializeRay
+void Bvh::initializeRay( Ray& ray, const Vec3& start, const Vec3& end, int flags ) const
+{
+    ray.m_origin    = start;
+    ray.m_direction = end - start;
+    ray.m_far       = ray.m_direction.normalize();
+    ray.m_near      = 0.01f;
+    ray.m_useAlpha  = (flags & HitUseAlpha) != 0;
+    ray.m_anyHit    = false;
+    ray.m_triangle  = -1;
+    ray.m_u         = 0.0f;
+    ray.m_v         = 0.0f;
+
+    // ** Avoid infinite slab distances for axis aligned rays
+    for( int i = 0; i < 3; i++ ) {
+        float d = ray.m_direction[i];
+
+        if( fabsf( d ) < 1e-12f ) {
+            d = d < 0.0f ? -1e-12f : 1e-12f;
+        }
+
+        ray.m_invDirection[i] = 1.0f / d;
+    }
+}
+
+// ** Bvh::traverse
+bool Bvh::traverse( Ray& ray ) const
+{
+    if( m_nodes.empty() ) {
+        return false;
+    }
+
+    //! Hierarchy traversal stack item.
+    struct StackItem {
+        int     m_node;
+        float   m_near;
+    };
+
+    const __m128 ox = _mm_set1_ps( ray.m_origin.x );
+    const __m128 oy = _mm_set1_ps( ray.m_origin.y );
+    const __m128 oz = _mm_set1_ps( ray.m_origin.z );
+    const __m128 ix = _mm_set1_ps( ray.m_invDirection.x );
+    const __m128 iy = _mm_set1_ps( ray.m_invDirection.y );
+    const __m128 iz = _mm_set1_ps( ray.m_invDirection.z );
+    const __m128 tn = _mm_set1_ps( ray.m_near );
+
+    StackItem stack[MaxStackDepth];
+    int       top = 0;
+    bool      hit = false;
+
+    stack[top].m_node = 0;
+    stack[top].m_near = ray.m_near;
+    top++;
+
+    while( top > 0 ) {
+        top--;
+
+        if( stack[top].m_near > ray.m_far ) {
+            continue;
+        }
+
+        const Node& node = m_nodes[stack[top].m_node];
+
+        // ** Test a ray against all child bounds at once
+        __m128 tf   = _mm_set1_ps( ray.m_far );
+        __m128 t0   = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.m_min[0] ), ox ), ix );
+        __m128 t1   = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.m_max[0] ), ox ), ix );
+        __m128 tmin = _mm_max_ps( tn, _mm_min_ps( t0, t1 ) );
+        __m128 tmax = _mm_min_ps( tf, _mm_max_ps( t0, t1 ) );
+
+        t0   = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.m_min[1] ), oy ), iy );
+        t1   = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.m_max[1] ), oy ), iy );
+        tmin = _mm_max_ps( tmin, _mm_min_ps( t0, t1 ) );
+        tmax = _mm_min_ps( tmax, _mm_max_ps( t0, t1 ) );
+
+        t0   = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.m_min[2] ), oz ), iz );
+        t1   = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( node.m_max[2] ), oz ), iz );
+        tmin = _mm_max_ps( tmin, _mm_min_ps( t0, t1 ) );
+        tmax = _mm_min_ps( tmax, _mm_max_ps( t0, t1 ) );
+
+        int   mask = _mm_movemask_ps( _mm_cmple_ps( tmin, tmax ) ) & ((1 << node.m_size) - 1);
+        float distances[4];
+        int   inner[4];
+        int   innerCount = 0;
+
+        _mm_storeu_ps( distances, tmin );
+
+        // ** Leaves are intersected right away, inner nodes are collected
+        for( int i = 0; i < 4; i++ ) {
+            if( (mask & (1 << i)) == 0 ) {
+                continue;
+            }
+
+            if( node.m_count[i] == 0 ) {
+                inner[innerCount++] = i;
+                continue;
+            }
+
+            for( int j = node.m_child[i], end = node.m_child[i] + node.m_count[i]; j < end; j++ ) {
+                if( !intersect( ray, j ) ) {
+                    continue;
+                }
+
+                if( ray.m_anyHit ) {
+                    return true;
+                }
+
+                hit = true;
+            }
+        }
+
+        // ** Sort inner nodes from far to near, so the nearest one is popped first
+        for( int i = 1; i < innerCount; i++ ) {
+            for( int j = i; j > 0 && distances[inner[j]] > distances[inner[j - 1]]; j-- ) {
+                std::swap( inner[j], inner[j - 1] );
+            }
+        }
+
+        for( int i = 0; i < innerCount; i++ ) {
+            assert( top < MaxStackDepth );
+            stack[top].m_node = node.m_child[inner[i]];
+            stack[top].m_near = distances[inner[i]];
+            top++;
+        }
+    }
+
+    return hit;
+}
+
+// ** Bvh::intersect
+bool Bvh::intersect( Ray& ray, int index ) const
+{
+    const Triangle& triangle = m_triangles[index];
+
+    Vec3  p   = ray.m_direction % triangle.m_e2;
+    float det = triangle.m_e1 * p;
+
+    if( fabsf( det ) < 1e-12f ) {
+        return false;
+    }
+
+    float inv = 1.0f / det;
+    Vec3  s   = ray.m_origin - triangle.m_v0;
+    float u   = (s * p) * inv;
+
+    if( u < 0.0f || u > 1.0f ) {
+        return false;
+    }
+
+    Vec3  q = s % triangle.m_e1;
+    float v = (ray.m_direction * q) * inv;
+
+    if( v < 0.0f || u + v > 1.0f ) {
+        return false;
+    }
+
+    float t = (triangle.m_e2 * q) * inv;
+
+    if( t < ray.m_near || t > ray.m_far ) {
+        return false;
+    }
+
+    // ** Skip transparent surfaces
+    if( ray.m_useAlpha && triangle.m_alpha ) {
+        Hit hit;
+        m_decoder.decode( hit, triangle.m_mesh, triangle.m_face, u, v, HitColor );
+
+        if( hit.m_color.a <= k_AlphaThreshold ) {
+            return false;
+        }
+    }
+
+    ray.m_far      = t;
+    ray.m_triangle = index;
+    ray.m_u        = u;
+    ray.m_v        = v;
+
+    return true;
+}
+
+// ** Bvh::decodeHit
+void Bvh::decodeHit( Hit& hit, const Ray& ray, int flags ) const
+{
+    const Triangle& triangle = m_triangles[ray.m_triangle];
+
+    hit = Hit();
+    hit.m_point = ray.m_origin + ray.m_direction * ray.m_far;
+
+    m_decoder.decode( hit, triangle.m_mesh, triangle.m_face, ray.m_u, ray.m_v, flags );
+}
+
+// ** Bvh::traceSegment
+Hit Bvh::traceSegment( const Vec3& start, const Vec3& end, int flags )
+{
+    Ray ray;
+    initializeRay( ray, start, end, flags );
+
+    Hit result;
+
+    if( traverse( ray ) ) {
+        decodeHit( result, ray, flags );
+    }
+
+    return result;
+}
+
+// ** Bvh::test
+bool Bvh::test( const Vec3& start, const Vec3& end, int flags )
+{
+    Ray ray;
+    initializeRay( ray, start, end, flags );
+    ray.m_anyHit = true;
+
+    return traverse( ray );
+}
+
+// ** Bvh::traceSegments
+void Bvh::traceSegments( Segment* segments, int count )
+{
+    for( int i = 0; i < count; i++ ) {
+        segments[i].m_hit = traceSegment( segments[i].m_start, segments[i].m_end, segments[i].m_flags );
+    }
+}
+
+// ** Bvh::testSegments
+void Bvh::testSegments( Segment* segments, int count )
+{
+    for( int i = 0; i < count; i++ ) {
+        segments[i].m_occluded = test( segments[i].m_start, segments[i].m_end, segments[i].m_flags );
+    }
+}
+
+} // namespace rt
+
+} // namespace relight
@@ -0,0 +1,177 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+#ifndef __Relight_RT_Bvh_H__
+#define __Relight_RT_Bvh_H__
+
+#include "Tracer.h"
+#include "HitDecoder.h"
+
+namespace relight {
+
+namespace rt {
+
+    // ** class Bvh
+    /*!
+     A self-contained ray tracer backend. Triangles of all scene meshes are transformed to a world space
+     and stored in a 4-wide bounding volume hierarchy built with a binned surface area heuristic. Child
+     bounding boxes of each node are tested against a ray at once with SSE instructions.
+
+     Transformed and removed meshes of a dynamic scene are handled by refitting node bounds in place,
+     a hierarchy topology is kept, so a tracing performance slowly degrades as meshes move far from
+     their original positions. Adding a mesh to a built hierarchy triggers a full rebuild.
+     */
+    class Bvh : public ITracer {
+    public:
+
+                        Bvh( void );
+
+        // ** ITracer
+        virtual Hit     traceSegment( const Vec3& start, const Vec3& end, int flags = HitAll );
+        virtual bool    test( const Vec3& start, const Vec3& end, int flags = 0 );
+        virtual void    traceSegments( Segment* segments, int count );
+        virtual void    testSegments( Segment* segments, int count );
+        virtual void    addMesh( const Mesh* mesh );
+        virtual void    begin( void );
+        virtual void    end( void );
+        virtual void    removeMesh( const Mesh* mesh );
+        virtual void    updateMesh( const Mesh* mesh );
+        virtual void    update( void );
+        virtual u64     memoryUsage( void ) const;
+
+    private:
+
+        //! A ray being traced through the hierarchy.
+        struct Ray {
+            Vec3                m_origin;       //!< Ray origin.
+            Vec3                m_direction;    //!< Normalized ray direction.
+            Vec3                m_invDirection; //!< Inversed ray direction used by slab tests.
+            float               m_near;         //!< Minimum hit distance.
+            float               m_far;          //!< Maximum hit distance, shrinks as closer hits are found.
+            bool                m_useAlpha;     //!< Transparent surfaces are skipped if set.
+            bool                m_anyHit;       //!< Traversal stops at the first hit found if set.
+            int                 m_triangle;     //!< Index of the closest triangle hit.
+            float               m_u, m_v;       //!< Barycentric coordinates of the closest hit.
+        };
+
+        //! A preprocessed world space triangle.
+        struct Triangle {
+            Vec3                m_v0;           //!< First triangle vertex.
+            Vec3                m_e1;           //!< First triangle edge.
+            Vec3                m_e2;           //!< Second triangle edge.
+            int                 m_mesh;         //!< Index of a mesh in a registry.
+            int                 m_face;         //!< Mesh face index.
+            bool                m_alpha;        //!< Mesh material has an alpha channel.
+        };
+
+        //! A 4-wide hierarchy node with child bounds stored as a structure of arrays.
+        struct Node {
+            float               m_min[3][4];    //!< Child bounds minimum, one array for each axis.
+            float               m_max[3][4];    //!< Child bounds maximum, one array for each axis.
+            int                 m_child[4];     //!< Inner child node index or a first leaf triangle.
+            int                 m_count[4];     //!< Amount of leaf triangles, zero for inner nodes.
+            int                 m_size;         //!< Amount of child slots used.
+        };
+
+        //! A triangle reference used while building a hierarchy.
+        struct Primitive {
+            Bounds              m_bounds;       //!< Triangle bounds.
+            Vec3                m_centroid;     //!< Triangle bounds centroid.
+            int                 m_index;        //!< Triangle index.
+        };
+
+        //! Initializes a ray from a given segment.
+        void            initializeRay( Ray& ray, const Vec3& start, const Vec3& end, int flags ) const;
+
+        //! Traverses a hierarchy, returns true if any triangle was hit.
+        bool            traverse( Ray& ray ) const;
+
+        //! Intersects a ray with a given triangle and updates the closest hit.
+        bool            intersect( Ray& ray, int index ) const;
+
+        //! Calculates a hit data requested by flags.
+        void            decodeHit( Hit& hit, const Ray& ray, int flags ) const;
+
+        //! Transforms a mesh face to a world space triangle.
+        void            initializeTriangle( Triangle& triangle, int mesh, int face ) const;
+
+        //! Builds a hierarchy from all registered meshes.
+        void            rebuild( void );
+
+        //! Recalculates bounds of all nodes bottom up, keeping a hierarchy topology.
+        void            refit( void );
+
+        //! Returns an index of a registered mesh.
+        int             meshIndex( const Mesh* mesh ) const;
+
+        //! Recursively builds a hierarchy node for a range of primitives.
+        int             build( Array<Primitive>& primitives, int first, int count );
+
+        //! Partitions a range of primitives by a best binned SAH split, returns a split position.
+        int             split( Array<Primitive>& primitives, int first, int count ) const;
+
+        //! Calculates a bounding box of a primitive range.
+        static Bounds   bounds( const Array<Primitive>& primitives, int first, int count );
+
+        //! Calculates a surface area of a bounding box.
+        static float    area( const Bounds& bounds );
+
+    private:
+
+        //! Maximum amount of triangles in a leaf.
+        enum { MaxLeafSize = 4 };
+
+        //! Amount of bins used to evaluate SAH splits.
+        enum { BinCount = 16 };
+
+        //! Maximum hierarchy traversal stack depth.
+        enum { MaxStackDepth = 128 };
+
+        //! Meshes added to a tracer, removed meshes are set to NULL until a next rebuild.
+        Array<const Mesh*>  m_meshes;
+
+        //! Mesh registry and hit attributes.
+        HitDecoder          m_decoder;
+
+        //! Hierarchy triangles, leaves reference continuous ranges of this array.
+        Array<Triangle>     m_triangles;
+
+        //! Hierarchy nodes, the first one is a root.
+        Array<Node>         m_nodes;
+
+        //! Meshes were added after a hierarchy was built.
+        bool                m_rebuild;
+
+        //! Meshes were moved or removed after a hierarchy was built.
+        bool                m_refit;
+    };
+
+} // namespace rt
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_RT_Bvh_H__ ) */
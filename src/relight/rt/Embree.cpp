@@ -29,26 +29,43 @@
 #include "Embree.h"
 #include "../scene/Mesh.h"
 
+#if RELIGHT_USE_EMBREE
+
 namespace relight {
 
 namespace rt {
 
 // ** Embree::Embree
-Embree::Embree( void )
+Embree::Embree( bool dynamic ) : m_dynamic( dynamic ), m_geometryMemory( 0 )
 {
     rtcInit( NULL );
 }
 
 Embree::~Embree( void )
 {
+    for( Prototypes::iterator i = m_prototypes.begin(), end = m_prototypes.end(); i != end; ++i ) {
+        rtcDeleteScene( i->second );
+    }
+
     rtcDeleteScene( m_scene );
     rtcExit();
 }
 
+// ** Embree::newScene
+RTCScene Embree::newScene( RTCSceneFlags flags ) const
+{
+    return rtcNewScene( flags, RTC_INTERSECT1 | RTC_INTERSECT4 | RELIGHT_EMBREE_INTERSECT );
+}
+
 // ** Embree::begin
 void Embree::begin( void )
 {
-    m_scene = rtcNewScene( RTC_SCENE_STATIC, RTC_INTERSECT1 | RTC_INTERSECT4 );
+    m_decoder.clear();
+    m_geometries.clear();
+
+    // ** Only a top level scene is dynamic, prototype geometry never changes
+    m_scene          = newScene( m_dynamic ? RTC_SCENE_DYNAMIC : RTC_SCENE_STATIC );
+    m_geometryMemory = 0;
 }
 
 // ** Embree::end
@@ -57,19 +74,141 @@ void Embree::end( void )
     rtcCommit( m_scene );
 }
 
+// ** Embree::update
+void Embree::update( void )
+{
+    assert( m_dynamic );
+    rtcCommit( m_scene );
+}
+
+// ** Embree::removeMesh
+void Embree::removeMesh( const Mesh* mesh )
+{
+    assert( m_dynamic );
+
+    Geometries::iterator i = m_geometries.find( mesh );
+    assert( i != m_geometries.end() );
+
+    // ** Embree may reuse a deleted geometry identifier, so the decoder slot is released too
+    rtcDeleteGeometry( m_scene, i->second );
+    m_decoder.setMesh( i->second, NULL );
+    m_geometries.erase( i );
+}
+
+// ** Embree::updateMesh
+void Embree::updateMesh( const Mesh* mesh )
+{
+    assert( m_dynamic );
+
+    Geometries::iterator i = m_geometries.find( mesh );
+    assert( i != m_geometries.end() );
+
+    setTransform( i->second, mesh );
+    rtcUpdate( m_scene, i->second );
+}
+
+// ** Embree::setTransform
+void Embree::setTransform( unsigned geom, const Mesh* mesh )
+{
+    assert( mesh->prototype() );
+
+    // ** Embree expects a 3x4 column major matrix
+    const Matrix4& transform = mesh->instanceTransform();
+    float          xfm[12]   = { transform[0], transform[1], transform[2], transform[4], transform[5], transform[6], transform[8], transform[9], transform[10], transform[12], transform[13], transform[14] };
+
+    rtcSetTransform( m_scene, geom, RTC_MATRIX_COLUMN_MAJOR, xfm );
+}
+
+// ** Embree::memoryUsage
+u64 Embree::memoryUsage( void ) const
+{
+    // ** Embree doesn't report a size of it's acceleration structures, so only uploaded buffers are counted
+    return m_geometryMemory + m_decoder.memoryUsage();
+}
+
 // ** Embree::traceSegments
-void Embree::traceSegments( Segment segments[4] )
+void Embree::traceSegments( Segment* segments, int count )
+{
+#if RELIGHT_EMBREE_PACKET == 16
+    tracePackets<RTCRay16, 16>( segments, count );
+#elif RELIGHT_EMBREE_PACKET == 8
+    tracePackets<RTCRay8, 8>( segments, count );
+#else
+    tracePackets<RTCRay4, 4>( segments, count );
+#endif
+}
+
+// ** Embree::testSegments
+void Embree::testSegments( Segment* segments, int count )
+{
+#if RELIGHT_EMBREE_PACKET == 16
+    testPackets<RTCRay16, 16>( segments, count );
+#elif RELIGHT_EMBREE_PACKET == 8
+    testPackets<RTCRay8, 8>( segments, count );
+#else
+    testPackets<RTCRay4, 4>( segments, count );
+#endif
+}
+
+// ** intersect
+static void intersect( const int* valid, RTCScene scene, RTCRay4& rays )
 {
-    int     valid4[4] = { -1,-1,-1,-1 };
-    RTCRay4 rays;
+    rtcIntersect4( valid, scene, rays );
+}
+
+// ** intersect
+static void intersect( const int* valid, RTCScene scene, RTCRay8& rays )
+{
+    rtcIntersect8( valid, scene, rays );
+}
+
+// ** intersect
+static void intersect( const int* valid, RTCScene scene, RTCRay16& rays )
+{
+    rtcIntersect16( valid, scene, rays );
+}
+
+// ** occluded
+static void occluded( const int* valid, RTCScene scene, RTCRay4& rays )
+{
+    rtcOccluded4( valid, scene, rays );
+}
+
+// ** occluded
+static void occluded( const int* valid, RTCScene scene, RTCRay8& rays )
+{
+    rtcOccluded8( valid, scene, rays );
+}
+
+// ** occluded
+static void occluded( const int* valid, RTCScene scene, RTCRay16& rays )
+{
+    rtcOccluded16( valid, scene, rays );
+}
+
+// ** initializePacket
+template<typename TRayPacket, int TWidth>
+static int initializePacket( TRayPacket& rays, int* valid, Vec3* directions, const Segment* segments, int count )
+{
+    int size = std::min( TWidth, count );
+
+    // ** The tail of a last packet is masked out
+    for( int i = 0; i < TWidth; i++ ) {
+        valid[i] = i < size ? -1 : 0;
+
+        if( i >= size ) {
+            continue;
+        }
 
-    for( int i = 0; i < 4; i++ ) {
-        Vec3 dir  = segments[i].m_end - segments[i].m_start;
+        const Segment& segment = segments[i];
+        Vec3&          dir     = directions[i];
+
+        dir       = segment.m_end - segment.m_start;
         float len = dir.normalize();
 
-        rays.orgx[i] = segments[i].m_start.x;
-        rays.orgy[i] = segments[i].m_start.y;
-        rays.orgz[i] = segments[i].m_start.z;
+        rays.orgx[i] = segment.m_start.x;
+        rays.orgy[i] = segment.m_start.y;
+        rays.orgz[i] = segment.m_start.z;
 
         rays.dirx[i] = dir.x;
         rays.diry[i] = dir.y;
@@ -83,23 +222,106 @@ void Embree::traceSegments( Segment segments[4] )
         rays.instID[i] = RTC_INVALID_GEOMETRY_ID;
         rays.mask[i]   = 0xFFFFFFFF;
         rays.time[i]   = 0.0f;
+
+        rays.m_useAlpha[i] = segment.m_flags & HitUseAlpha;
+    }
+
+    return size;
+}
+
+// ** Embree::tracePackets
+template<typename TRayPacket, int TWidth>
+void Embree::tracePackets( Segment* segments, int count )
+{
+    typedef EmRayPacket<TRayPacket, TWidth> Packet;
+
+    RTCORE_ALIGN( 64 ) int      valid[TWidth];
+    RTCORE_ALIGN( 64 ) Packet   rays;
+    Vec3                        directions[TWidth];
+
+    for( int first = 0; first < count; first += TWidth ) {
+        int size = initializePacket<Packet, TWidth>( rays, valid, directions, segments + first, count - first );
+
+        intersect( valid, m_scene, rays );
+
+        // ** Decode hits
+        for( int i = 0; i < size; i++ ) {
+            Segment& segment = segments[first + i];
+
+            if( rays.geomID[i] == static_cast<int>( RTC_INVALID_GEOMETRY_ID ) ) {
+                segment.m_hit = Hit();
+                continue;
+            }
+
+            Vec3 point = segment.m_start + directions[i] * rays.tfar[i];
+            decodeHit( segment.m_hit, point, rays.instID[i], rays.geomID[i], rays.primID[i], rays.u[i], rays.v[i], segment.m_flags );
+        }
+    }
+}
+
+// ** Embree::testPackets
+template<typename TRayPacket, int TWidth>
+void Embree::testPackets( Segment* segments, int count )
+{
+    typedef EmRayPacket<TRayPacket, TWidth> Packet;
+
+    RTCORE_ALIGN( 64 ) int      valid[TWidth];
+    RTCORE_ALIGN( 64 ) Packet   rays;
+    Vec3                        directions[TWidth];
+
+    for( int first = 0; first < count; first += TWidth ) {
+        int size = initializePacket<Packet, TWidth>( rays, valid, directions, segments + first, count - first );
+
+        occluded( valid, m_scene, rays );
+
+        for( int i = 0; i < size; i++ ) {
+            segments[first + i].m_occluded = rays.geomID[i] != static_cast<int>( RTC_INVALID_GEOMETRY_ID );
+        }
     }
+}
 
-    rtcIntersect4( valid4, m_scene, rays );
+// ** Embree::decodeHit
+void Embree::decodeHit( Hit& hit, const Vec3& point, int instID, int geomID, int primID, float u, float v, int flags ) const
+{
+    hit = Hit();
+    hit.m_point = point;
 
-    for( int i = 0; i < 4; i++ ) {
-        if( rays.geomID[i] == RTC_INVALID_GEOMETRY_ID ) {
+    m_decoder.decode( hit, instID != static_cast<int>( RTC_INVALID_GEOMETRY_ID ) ? instID : geomID, primID, u, v, flags );
+}
+
+// ** Embree::alphaFilter
+void Embree::alphaFilter( void* userData, RTCRay& ray )
+{
+    if( !static_cast<EmRay&>( ray ).m_useAlpha ) {
+        return;
+    }
+
+    const Mesh* mesh  = reinterpret_cast<const Mesh*>( userData );
+    Rgba        color = mesh->face( ray.primID ).colorAt( Barycentric( ray.u, ray.v ) );
+
+    if( color.a <= k_AlphaThreshold ) {
+        ray.geomID = RTC_INVALID_GEOMETRY_ID;
+    }
+}
+
+// ** Embree::alphaFilterPacket
+template<typename TRayPacket, int TWidth>
+void Embree::alphaFilterPacket( const void* valid, void* userData, TRayPacket& rays )
+{
+    const int*  mask   = reinterpret_cast<const int*>( valid );
+    const int*  alpha  = static_cast<EmRayPacket<TRayPacket, TWidth>&>( rays ).m_useAlpha;
+    const Mesh* mesh   = reinterpret_cast<const Mesh*>( userData );
+
+    for( int i = 0; i < TWidth; i++ ) {
+        if( !mask[i] || !alpha[i] ) {
             continue;
         }
 
-        const Mesh* mesh    = m_meshes[rays.geomID[i]];
-        Face        face    = mesh->face( rays.primID[i] );
-        Barycentric coord   = Barycentric( rays.u[i], rays.v[i] );
+        Rgba color = mesh->face( rays.primID[i] ).colorAt( Barycentric( rays.u[i], rays.v[i] ) );
 
-        segments[i].m_hit.m_normal  = face.normalAt( coord );
-        segments[i].m_hit.m_color   = face.colorAt( coord );
-        segments[i].m_hit.m_uv      = face.uvAt( coord, Vertex::Lightmap );
-        segments[i].m_hit.m_mesh    = mesh;
+        if( color.a <= k_AlphaThreshold ) {
+            rays.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+        }
     }
 }
 
@@ -130,11 +352,12 @@ float Embree::initializeRay( RTCRay& ray, Vec3& direction, const Vec3& start, co
 }
 
 // ** Embree::test
-bool Embree::test( const Vec3& start, const Vec3& end )
+bool Embree::test( const Vec3& start, const Vec3& end, int flags )
 {
-    Vec3   direction;
-    RTCRay ray;
+    Vec3  direction;
+    EmRay ray;
     initializeRay( ray, direction, start, end );
+    ray.m_useAlpha = flags & HitUseAlpha;
 
     rtcOccluded( m_scene, ray );
 
@@ -142,11 +365,12 @@ bool Embree::test( const Vec3& start, const Vec3& end )
 }
 
 // ** Embree::traceSegment
-Hit Embree::traceSegment( const Vec3& start, const Vec3& end, int flags, int step )
+Hit Embree::traceSegment( const Vec3& start, const Vec3& end, int flags )
 {
-    Vec3   direction;
-    RTCRay ray;
+    Vec3  direction;
+    EmRay ray;
     initializeRay( ray, direction, start, end );
+    ray.m_useAlpha = flags & HitUseAlpha;
 
     rtcIntersect( m_scene, ray );
 
@@ -154,36 +378,49 @@ Hit Embree::traceSegment( const Vec3& start, const Vec3& end, int flags, int ste
         return Hit();
     }
 
-    Vec3        point   = start + direction * ray.tfar;
-    const Mesh* mesh    = m_meshes[ray.geomID];
-    Face        face    = mesh->face( ray.primID );
-    Barycentric coord   = Barycentric( ray.u, ray.v );
-    Rgba        color   = face.colorAt( coord );
-
-    if( flags & HitUseAlpha && color.a <= 0.1f && step < 25 ) {
-        return traceSegment( point + direction, end, flags, step + 1 );
-    }
-
     Hit result;
-
-    if( flags & HitNormal ) result.m_normal = face.normalAt( coord );
-    if( flags & HitColor )  result.m_color  = face.colorAt( coord );
-    if( flags & HitUv )     result.m_uv     = face.uvAt( coord, Vertex::Lightmap );
-
-	result.m_point = point;
-    result.m_mesh  = mesh;
+    decodeHit( result, start + direction * ray.tfar, ray.instID, ray.geomID, ray.primID, ray.u, ray.v, flags );
 
     return result;
 }
 
 // ** Embree::addMesh
 void Embree::addMesh( const Mesh* mesh )
+{
+    unsigned geom = RTC_INVALID_GEOMETRY_ID;
+
+    if( const Mesh* prototype = mesh->prototype() ) {
+        // ** Prototype geometry is uploaded once and shared by all instances
+        Prototypes::iterator i = m_prototypes.find( prototype );
+
+        // ** Instanced scenes are committed before a scene that references them
+        if( i == m_prototypes.end() ) {
+            RTCScene scene = newScene( RTC_SCENE_STATIC );
+            addGeometry( scene, prototype );
+            rtcCommit( scene );
+            i = m_prototypes.insert( Prototypes::value_type( prototype, scene ) ).first;
+        }
+
+        geom = rtcNewInstance( m_scene, i->second );
+        setTransform( geom, mesh );
+    } else {
+        geom = addGeometry( m_scene, mesh );
+    }
+
+    // ** Push instance to a registry
+    m_decoder.setMesh( geom, mesh );
+    m_geometries[mesh] = geom;
+}
+
+// ** Embree::addGeometry
+unsigned Embree::addGeometry( RTCScene scene, const Mesh* mesh )
 {
     // ** Create a new Embree geomentry
-    unsigned geom = rtcNewTriangleMesh( m_scene, RTC_GEOMETRY_STATIC, mesh->faceCount(), mesh->vertexCount() );
+    unsigned geom = rtcNewTriangleMesh( scene, RTC_GEOMETRY_STATIC, mesh->faceCount(), mesh->vertexCount() );
+    m_geometryMemory += mesh->vertexCount() * sizeof( EmVertex ) + mesh->faceCount() * sizeof( EmFace );
 
     // ** Upload vertex buffer
-    EmVertex* vertices = ( EmVertex* )rtcMapBuffer( m_scene, geom, RTC_VERTEX_BUFFER );
+    EmVertex* vertices = ( EmVertex* )rtcMapBuffer( scene, geom, RTC_VERTEX_BUFFER );
 
     for( int j = 0, n = mesh->vertexCount(); j < n; j++ ) {
         EmVertex&   dst = vertices[j];
@@ -195,10 +432,10 @@ void Embree::addMesh( const Mesh* mesh )
         dst.a = 1.0f;
     }
 
-    rtcUnmapBuffer( m_scene, geom, RTC_VERTEX_BUFFER );
+    rtcUnmapBuffer( scene, geom, RTC_VERTEX_BUFFER );
 
     // ** Upload index buffer
-    EmFace* triangles = ( EmFace* )rtcMapBuffer( m_scene, geom, RTC_INDEX_BUFFER );
+    EmFace* triangles = ( EmFace* )rtcMapBuffer( scene, geom, RTC_INDEX_BUFFER );
     int     idx       = 0;
 
     for( int j = 0, n = mesh->indexCount() / 3; j < n; j++ ) {
@@ -210,12 +447,30 @@ void Embree::addMesh( const Mesh* mesh )
         tri.v2 = mesh->index( j * 3 + 2 );
     }
 
-    rtcUnmapBuffer( m_scene, geom, RTC_INDEX_BUFFER );
+    rtcUnmapBuffer( scene, geom, RTC_INDEX_BUFFER );
+
+    // ** Register alpha test callbacks, so opaque geometry is traced without filtering
+    if( mesh->hasAlpha() ) {
+        rtcSetUserData( scene, geom, const_cast<Mesh*>( mesh ) );
+
+        rtcSetIntersectionFilterFunction( scene, geom, alphaFilter );
+        rtcSetOcclusionFilterFunction( scene, geom, alphaFilter );
+        rtcSetIntersectionFilterFunction4( scene, geom, alphaFilterPacket<RTCRay4, 4> );
+        rtcSetOcclusionFilterFunction4( scene, geom, alphaFilterPacket<RTCRay4, 4> );
+    #if RELIGHT_EMBREE_PACKET == 16
+        rtcSetIntersectionFilterFunction16( scene, geom, alphaFilterPacket<RTCRay16, 16> );
+        rtcSetOcclusionFilterFunction16( scene, geom, alphaFilterPacket<RTCRay16, 16> );
+    #elif RELIGHT_EMBREE_PACKET == 8
+        rtcSetIntersectionFilterFunction8( scene, geom, alphaFilterPacket<RTCRay8, 8> );
+        rtcSetOcclusionFilterFunction8( scene, geom, alphaFilterPacket<RTCRay8, 8> );
+    #endif
+    }
 
-    // ** Push instance to a registry
-    m_meshes.push_back( mesh );
+    return geom;
 }
 
 } // namespace rt
 
 } // namespace relight
+
+#endif  /*  RELIGHT_USE_EMBREE */
@@ -28,10 +28,25 @@
 #define __Relight_RT_Embree_H__
 
 #include "Tracer.h"
+#include "HitDecoder.h"
+
+#if RELIGHT_USE_EMBREE
 
 #include <embree2/rtcore.h>
 #include <embree2/rtcore_ray.h>
 
+//! Width of ray packets used by Embree::traceSegments, selected by an instruction set the library is compiled for.
+#if defined( __MIC__ )
+    #define RELIGHT_EMBREE_PACKET       16
+    #define RELIGHT_EMBREE_INTERSECT    RTC_INTERSECT16
+#elif defined( __AVX__ )
+    #define RELIGHT_EMBREE_PACKET       8
+    #define RELIGHT_EMBREE_INTERSECT    RTC_INTERSECT8
+#else
+    #define RELIGHT_EMBREE_PACKET       4
+    #define RELIGHT_EMBREE_INTERSECT    RTC_INTERSECT4
+#endif
+
 namespace relight {
 
 namespace rt {
@@ -40,24 +55,68 @@ namespace rt {
     class Embree : public ITracer {
     public:
 
-                        Embree( void );
+                        //! Constructs an Embree instance, a dynamic tracer allows scene changes after a construction ended.
+                        Embree( bool dynamic = false );
         virtual         ~Embree( void );
 
         // ** ITracer
-        virtual Hit     traceSegment( const Vec3& start, const Vec3& end, int flags = HitPoint, int step = 0 );
-        virtual bool    test( const Vec3& start, const Vec3& end );
-        virtual void    traceSegments( Segment segments[4] );
+        virtual Hit     traceSegment( const Vec3& start, const Vec3& end, int flags = HitAll );
+        virtual bool    test( const Vec3& start, const Vec3& end, int flags = 0 );
+        virtual void    traceSegments( Segment* segments, int count );
+        virtual void    testSegments( Segment* segments, int count );
         virtual void    addMesh( const Mesh* mesh );
         virtual void    begin( void );
         virtual void    end( void );
+        virtual void    removeMesh( const Mesh* mesh );
+        virtual void    updateMesh( const Mesh* mesh );
+        virtual void    update( void );
+        virtual u64     memoryUsage( void ) const;
 
     private:
 
         //! Initializes an Embree ray from a given segment.
         float           initializeRay( RTCRay& ray, Vec3& direction, const Vec3& start, const Vec3& end ) const;
 
+        //! Traces a stream of segments with ray packets of a given width.
+        template<typename TRayPacket, int TWidth>
+        void            tracePackets( Segment* segments, int count );
+
+        //! Tests a stream of segments with ray packets of a given width.
+        template<typename TRayPacket, int TWidth>
+        void            testPackets( Segment* segments, int count );
+
+        //! Calculates a hit data requested by flags, an instance hit is decoded with an instance mesh.
+        void            decodeHit( Hit& hit, const Vec3& point, int instID, int geomID, int primID, float u, float v, int flags ) const;
+
+        //! Creates a new Embree scene with intersection flags used by this tracer.
+        RTCScene        newScene( RTCSceneFlags flags ) const;
+
+        //! Sets a transform of an instance geometry.
+        void            setTransform( unsigned geom, const Mesh* mesh );
+
+        //! Uploads mesh geometry to a given Embree scene.
+        unsigned        addGeometry( RTCScene scene, const Mesh* mesh );
+
+        //! Rejects hits with transparent surfaces, registered for geometries with alpha materials only.
+        static void     alphaFilter( void* userData, RTCRay& ray );
+
+        //! Rejects hits with transparent surfaces for a packet of rays.
+        template<typename TRayPacket, int TWidth>
+        static void     alphaFilterPacket( const void* valid, void* userData, TRayPacket& rays );
+
     private:
 
+        //! Embree ray extended with an alpha test flag, read by filter callbacks.
+        struct EmRay : public RTCRay {
+            int                 m_useAlpha;
+        };
+
+        //! Embree ray packet extended with alpha test flags, read by filter callbacks.
+        template<typename TRayPacket, int TWidth>
+        struct EmRayPacket : public TRayPacket {
+            int                 m_useAlpha[TWidth];
+        };
+
         //! Embree vertex layout.
         struct EmVertex {
             float x, y, z, a;
@@ -71,12 +130,32 @@ namespace rt {
         //! Embree scene.
         RTCScene            m_scene;
 
-        //! Mesh registry.
-        Array<const Mesh*>  m_meshes;
+        //! Container type to map prototype meshes to instanced Embree scenes.
+        typedef Map<const Mesh*, RTCScene> Prototypes;
+
+        //! Container type to map scene meshes to Embree geometry identifiers.
+        typedef Map<const Mesh*, unsigned> Geometries;
+
+        //! Mesh registry and hit attributes.
+        HitDecoder          m_decoder;
+
+        //! Instanced prototype scenes.
+        Prototypes          m_prototypes;
+
+        //! Geometry identifiers of scene meshes.
+        Geometries          m_geometries;
+
+        //! Scene is built with RTC_SCENE_DYNAMIC flag.
+        bool                m_dynamic;
+
+        //! Size of uploaded vertex and index buffers.
+        u64                 m_geometryMemory;
     };
 
 } // namespace rt
 
 } // namespace relight
 
+#endif  /*  RELIGHT_USE_EMBREE */
+
 #endif  /*  !defined( __Relight_RT_Embree_H__ ) */
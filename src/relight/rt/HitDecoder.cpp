@@ -0,0 +1,218 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+#include "../BuildCheck.h"
+
+#include "HitDecoder.h"
+#include "../scene/Mesh.h"
+#include "../scene/Material.h"
+#include "../Statistics.h"
+
+namespace relight {
+
+namespace rt {
+
+// ** HitDecoder::k_decoders
+const HitDecoder::Decoder HitDecoder::k_decoders[8] = {
+    &HitDecoder::decode<0>,
+    &HitDecoder::decode<HitUv>,
+    &HitDecoder::decode<HitColor>,
+    &HitDecoder::decode<HitUv | HitColor>,
+    &HitDecoder::decode<HitNormal>,
+    &HitDecoder::decode<HitNormal | HitUv>,
+    &HitDecoder::decode<HitNormal | HitColor>,
+    &HitDecoder::decode<HitNormal | HitUv | HitColor>,
+};
+
+// ** HitDecoder::clear
+void HitDecoder::clear( void )
+{
+    m_meshes.clear();
+    m_attributes.clear();
+}
+
+// ** HitDecoder::addMesh
+int HitDecoder::addMesh( const Mesh* mesh )
+{
+    int index = ( int )m_meshes.size();
+    setMesh( index, mesh );
+    return index;
+}
+
+// ** HitDecoder::setMesh
+void HitDecoder::setMesh( int index, const Mesh* mesh )
+{
+    assert( index >= 0 );
+
+    if( index >= ( int )m_meshes.size() ) {
+        Entry empty = { NULL, NULL };
+        m_meshes.resize( index + 1, empty );
+    }
+
+    Entry& entry = m_meshes[index];
+    entry.m_mesh       = mesh;
+    entry.m_attributes = NULL;
+
+    if( !mesh ) {
+        return;
+    }
+
+    const Mesh* prototype = mesh->prototype() ? mesh->prototype() : mesh;
+
+    // ** Build an attribute table once for each prototype
+    AttributeTables::iterator i = m_attributes.find( prototype );
+
+    if( i == m_attributes.end() ) {
+        i = m_attributes.insert( AttributeTables::value_type( prototype, Attributes() ) ).first;
+        build( i->second, prototype );
+    }
+
+    entry.m_attributes = &i->second;
+}
+
+// ** HitDecoder::mesh
+const Mesh* HitDecoder::mesh( int index ) const
+{
+    assert( index >= 0 && index < ( int )m_meshes.size() );
+    return m_meshes[index].m_mesh;
+}
+
+// ** HitDecoder::build
+void HitDecoder::build( Attributes& attributes, const Mesh* mesh )
+{
+    int count = mesh->faceCount();
+
+    for( int i = 0; i < 9; i++ ) {
+        attributes.m_normal[i].resize( count );
+    }
+
+    for( int i = 0; i < 6; i++ ) {
+        attributes.m_uv[i].resize( count );
+        attributes.m_diffuse[i].resize( count );
+    }
+
+    attributes.m_material.resize( count );
+
+    for( int i = 0; i < count; i++ ) {
+        const Vertex* a = &mesh->vertex( mesh->index( i * 3 + 0 ) );
+        const Vertex* b = &mesh->vertex( mesh->index( i * 3 + 1 ) );
+        const Vertex* c = &mesh->vertex( mesh->index( i * 3 + 2 ) );
+
+        for( int j = 0; j < 3; j++ ) {
+            attributes.m_normal[j + 0][i] = a->normal[j];
+            attributes.m_normal[j + 3][i] = b->normal[j] - a->normal[j];
+            attributes.m_normal[j + 6][i] = c->normal[j] - a->normal[j];
+        }
+
+        for( int j = 0; j < 2; j++ ) {
+            attributes.m_uv[j + 0][i] = a->uv[Vertex::Lightmap][j];
+            attributes.m_uv[j + 2][i] = b->uv[Vertex::Lightmap][j] - a->uv[Vertex::Lightmap][j];
+            attributes.m_uv[j + 4][i] = c->uv[Vertex::Lightmap][j] - a->uv[Vertex::Lightmap][j];
+
+            attributes.m_diffuse[j + 0][i] = a->uv[Vertex::Diffuse][j];
+            attributes.m_diffuse[j + 2][i] = b->uv[Vertex::Diffuse][j] - a->uv[Vertex::Diffuse][j];
+            attributes.m_diffuse[j + 4][i] = c->uv[Vertex::Diffuse][j] - a->uv[Vertex::Diffuse][j];
+        }
+
+        attributes.m_material[i] = a->material;
+    }
+}
+
+// ** HitDecoder::decode
+void HitDecoder::decode( Hit& hit, int mesh, int face, float u, float v, int flags ) const
+{
+    Decoder decoder = k_decoders[(flags & (HitUv | HitColor | HitNormal)) >> 1];
+
+    if( !Statistics::isEnabled() ) {
+        (this->*decoder)( hit, mesh, face, u, v );
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    (this->*decoder)( hit, mesh, face, u, v );
+    Statistics::recordDecode( std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() );
+}
+
+// ** HitDecoder::memoryUsage
+u64 HitDecoder::memoryUsage( void ) const
+{
+    u64 result = m_meshes.capacity() * sizeof( Entry );
+
+    for( AttributeTables::const_iterator i = m_attributes.begin(), end = m_attributes.end(); i != end; ++i ) {
+        const Attributes& attributes = i->second;
+
+        for( int j = 0; j < 9; j++ ) {
+            result += attributes.m_normal[j].capacity() * sizeof( float );
+        }
+
+        for( int j = 0; j < 6; j++ ) {
+            result += (attributes.m_uv[j].capacity() + attributes.m_diffuse[j].capacity()) * sizeof( float );
+        }
+
+        result += attributes.m_material.capacity() * sizeof( const Material* );
+    }
+
+    return result;
+}
+
+// ** HitDecoder::decode
+template<int TFlags>
+void HitDecoder::decode( Hit& hit, int mesh, int face, float u, float v ) const
+{
+    const Entry&      entry = m_meshes[mesh];
+    const Attributes& table = *entry.m_attributes;
+
+    hit.m_mesh = entry.m_mesh;
+
+    // ** Barycentric u is a weight of a second face index, v is a weight of a third one
+    if( TFlags & HitNormal ) {
+        Vec3 normal( table.m_normal[0][face] + table.m_normal[3][face] * u + table.m_normal[6][face] * v
+                   , table.m_normal[1][face] + table.m_normal[4][face] * u + table.m_normal[7][face] * v
+                   , table.m_normal[2][face] + table.m_normal[5][face] * u + table.m_normal[8][face] * v );
+        hit.m_normal = entry.m_mesh->worldNormal( normal );
+    }
+
+    if( TFlags & HitUv ) {
+        hit.m_uv = Uv( table.m_uv[0][face] + table.m_uv[2][face] * u + table.m_uv[4][face] * v
+                     , table.m_uv[1][face] + table.m_uv[3][face] * u + table.m_uv[5][face] * v );
+    }
+
+    if( TFlags & HitColor ) {
+        const Material* material = table.m_material[face];
+
+        if( material ) {
+            hit.m_color = material->colorAt( Uv( table.m_diffuse[0][face] + table.m_diffuse[2][face] * u + table.m_diffuse[4][face] * v
+                                               , table.m_diffuse[1][face] + table.m_diffuse[3][face] * u + table.m_diffuse[5][face] * v ) );
+        } else {
+            hit.m_color = Rgba( 1.0f, 1.0f, 1.0f, 1.0f );
+        }
+    }
+}
+
+} // namespace rt
+
+} // namespace relight
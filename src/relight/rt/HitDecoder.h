@@ -0,0 +1,111 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+
+#ifndef __Relight_RT_HitDecoder_H__
+#define __Relight_RT_HitDecoder_H__
+
+#include "Tracer.h"
+
+namespace relight {
+
+namespace rt {
+
+    // ** class HitDecoder
+    /*!
+     Calculates hit attributes from a mesh index, a face index and barycentric coordinates reported by a tracer.
+     Face attributes are precomputed to a compact structure of arrays, so decoding is a few loads and multiply-adds.
+     Instances share attribute tables of their prototype. A decoding routine is specialised for each hit flags mask
+     at compile time, so attributes that were not requested are never touched and materials are sampled only for HitColor.
+     */
+    class HitDecoder {
+    public:
+
+        //! Removes all registered meshes.
+        void                clear( void );
+
+        //! Registers a mesh and returns it's index.
+        int                 addMesh( const Mesh* mesh );
+
+        //! Registers a mesh at a given index, a NULL mesh unregisters an index.
+        void                setMesh( int index, const Mesh* mesh );
+
+        //! Returns a registered mesh.
+        const Mesh*         mesh( int index ) const;
+
+        //! Calculates hit attributes requested by flags, a hit point should be set by a caller.
+        void                decode( Hit& hit, int mesh, int face, float u, float v, int flags ) const;
+
+        //! Returns an approximate amount of memory in bytes used by attribute tables.
+        u64                 memoryUsage( void ) const;
+
+    private:
+
+        //! Calculates hit attributes requested by TFlags.
+        template<int TFlags>
+        void                decode( Hit& hit, int mesh, int face, float u, float v ) const;
+
+        //! Per-face attributes of a single mesh, each vertex attribute is stored as a first vertex value and two edges.
+        struct Attributes {
+            Array<float>            m_normal[9];    //!< Normal XYZ, first edge XYZ and second edge XYZ.
+            Array<float>            m_uv[6];        //!< Lightmap UV, first edge UV and second edge UV.
+            Array<float>            m_diffuse[6];   //!< Diffuse UV, first edge UV and second edge UV.
+            Array<const Material*>  m_material;     //!< Face material.
+        };
+
+        //! A registered mesh.
+        struct Entry {
+            const Mesh*             m_mesh;         //!< Mesh instance.
+            const Attributes*       m_attributes;   //!< Attributes shared with a prototype.
+        };
+
+        //! Fills attribute table of a mesh.
+        static void         build( Attributes& attributes, const Mesh* mesh );
+
+        //! Attribute decoding function.
+        typedef void ( HitDecoder::*Decoder )( Hit& hit, int mesh, int face, float u, float v ) const;
+
+        //! Attribute tables.
+        typedef Map<const Mesh*, Attributes> AttributeTables;
+
+    private:
+
+        //! Registered meshes.
+        Array<Entry>        m_meshes;
+
+        //! Attribute tables by a prototype mesh.
+        AttributeTables     m_attributes;
+
+        //! Decoding functions indexed by a hit attributes mask.
+        static const Decoder k_decoders[8];
+    };
+
+} // namespace rt
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_RT_HitDecoder_H__ ) */
@@ -0,0 +1,165 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+#include "../BuildCheck.h"
+
+#include "Profiler.h"
+#include "../Statistics.h"
+
+namespace relight {
+
+namespace rt {
+
+// ** elapsed
+static double elapsed( const std::chrono::steady_clock::time_point& start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// ** Profiler::Profiler
+Profiler::Profiler( ITracer* tracer ) : m_tracer( tracer ), m_buildTime( 0.0 )
+{
+
+}
+
+// ** Profiler::~Profiler
+Profiler::~Profiler( void )
+{
+    delete m_tracer;
+}
+
+// ** Profiler::traceSegment
+Hit Profiler::traceSegment( const Vec3& start, const Vec3& end, int flags )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    Hit result = m_tracer->traceSegment( start, end, flags );
+    Statistics::recordRays( 1, result ? 1 : 0, (end - start).length(), elapsed( time ) );
+
+    return result;
+}
+
+// ** Profiler::test
+bool Profiler::test( const Vec3& start, const Vec3& end, int flags )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    bool result = m_tracer->test( start, end, flags );
+    Statistics::recordRays( 1, result ? 1 : 0, (end - start).length(), elapsed( time ) );
+
+    return result;
+}
+
+// ** Profiler::traceSegments
+void Profiler::traceSegments( Segment* segments, int count )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    m_tracer->traceSegments( segments, count );
+    double seconds = elapsed( time );
+
+    int    hits   = 0;
+    double length = 0.0;
+
+    for( int i = 0; i < count; i++ ) {
+        hits   += segments[i].m_hit ? 1 : 0;
+        length += (segments[i].m_end - segments[i].m_start).length();
+    }
+
+    Statistics::recordRays( count, hits, length, seconds );
+}
+
+// ** Profiler::testSegments
+void Profiler::testSegments( Segment* segments, int count )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    m_tracer->testSegments( segments, count );
+    double seconds = elapsed( time );
+
+    int    hits   = 0;
+    double length = 0.0;
+
+    for( int i = 0; i < count; i++ ) {
+        hits   += segments[i].m_occluded ? 1 : 0;
+        length += (segments[i].m_end - segments[i].m_start).length();
+    }
+
+    Statistics::recordRays( count, hits, length, seconds );
+}
+
+// ** Profiler::addMesh
+void Profiler::addMesh( const Mesh* mesh )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    m_tracer->addMesh( mesh );
+    m_buildTime += elapsed( time );
+}
+
+// ** Profiler::begin
+void Profiler::begin( void )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    m_tracer->begin();
+    m_buildTime = elapsed( time );
+}
+
+// ** Profiler::end
+void Profiler::end( void )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    m_tracer->end();
+    m_buildTime += elapsed( time );
+
+    Statistics::recordBuild( m_buildTime, memoryUsage() );
+}
+
+// ** Profiler::removeMesh
+void Profiler::removeMesh( const Mesh* mesh )
+{
+    m_tracer->removeMesh( mesh );
+}
+
+// ** Profiler::updateMesh
+void Profiler::updateMesh( const Mesh* mesh )
+{
+    m_tracer->updateMesh( mesh );
+}
+
+// ** Profiler::update
+void Profiler::update( void )
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    m_tracer->update();
+    Statistics::recordBuild( elapsed( time ), 0 );
+}
+
+// ** Profiler::memoryUsage
+u64 Profiler::memoryUsage( void ) const
+{
+    return m_tracer->memoryUsage();
+}
+
+} // namespace rt
+
+} // namespace relight
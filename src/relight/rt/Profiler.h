@@ -0,0 +1,76 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+
+#ifndef __Relight_RT_Profiler_H__
+#define __Relight_RT_Profiler_H__
+
+#include "Tracer.h"
+
+namespace relight {
+
+namespace rt {
+
+    // ** class Profiler
+    /*!
+     Wraps a ray tracer to record an amount of traced rays, hits, segment lengths and a tracing time
+     to statistics of a calling thread. A scene uses this wrapper only when statistics are enabled.
+     */
+    class Profiler : public ITracer {
+    public:
+
+                        //! Constructs a Profiler instance, takes an ownership of a wrapped tracer.
+                        Profiler( ITracer* tracer );
+        virtual         ~Profiler( void );
+
+        // ** ITracer
+        virtual Hit     traceSegment( const Vec3& start, const Vec3& end, int flags = HitAll );
+        virtual bool    test( const Vec3& start, const Vec3& end, int flags = 0 );
+        virtual void    traceSegments( Segment* segments, int count );
+        virtual void    testSegments( Segment* segments, int count );
+        virtual void    addMesh( const Mesh* mesh );
+        virtual void    begin( void );
+        virtual void    end( void );
+        virtual void    removeMesh( const Mesh* mesh );
+        virtual void    updateMesh( const Mesh* mesh );
+        virtual void    update( void );
+        virtual u64     memoryUsage( void ) const;
+
+    private:
+
+        //! Wrapped tracer.
+        ITracer*        m_tracer;
+
+        //! Time in seconds spent building a wrapped tracer.
+        double          m_buildTime;
+    };
+
+} // namespace rt
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_RT_Profiler_H__ ) */
@@ -0,0 +1,197 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+
+#include "../BuildCheck.h"
+
+#include "RayBuffer.h"
+
+namespace relight {
+
+namespace rt {
+
+// ** RayBuffer::size
+int RayBuffer::size( void ) const
+{
+    return ( int )m_segments.size();
+}
+
+// ** RayBuffer::clear
+void RayBuffer::clear( void )
+{
+    m_segments.clear();
+}
+
+// ** RayBuffer::allocate
+Segment* RayBuffer::allocate( int count )
+{
+    int first = size();
+    m_segments.resize( first + count );
+    return &m_segments[first];
+}
+
+// ** RayBuffer::segment
+Segment& RayBuffer::segment( int index )
+{
+    assert( index >= 0 && index < size() );
+    return m_segments[index];
+}
+
+// ** RayBuffer::trace
+void RayBuffer::trace( ITracer* tracer, bool reorder )
+{
+    if( m_segments.empty() ) {
+        return;
+    }
+
+    if( !reorder ) {
+        tracer->traceSegments( &m_segments[0], size() );
+        return;
+    }
+
+    sort();
+    tracer->traceSegments( &m_sorted[0], size() );
+    scatter();
+}
+
+// ** RayBuffer::test
+void RayBuffer::test( ITracer* tracer, bool reorder )
+{
+    if( m_segments.empty() ) {
+        return;
+    }
+
+    if( !reorder ) {
+        tracer->testSegments( &m_segments[0], size() );
+        return;
+    }
+
+    sort();
+    tracer->testSegments( &m_sorted[0], size() );
+    scatter();
+}
+
+// ** RayBuffer::sort
+void RayBuffer::sort( void )
+{
+    int count = size();
+
+    // ** Origins are quantized relative to their bounds
+    Bounds origins;
+
+    for( int i = 0; i < count; i++ ) {
+        origins << m_segments[i].m_start;
+    }
+
+    Vec3 extent = origins.max() - origins.min();
+    Vec3 scale;
+
+    for( int i = 0; i < 3; i++ ) {
+        scale[i] = extent[i] > 0.0f ? 1023.0f / extent[i] : 0.0f;
+    }
+
+    // ** A direction octant is the most significant part of a key, so similar directions are grouped first
+    m_keys.resize( count );
+
+    for( int i = 0; i < count; i++ ) {
+        const Segment& segment   = m_segments[i];
+        Vec3           direction = segment.m_end - segment.m_start;
+        Vec3           origin    = segment.m_start - origins.min();
+
+        u64 octant = (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+        u64 morton = spreadBits( static_cast<u32>( origin.x * scale.x ) )
+                   | (spreadBits( static_cast<u32>( origin.y * scale.y ) ) << 1)
+                   | (spreadBits( static_cast<u32>( origin.z * scale.z ) ) << 2);
+
+        m_keys[i].m_key   = (octant << 30) | morton;
+        m_keys[i].m_index = i;
+    }
+
+    sortKeys();
+
+    m_sorted.resize( count );
+
+    for( int i = 0; i < count; i++ ) {
+        m_sorted[i] = m_segments[m_keys[i].m_index];
+    }
+}
+
+// ** RayBuffer::sortKeys
+void RayBuffer::sortKeys( void )
+{
+    int count = size();
+
+    m_swap.resize( count );
+
+    for( int shift = 0; shift < KeyBits; shift += RadixBits ) {
+        int offsets[RadixSize] = { 0 };
+
+        for( int i = 0; i < count; i++ ) {
+            offsets[(m_keys[i].m_key >> shift) & (RadixSize - 1)]++;
+        }
+
+        for( int i = 0, offset = 0; i < RadixSize; i++ ) {
+            int digits = offsets[i];
+            offsets[i] = offset;
+            offset    += digits;
+        }
+
+        for( int i = 0; i < count; i++ ) {
+            m_swap[offsets[(m_keys[i].m_key >> shift) & (RadixSize - 1)]++] = m_keys[i];
+        }
+
+        m_keys.swap( m_swap );
+    }
+}
+
+// ** RayBuffer::scatter
+void RayBuffer::scatter( void )
+{
+    for( int i = 0, n = size(); i < n; i++ ) {
+        Segment& segment = m_segments[m_keys[i].m_index];
+
+        segment.m_hit      = m_sorted[i].m_hit;
+        segment.m_occluded = m_sorted[i].m_occluded;
+    }
+}
+
+// ** RayBuffer::spreadBits
+u64 RayBuffer::spreadBits( u32 value )
+{
+    u64 x = value & 0x3ff;
+
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+
+    return x;
+}
+
+} // namespace rt
+
+} // namespace relight
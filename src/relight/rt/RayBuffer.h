@@ -0,0 +1,109 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+
+
+#ifndef __Relight_RT_RayBuffer_H__
+#define __Relight_RT_RayBuffer_H__
+
+#include "Tracer.h"
+
+namespace relight {
+
+namespace rt {
+
+    // ** class RayBuffer
+    /*!
+     Collects segments of many lumels and traces them reordered for coherence. Segments are sorted by a key
+     made of a direction octant and a Morton code of a quantized origin, so rays that start close to each other
+     and go in a similar direction are traced together and visit the same hierarchy nodes. Results are scattered
+     back, so segments keep the order they were allocated in.
+     */
+    class RayBuffer {
+    public:
+
+        //! Returns an amount of buffered segments.
+        int                 size( void ) const;
+
+        //! Removes all buffered segments.
+        void                clear( void );
+
+        //! Appends a given amount of segments and returns a pointer to the first one, valid until a next allocation.
+        Segment*            allocate( int count );
+
+        //! Returns a buffered segment.
+        Segment&            segment( int index );
+
+        //! Traces all buffered segments, optionally sorted by a coherence key.
+        void                trace( ITracer* tracer, bool reorder = true );
+
+        //! Tests all buffered segments for occlusion, optionally sorted by a coherence key.
+        void                test( ITracer* tracer, bool reorder = true );
+
+    private:
+
+        //! Sorts buffered segments to a reordered array.
+        void                sort( void );
+
+        //! Sorts keys with a least significant digit radix sort.
+        void                sortKeys( void );
+
+        //! Copies results of reordered segments back to buffered ones.
+        void                scatter( void );
+
+        //! Spreads lower 10 bits of a value, so there are two zero bits between each bit.
+        static u64          spreadBits( u32 value );
+
+    private:
+
+        //! A segment sorting key.
+        struct SortKey {
+            u64             m_key;      //!< Octant and Morton code.
+            int             m_index;    //!< Buffered segment index.
+
+        };
+
+        //! A key has 3 octant bits and 30 Morton code bits, it is sorted by 11 bit digits.
+        enum { KeyBits = 33, RadixBits = 11, RadixSize = 1 << RadixBits };
+
+        //! Buffered segments in an allocation order.
+        Array<Segment>      m_segments;
+
+        //! Segments sorted by a coherence key.
+        Array<Segment>      m_sorted;
+
+        //! Sorting keys.
+        Array<SortKey>      m_keys;
+
+        //! Temporary keys used by a radix sort pass.
+        Array<SortKey>      m_swap;
+    };
+
+} // namespace rt
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_RT_RayBuffer_H__ ) */
@@ -48,8 +48,26 @@ namespace rt {
         const Mesh*     m_mesh;     //!< Intersected mesh instance.
     };
 
+    //! Enumeration of flags for trace results.
+    enum HitFlags {
+        HitPoint    = 1 << 0,
+        HitUv       = 1 << 1,
+        HitColor    = 1 << 2,
+        HitNormal   = 1 << 3,
+        HitUseAlpha = 1 << 4,
+        HitAll      = HitPoint | HitUv | HitColor | HitNormal
+    };
+
+    //! Surfaces with an alpha below this threshold are transparent for rays traced with HitUseAlpha.
+    const float k_AlphaThreshold = 0.1f;
+
     //! A ray tracer segment.
     struct Segment {
+                        //! Constructs a Segment instance.
+                        Segment( void ) : m_flags( HitAll ), m_occluded( false ) {}
+
+                        //! Constructs a Segment instance from it's end points.
+                        Segment( const Vec3& start, const Vec3& end, int flags = HitAll ) : m_start( start ), m_end( end ), m_flags( flags ), m_occluded( false ) {}
 
         //! Segment start point.
         Vec3            m_start;
@@ -57,18 +75,14 @@ namespace rt {
         //! Segment end point.
         Vec3            m_end;
 
+        //! Hit flags that specify a hit data to be calculated.
+        int             m_flags;
+
         //! Ray tracing result.
         Hit             m_hit;
-    };
 
-    //! Enumeration of flags for trace results.
-    enum HitFlags {
-        HitPoint    = 1 << 0,
-        HitUv       = 1 << 1,
-        HitColor    = 1 << 2,
-        HitNormal   = 1 << 3,
-        HitUseAlpha = 1 << 4,
-        HitAll      = HitPoint | HitUv | HitColor | HitNormal
+        //! Occlusion test result.
+        bool            m_occluded;
     };
 
     //! A base class for all scene ray tracers.
@@ -84,18 +98,38 @@ namespace rt {
          \param result Ray tracing result.
          \return True if a ray intersects a scene, otherwise false.
          */
-        virtual Hit            traceSegment( const Vec3& start, const Vec3& end, int flags = HitAll, int step = 0 ) = 0;
+        virtual Hit            traceSegment( const Vec3& start, const Vec3& end, int flags = HitAll ) = 0;
 
         //! Test a given segment for intersection with scene.
         /*!
+         An occlusion query stops at the first hit found and calculates no hit data,
+         so it should be preferred by all callers that only need a visibility.
+
          \param start Segment start point.
          \param end Segment end point.
+         \param flags Only HitUseAlpha is taken into account, transparent surfaces do not occlude a segment if set.
          \return True if a ray intersects a scene, otherwise false.
          */
-        virtual bool            test( const Vec3& start, const Vec3& end ) = 0;
+        virtual bool            test( const Vec3& start, const Vec3& end, int flags = 0 ) = 0;
+
+        //! Tests a stream of segments for intersection with scene.
+        /*!
+         Results are written to a segment m_occluded field, segment hits are left untouched.
+
+         \param segments Segments to be tested.
+         \param count Amount of segments in a stream.
+         */
+        virtual void            testSegments( Segment* segments, int count ) = 0;
 
-        //! Traces a batch of 4 segments.
-        virtual void            traceSegments( Segment segments[4] ) = 0;
+        //! Traces a stream of segments.
+        /*!
+         Segments are traced in batches of a backend preferred size. The hit data requested
+         by segment flags is written to a segment hit, the same way traceSegment does.
+
+         \param segments Segments to be traced.
+         \param count Amount of segments in a stream.
+         */
+        virtual void            traceSegments( Segment* segments, int count ) = 0;
 
         //! Adds a new mesh instance to scene.
         virtual void            addMesh( const Mesh* mesh ) = 0;
@@ -105,6 +139,21 @@ namespace rt {
 
         //! Ends a scene construction.
         virtual void            end( void ) = 0;
+
+        //! Removes a mesh from a scene, a mesh data is not destroyed.
+        virtual void            removeMesh( const Mesh* mesh ) = 0;
+
+        //! Notifies a tracer that an instance transform of a given mesh was changed.
+        virtual void            updateMesh( const Mesh* mesh ) = 0;
+
+        //! Applies meshes added, removed and updated after a scene construction ended.
+        /*!
+         Tracing a scene is not allowed between a scene change and an update call.
+         */
+        virtual void            update( void ) = 0;
+
+        //! Returns an approximate amount of memory in bytes used by acceleration structures and hit attributes.
+        virtual u64             memoryUsage( void ) const = 0;
     };
 
 } // namespace rt
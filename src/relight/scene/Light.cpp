@@ -33,10 +33,16 @@
 
 namespace relight {
 
+//! Length of shadow rays cast towards directional lights.
+static const float k_ShadowDistance = 1000.0f;
+
+//! Solid angle below which area light triangles are sampled by area only, as spherical triangle angles lose precision.
+static const float k_MinSolidAngle = 0.01f;
+
 // ------------------------------------------------------------ Light ------------------------------------------------------------ //
 
 // ** Light::Light
-Light::Light( void ) : m_intensity( 0.0f ), m_castsShadow( false ), m_cutoff( NULL ), m_attenuation( NULL ), m_influence( NULL ), m_vertexGenerator( NULL ), m_photonEmitter( NULL )
+Light::Light( void ) : m_intensity( 0.0f ), m_castsShadow( false ), m_cutoff( NULL ), m_attenuation( NULL ), m_influence( NULL ), m_vertexGenerator( NULL ), m_areaSampler( NULL ), m_photonEmitter( NULL )
 {
 
 }
@@ -47,6 +53,7 @@ Light::~Light( void )
     delete m_attenuation;
     delete m_photonEmitter;
     delete m_influence;
+    delete m_areaSampler;
 }
 
 // ** Light::cutoff
@@ -88,6 +95,19 @@ void Light::setVertexGenerator( LightVertexGenerator* value )
     m_vertexGenerator = value;
 }
 
+// ** Light::areaSampler
+LightAreaSampler* Light::areaSampler( void ) const
+{
+    return m_areaSampler;
+}
+
+// ** Light::setAreaSampler
+void Light::setAreaSampler( LightAreaSampler* value )
+{
+    delete m_areaSampler;
+    m_areaSampler = value;
+}
+
 // ** Light::attenuation
 LightAttenuation* Light::attenuation( void ) const
 {
@@ -216,20 +236,14 @@ Light* Light::createAreaLight( const Mesh* mesh, const Vec3& position, const Rgb
     Light* light = new Light;
 
     light->setInfluence( new LightInfluence( light ) );
-    light->setAttenuation( new LinearLightAttenuation( light, mesh->bounds().volume() ) );
-    light->setPhotonEmitter( new PhotonEmitter( light ) );
+    light->setPhotonEmitter( new AreaPhotonEmitter( light ) );
     light->setCutoff( new LightCutoff( light ) );
-//    light->setVertexGenerator( new FaceLightVertexGenerator( mesh, true, 3 ) );
-//  light->setVertexGenerator( new FaceLightVertexGenerator( mesh, false, 0 ) );
-  light->setVertexGenerator( new FaceLightVertexGenerator( mesh, true, 0 ) );
-//  light->setVertexGenerator( new LightVertexGenerator( mesh ) );
+    light->setAreaSampler( new LightAreaSampler( mesh ) );
     light->setCastsShadow( castsShadow );
     light->setPosition( position );
     light->setColor( color );
     light->setIntensity( intensity );
-    
-    light->vertexGenerator()->generate();
-    
+
     return light;
 }
 
@@ -274,8 +288,8 @@ void LightVertexGenerator::push( const Vertex& vertex )
 {
      LightVertex lightVertex;
 
-     lightVertex.m_position = vertex.position;
-     lightVertex.m_normal   = vertex.normal;
+     lightVertex.m_position = m_mesh->worldPosition( vertex.position );
+     lightVertex.m_normal   = m_mesh->worldNormal( vertex.normal );
 
      m_vertices.push_back( lightVertex );
 }
@@ -322,6 +336,284 @@ void FaceLightVertexGenerator::generateFromTriangle( const Triangle& triangle, i
     }
 }
 
+// ------------------------------------------------------ LightAreaSampler ------------------------------------------------------- //
+
+// ** LightAreaSampler::LightAreaSampler
+LightAreaSampler::LightAreaSampler( const Mesh* mesh ) : m_area( 0.0f )
+{
+    for( int i = 0; i < mesh->faceCount(); i++ ) {
+        const Face& face = mesh->face( i );
+        Patch       patch;
+
+        patch.m_a = mesh->worldPosition( face.vertex( 0 )->position );
+        patch.m_b = mesh->worldPosition( face.vertex( 1 )->position );
+        patch.m_c = mesh->worldPosition( face.vertex( 2 )->position );
+
+        // ** Orient a geometric normal to an emitting side given by vertex normals
+        Vec3 normal  = (patch.m_b - patch.m_a) % (patch.m_c - patch.m_a);
+        Vec3 shading = mesh->worldNormal( face.vertex( 0 )->normal ) + mesh->worldNormal( face.vertex( 1 )->normal ) + mesh->worldNormal( face.vertex( 2 )->normal );
+
+        patch.m_area = normal.normalize() * 0.5f;
+
+        if( patch.m_area <= 0.0f ) {
+            continue;
+        }
+
+        patch.m_normal = normal * shading < 0.0f ? -normal : normal;
+
+        m_patches.push_back( patch );
+        m_area += patch.m_area;
+        m_bounds << patch.m_a << patch.m_b << patch.m_c;
+    }
+
+    // ** Build an alias table (Vose), each column keeps it's own triangle with a given probability or falls to an alias
+    int        count = ( int )m_patches.size();
+    Array<int> underfull;
+    Array<int> overfull;
+
+    m_probability.resize( count );
+    m_alias.resize( count );
+
+    for( int i = 0; i < count; i++ ) {
+        m_probability[i] = m_patches[i].m_area * count / m_area;
+        m_alias[i]       = i;
+
+        if( m_probability[i] < 1.0f ) {
+            underfull.push_back( i );
+        } else {
+            overfull.push_back( i );
+        }
+    }
+
+    while( !underfull.empty() && !overfull.empty() ) {
+        int s = underfull.back(); underfull.pop_back();
+        int l = overfull.back(); overfull.pop_back();
+
+        m_alias[s]        = l;
+        m_probability[l] -= 1.0f - m_probability[s];
+
+        if( m_probability[l] < 1.0f ) {
+            underfull.push_back( l );
+        } else {
+            overfull.push_back( l );
+        }
+    }
+
+    // ** Remaining columns are full up to a rounding error
+    for( int i = 0, n = ( int )underfull.size(); i < n; i++ ) {
+        m_probability[underfull[i]] = 1.0f;
+    }
+
+    for( int i = 0, n = ( int )overfull.size(); i < n; i++ ) {
+        m_probability[overfull[i]] = 1.0f;
+    }
+}
+
+// ** LightAreaSampler::area
+float LightAreaSampler::area( void ) const
+{
+    return m_area;
+}
+
+// ** LightAreaSampler::triangleCount
+int LightAreaSampler::triangleCount( void ) const
+{
+    return ( int )m_patches.size();
+}
+
+// ** LightAreaSampler::bounds
+const Bounds& LightAreaSampler::bounds( void ) const
+{
+    return m_bounds;
+}
+
+// ** LightAreaSampler::pick
+int LightAreaSampler::pick( float sample ) const
+{
+    int   count  = ( int )m_patches.size();
+    float column = sample * count;
+    int   index  = min2( static_cast<int>( column ), count - 1 );
+
+    return column - index < m_probability[index] ? index : m_alias[index];
+}
+
+// ** LightAreaSampler::samplePoint
+void LightAreaSampler::samplePoint( const Vec3& offset, const Vec2& sample, Random& random, Vec3& position, Vec3& normal ) const
+{
+    const Patch& patch = m_patches[pick( random.next0to1() )];
+
+    // ** Uniform barycentric coordinates
+    float su = sqrtf( sample.x );
+    float u  = 1.0f - su;
+    float v  = sample.y * su;
+
+    position = patch.m_a * u + patch.m_b * v + patch.m_c * (1.0f - u - v) + offset;
+    normal   = patch.m_normal;
+}
+
+// ** LightAreaSampler::solidAngles
+void LightAreaSampler::solidAngles( const Vec3& offset, const Vec3& point, Array<float>& distribution ) const
+{
+    float total = 0.0f;
+
+    // ** Solid angles of all triangles are too expensive to be calculated at each lumel of a finely tessellated light
+    if( ( int )m_patches.size() > MaxSolidAngleTriangles ) {
+        distribution.clear();
+        return;
+    }
+
+    distribution.resize( m_patches.size() );
+
+    for( int i = 0, n = ( int )m_patches.size(); i < n; i++ ) {
+        const Patch& patch = m_patches[i];
+        Vec3         a     = patch.m_a + offset - point;
+
+        // ** Van Oosterom and Strackee formula stays precise for small triangles
+        if( -(a * patch.m_normal) > 0.0f ) {
+            Vec3  b           = patch.m_b + offset - point;
+            Vec3  c           = patch.m_c + offset - point;
+            float la          = a.length();
+            float lb          = b.length();
+            float lc          = c.length();
+            float numerator   = fabsf( a * (b % c) );
+            float denominator = la * lb * lc + (a * b) * lc + (b * c) * la + (c * a) * lb;
+            float angle       = 2.0f * atan2f( numerator, denominator );
+
+            total += angle;
+        }
+
+        distribution[i] = total;
+    }
+}
+
+// ** LightAreaSampler::sample
+float LightAreaSampler::sample( const Vec3& offset, const Vec3& point, const Vec3& normal, const Array<float>& distribution, const Vec2& sample, Random& random, Vec3& position ) const
+{
+    if( m_patches.empty() ) {
+        return 0.0f;
+    }
+
+    // ** Pick a strategy and a triangle, a solid angle strategy is skipped if a receiver sees no front face
+    float total    = distribution.empty() ? 0.0f : distribution.back();
+    float strategy = total > 0.0f ? 0.5f : 0.0f;
+    bool  solid    = random.next0to1() < strategy;
+    int   index    = 0;
+
+    if( solid ) {
+        index = ( int )(std::upper_bound( distribution.begin(), distribution.end(), random.next0to1() * total ) - distribution.begin());
+        index = min2( index, ( int )m_patches.size() - 1 );
+    } else {
+        index = pick( random.next0to1() );
+    }
+
+    const Patch& patch = m_patches[index];
+    Vec3         a     = patch.m_a + offset;
+    Vec3         b     = patch.m_b + offset;
+    Vec3         c     = patch.m_c + offset;
+
+    // ** A receiver is behind a one-sided triangle
+    float height = (point - a) * patch.m_normal;
+
+    if( height <= 0.0f ) {
+        return 0.0f;
+    }
+
+    // ** Small triangles are sampled by area with both strategies, as spherical triangle angles lose precision
+    Vec3 da = a - point; da.normalize();
+    Vec3 db = b - point; db.normalize();
+    Vec3 dc = c - point; dc.normalize();
+
+    float alpha      = 0.0f;
+    float solidAngle = sphericalTriangle( da, db, dc, alpha );
+    bool  spherical  = solidAngle > k_MinSolidAngle;
+    Vec3  direction;
+
+    if( solid && spherical ) {
+        direction = sampleSphericalTriangle( da, db, dc, solidAngle, alpha, sample );
+
+        float cosine = -(direction * patch.m_normal);
+
+        if( cosine <= 0.0f ) {
+            return 0.0f;
+        }
+
+        position = point + direction * (height / cosine);
+    } else {
+        float su = sqrtf( sample.x );
+        float u  = 1.0f - su;
+        float v  = sample.y * su;
+
+        position  = a * u + b * v + c * (1.0f - u - v);
+        direction = position - point;
+        direction.normalize();
+    }
+
+    float distance     = (position - point).length();
+    float cosLight     = -(direction * patch.m_normal);
+    float cosReceiver  = direction * normal;
+
+    if( cosLight <= 0.0f || cosReceiver <= 0.0f ) {
+        return 0.0f;
+    }
+
+    // ** Solid angle densities of a sampled point for both strategies
+    float pdfTriangle = distance * distance / (patch.m_area * cosLight);
+    float pdfArea     = (patch.m_area / m_area) * pdfTriangle;
+    float pdfSolid    = 0.0f;
+
+    if( strategy > 0.0f ) {
+        float weight = distribution[index] - (index ? distribution[index - 1] : 0.0f);
+        pdfSolid = (weight / total) * (spherical ? 1.0f / solidAngle : pdfTriangle);
+    }
+
+    float pdf = (1.0f - strategy) * pdfArea + strategy * pdfSolid;
+
+    // ** Emitted radiance is 1 / area
+    return cosReceiver / (m_area * pdf);
+}
+
+// ** LightAreaSampler::sphericalTriangle
+float LightAreaSampler::sphericalTriangle( const Vec3& a, const Vec3& b, const Vec3& c, float& alpha )
+{
+    // ** Interior angles are angles between great circle planes through each vertex
+    Vec3 ab = a % b; ab.normalize();
+    Vec3 ac = a % c; ac.normalize();
+    Vec3 ba = b % a; ba.normalize();
+    Vec3 bc = b % c; bc.normalize();
+    Vec3 ca = c % a; ca.normalize();
+    Vec3 cb = c % b; cb.normalize();
+
+    alpha = acosf( min2( max2( ab * ac, -1.0f ), 1.0f ) );
+
+    float beta  = acosf( min2( max2( ba * bc, -1.0f ), 1.0f ) );
+    float gamma = acosf( min2( max2( ca * cb, -1.0f ), 1.0f ) );
+
+    return alpha + beta + gamma - Pi;
+}
+
+// ** LightAreaSampler::sampleSphericalTriangle
+Vec3 LightAreaSampler::sampleSphericalTriangle( const Vec3& a, const Vec3& b, const Vec3& c, float solidAngle, float alpha, const Vec2& sample )
+{
+    // ** Pick a sub-triangle area, this moves a third vertex along an arc from a to c
+    float area  = sample.x * solidAngle;
+    float s     = sinf( area - alpha );
+    float t     = cosf( area - alpha );
+    float sa    = sinf( alpha );
+    float ca    = cosf( alpha );
+    float u     = t - ca;
+    float v     = s + sa * (a * b);
+    float q     = min2( max2( ((v * t - u * s) * ca - v) / ((v * s + u * t) * sa), -1.0f ), 1.0f );
+
+    Vec3 ortho  = c - a * (c * a); ortho.normalize();
+    Vec3 vertex = a * q + ortho * sqrtf( max2( 1.0f - q * q, 0.0f ) );
+
+    // ** Pick a point along an arc from b to a new vertex
+    float z     = 1.0f - sample.y * (1.0f - vertex * b);
+    Vec3  arc   = vertex - b * (vertex * b); arc.normalize();
+
+    return b * z + arc * sqrtf( max2( 1.0f - z * z, 0.0f ) );
+}
+
 // -------------------------------------------------------- PhotonEmitter --------------------------------------------------------- //
 
 // ** PhotonEmitter::PhotonEmitter
@@ -337,10 +629,10 @@ int PhotonEmitter::photonCount( void ) const
 }
 
 // ** PhotonEmitter::emit
-void PhotonEmitter::emit( const Scene* scene, Vec3& position, Vec3& direction ) const
+void PhotonEmitter::emit( const Scene* scene, Vec3& position, Vec3& direction, Sampler& sampler, Random& /*random*/ ) const
 {
     position  = m_light->position();
-    direction = Vec3::randomDirection();
+    direction = sampler.sphereDirection();
 }
 
 // --------------------------------------------------- DirectinalPhotonEmitter ---------------------------------------------------- //
@@ -352,14 +644,39 @@ DirectionalPhotonEmitter::DirectionalPhotonEmitter( const Light* light, const Ve
 }
 
 // ** DirectionalPhotonEmitter::emit
-void DirectionalPhotonEmitter::emit( const Scene* scene, Vec3& position, Vec3& direction ) const
+void DirectionalPhotonEmitter::emit( const Scene* scene, Vec3& position, Vec3& direction, Sampler& /*sampler*/, Random& random ) const
 {
     const Bounds& bounds = scene->bounds();
 
-    position  = m_plane * bounds.randomPointInside() - m_direction * 5;
+    position  = m_plane * bounds.randomPointInside( random ) - m_direction * 5;
     direction = m_direction;
 }
 
+// ----------------------------------------------------- AreaPhotonEmitter ------------------------------------------------------ //
+
+// ** AreaPhotonEmitter::AreaPhotonEmitter
+AreaPhotonEmitter::AreaPhotonEmitter( const Light* light ) : PhotonEmitter( light )
+{
+
+}
+
+// ** AreaPhotonEmitter::emit
+void AreaPhotonEmitter::emit( const Scene* scene, Vec3& position, Vec3& direction, Sampler& sampler, Random& random ) const
+{
+    const LightAreaSampler* area = m_light->areaSampler();
+    Vec3                    normal;
+
+    if( !area || !area->triangleCount() ) {
+        PhotonEmitter::emit( scene, position, direction, sampler, random );
+        return;
+    }
+
+    area->samplePoint( m_light->position(), sampler.next2D(), random, position, normal );
+
+    float u   = random.next0to1();
+    direction = Vec3::hemisphereDirectionCosine( normal, Vec2( u, random.next0to1() ) );
+}
+
 // ------------------------------------------------------- LightInfluence --------------------------------------------------------- //
 
 // ** LightInfluence::LightInfluence
@@ -370,6 +687,23 @@ LightInfluence::LightInfluence( const Light* light ) : m_light( light )
 
 // ** LightInfluence::calculate
 float LightInfluence::calculate( rt::ITracer* tracer, const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const
+{
+    float intensity = unshadowed( light, point, normal, distance );
+
+    if( intensity <= 0.0f ) {
+        return 0.0f;
+    }
+
+    // ** Cast shadow to point
+    if( m_light->castsShadow() ) {
+        intensity *= tracer->test( point, shadowRayEnd( light, point ), rt::HitUseAlpha ) ? 0.0f : 1.0f;
+    }
+
+    return intensity;
+}
+
+// ** LightInfluence::unshadowed
+float LightInfluence::unshadowed( const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const
 {
     Vec3 direction = light - point;
     distance       = direction.normalize();
@@ -380,12 +714,39 @@ float LightInfluence::calculate( rt::ITracer* tracer, const Vec3& light, const V
         return 0.0f;
     }
 
-    // ** Cast shadow to point
-    if( m_light->castsShadow() ) {
-        intensity *= tracer->traceSegment( point, light, rt::HitUseAlpha ) ? 0.0f : 1.0f;
+    return intensity;
+}
+
+// ** LightInfluence::shadowRayEnd
+Vec3 LightInfluence::shadowRayEnd( const Vec3& light, const Vec3& /*point*/ ) const
+{
+    return light;
+}
+
+// ** LightInfluence::shadowBounds
+Bounds LightInfluence::shadowBounds( const Bounds& receiver ) const
+{
+    Bounds result = receiver;
+    result << m_light->position();
+
+    // ** Area lights cast shadow rays to any point of their triangles
+    if( const LightAreaSampler* sampler = m_light->areaSampler() ) {
+        if( sampler->triangleCount() ) {
+            result << sampler->bounds().min() + m_light->position();
+            result << sampler->bounds().max() + m_light->position();
+        }
     }
 
-    return intensity;
+    // ** Vertex generated lights cast shadow rays to all of their vertices
+    if( const LightVertexGenerator* generator = m_light->vertexGenerator() ) {
+        const LightVertexBuffer& vertices = generator->vertices();
+
+        for( int i = 0, n = generator->vertexCount(); i < n; i++ ) {
+            result << vertices[i].m_position + m_light->position();
+        }
+    }
+
+    return result;
 }
 
 // ** LightInfluence::lambert
@@ -403,8 +764,8 @@ DirectionalLightInfluence::DirectionalLightInfluence( const Light* light, const
 
 }
 
-// ** DirectionalLightInfluence::calculate
-float DirectionalLightInfluence::calculate( rt::ITracer* tracer, const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const
+// ** DirectionalLightInfluence::unshadowed
+float DirectionalLightInfluence::unshadowed( const Vec3& /*light*/, const Vec3& /*point*/, const Vec3& normal, float& /*distance*/ ) const
 {
     float intensity = lambert( -m_direction, normal );
 
@@ -412,14 +773,24 @@ float DirectionalLightInfluence::calculate( rt::ITracer* tracer, const Vec3& lig
         return 0.0f;
     }
 
-    // ** Cast shadow to point
-    if( m_light->castsShadow() ) {
-        intensity *= tracer->traceSegment( point, point - m_direction * 1000, rt::HitUseAlpha ) ? 0.0f : 1.0f;
-    }
-
     return intensity;
 }
 
+// ** DirectionalLightInfluence::shadowRayEnd
+Vec3 DirectionalLightInfluence::shadowRayEnd( const Vec3& /*light*/, const Vec3& point ) const
+{
+    return point - m_direction * k_ShadowDistance;
+}
+
+// ** DirectionalLightInfluence::shadowBounds
+Bounds DirectionalLightInfluence::shadowBounds( const Bounds& receiver ) const
+{
+    Bounds result = receiver;
+    result << receiver.min() - m_direction * k_ShadowDistance;
+    result << receiver.max() - m_direction * k_ShadowDistance;
+    return result;
+}
+
 // --------------------------------------------------------- LightCutoff ---------------------------------------------------------- //
 
 // ** LightCutoff::LightCutoff
@@ -440,6 +811,12 @@ float LightCutoff::cutoffForDirection( const Vec3& direction ) const
     return 1.0f;
 }
 
+// ** LightCutoff::bound
+float LightCutoff::bound( const Bounds& /*region*/ ) const
+{
+    return 1.0f;
+}
+
 // ------------------------------------------------------- LightSpotCutoff -------------------------------------------------------- //
 
 // ** LightSpotCutoff::LightSpotCutoff
@@ -475,6 +852,23 @@ float LightSpotCutoff::cutoffForDirection( const Vec3& direction ) const
     return value;
 }
 
+// ** LightSpotCutoff::bound
+float LightSpotCutoff::bound( const Bounds& region ) const
+{
+    // ** Test a cone that encloses a bounding sphere of a region against a spot cone
+    Vec3  center   = region.center() - m_light->position();
+    float radius   = (region.max() - region.min()).length() * 0.5f;
+    float distance = center.normalize();
+
+    if( distance <= radius ) {
+        return 1.0f;
+    }
+
+    float angle = acosf( min2( max2( center * m_direction, -1.0f ), 1.0f ) ) - asinf( radius / distance );
+
+    return angle <= 0.0f || cosf( angle ) > m_cutoff ? 1.0f : 0.0f;
+}
+
 // ------------------------------------------------------- LightAttenuation ------------------------------------------------------- //
 
 // ** LightAttenuation::LightAttenuation
@@ -48,6 +48,9 @@ namespace relight {
         //! Calculates a light cutoff for direction.
         virtual float       cutoffForDirection( const Vec3& direction ) const;
 
+        //! Returns an upper bound of a light cutoff for all points inside a region.
+        virtual float       bound( const Bounds& region ) const;
+
     protected:
 
         //! Parent light instance.
@@ -76,6 +79,9 @@ namespace relight {
         //! Calculates a light cutoff for direction.
         virtual float       cutoffForDirection( const Vec3& direction ) const;
 
+        //! Returns zero if a region lies outside a spot light cone, otherwise one.
+        virtual float       bound( const Bounds& region ) const;
+
     private:
 
         //! Light direction.
@@ -148,6 +154,15 @@ namespace relight {
         //! Calculates omni light influence to a given point.
         virtual float       calculate( rt::ITracer* tracer, const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const;
 
+        //! Calculates omni light influence to a given point ignoring shadows.
+        virtual float       unshadowed( const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const;
+
+        //! Returns an end point of a shadow ray cast from a given point towards a light.
+        virtual Vec3        shadowRayEnd( const Vec3& light, const Vec3& point ) const;
+
+        //! Returns a bounding box of all shadow rays cast from a given receiver, a light position is used as a ray end point.
+        virtual Bounds      shadowBounds( const Bounds& receiver ) const;
+
         //! Calculates a light influence by a Lambert's cosine law.
         static float        lambert( const Vec3& direction, const Vec3& normal );
 
@@ -166,8 +181,14 @@ namespace relight {
                             //! Constructs a DirectionalLightInfluence instance.
                             DirectionalLightInfluence( const Light* light, const Vec3& direction );
 
-        //! Calculates a directional light influence.
-        virtual float       calculate( rt::ITracer* tracer, const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const;
+        //! Calculates a directional light influence ignoring shadows.
+        virtual float       unshadowed( const Vec3& light, const Vec3& point, const Vec3& normal, float& distance ) const;
+
+        //! Returns an end point of a shadow ray cast from a given point along a light direction.
+        virtual Vec3        shadowRayEnd( const Vec3& light, const Vec3& point ) const;
+
+        //! Returns a bounding box of all shadow rays cast from a given receiver along a light direction.
+        virtual Bounds      shadowBounds( const Bounds& receiver ) const;
 
     private:
 
@@ -189,7 +210,14 @@ namespace relight {
         virtual int         photonCount( void ) const;
 
         //! Emits a new photon.
-        virtual void        emit( const Scene* scene, Vec3& position, Vec3& direction ) const;
+        /*!
+         \param scene Scene to emit photon to.
+         \param position Emitted photon position.
+         \param direction Emitted photon direction.
+         \param sampler Sample sequence positioned at an emitted photon index.
+         \param random Random number generator seeded by an emitted photon index.
+         */
+        virtual void        emit( const Scene* scene, Vec3& position, Vec3& direction, Sampler& sampler, Random& random ) const;
 
     protected:
 
@@ -211,7 +239,7 @@ namespace relight {
                             DirectionalPhotonEmitter( const Light* light, const Vec3& direction );
 
         //! Emits a new photon.
-        virtual void        emit( const Scene* scene, Vec3& position, Vec3& direction ) const;
+        virtual void        emit( const Scene* scene, Vec3& position, Vec3& direction, Sampler& sampler, Random& random ) const;
 
     private:
 
@@ -222,6 +250,19 @@ namespace relight {
         Plane               m_plane;
     };
 
+    /*!
+     Area photon emitter emits photons from a surface of a mesh light with a cosine weighted direction.
+     */
+    class AreaPhotonEmitter : public PhotonEmitter {
+    public:
+
+                            //! Constructs a new AreaPhotonEmitter instance.
+                            AreaPhotonEmitter( const Light* light );
+
+        //! Emits a photon from a point sampled on a light surface.
+        virtual void        emit( const Scene* scene, Vec3& position, Vec3& direction, Sampler& sampler, Random& random ) const;
+    };
+
     /*!
      A base class for all light types in Relight.
      */
@@ -248,6 +289,16 @@ namespace relight {
         //! Sets an light vertex generator.
         void                setVertexGenerator( LightVertexGenerator* value );
 
+        //! Returns a light area sampler.
+        LightAreaSampler*   areaSampler( void ) const;
+
+        //! Sets a light area sampler.
+        /*!
+         Lights with an area sampler are baked by sampling points on a light surface,
+         a light vertex generator is ignored in this case.
+         */
+        void                setAreaSampler( LightAreaSampler* value );
+
         //! Returns an cutoff model.
         LightCutoff*        cutoff( void ) const;
 
@@ -297,7 +348,7 @@ namespace relight {
         //! Creates a directional light instance.
         static Light*       createDirectionalLight( const Vec3& direction, const Rgb& color = Rgb( 1.0f, 1.0f, 1.0f ), float intensity = 1.0f, bool castsShadow = true );
 
-        //! Creates an area light instance.
+        //! Creates an area light instance, no attenuation is set, because a light from each mesh triangle already falls off with an inverse square of a distance.
         static Light*       createAreaLight( const Mesh* mesh, const Vec3& position, const Rgb& color = Rgb( 1.0f, 1.0f, 1.0f ), float intensity = 1.0f, bool castsShadow = true );
 
     protected:
@@ -331,6 +382,9 @@ namespace relight {
         //! Light vertex sampler.
         LightVertexGenerator*   m_vertexGenerator;
 
+        //! Light surface sampler.
+        LightAreaSampler*   m_areaSampler;
+
         //! Light source photon emitter.
         PhotonEmitter*      m_photonEmitter;
     };
@@ -411,6 +465,99 @@ namespace relight {
         int                         m_maxSubdivisions;
     };
 
+    /*!
+     A LightAreaSampler samples points on a surface of a mesh light source.
+
+     Two sampling strategies are combined with a one-sample balance heuristic. An area strategy picks
+     a triangle proportionally to it's area with an alias table and samples a point on it uniformly.
+     A solid angle strategy picks a triangle proportionally to a solid angle it subtends from a receiver
+     and samples a direction inside it uniformly (Arvo, "Stratified Sampling of Spherical Triangles").
+     Area sampling is robust for distant triangles, while solid angle sampling removes an inverse
+     square variance near a light.
+
+     Each triangle emits from it's front side with a radiance normalized by a total light area,
+     so a light emits the same power regardless of it's size and tesselation.
+     */
+    class LightAreaSampler {
+    public:
+
+        enum {
+            MaxSolidAngleTriangles = 64,     //!< Maximum amount of triangles, for which a solid angle distribution is calculated per receiver.
+        };
+
+                                    //! Constructs a LightAreaSampler instance.
+                                    LightAreaSampler( const Mesh* mesh );
+
+        //! Returns a total light area.
+        float                       area( void ) const;
+
+        //! Returns an amount of emitting triangles.
+        int                         triangleCount( void ) const;
+
+        //! Returns bounds of emitting triangles.
+        const Bounds&               bounds( void ) const;
+
+        //! Calculates a cumulative distribution of triangle solid angles seen from a receiver.
+        /*!
+         Lights with more than MaxSolidAngleTriangles triangles output an empty distribution and are sampled by area only.
+         \param offset Light position added to mesh triangles.
+         \param point Receiver position.
+         \param distribution Output cumulative solid angles, back facing triangles subtend a zero solid angle.
+         */
+        void                        solidAngles( const Vec3& offset, const Vec3& point, Array<float>& distribution ) const;
+
+        //! Samples a light point that illuminates a given receiver.
+        /*!
+         \param offset Light position added to mesh triangles.
+         \param point Receiver position.
+         \param normal Receiver normal.
+         \param distribution Cumulative triangle solid angles calculated for a receiver.
+         \param sample A point in a [0, 1) square used to sample a point on a triangle.
+         \param random Random number generator used to pick a triangle and a sampling strategy.
+         \param position Output light point.
+         \return An unshadowed irradiance estimate of a unit intensity light, zero if a sampled point does not illuminate a receiver.
+         */
+        float                       sample( const Vec3& offset, const Vec3& point, const Vec3& normal, const Array<float>& distribution, const Vec2& sample, Random& random, Vec3& position ) const;
+
+        //! Samples a point on a light surface uniformly by area.
+        void                        samplePoint( const Vec3& offset, const Vec2& sample, Random& random, Vec3& position, Vec3& normal ) const;
+
+    private:
+
+        //! An emitting mesh triangle.
+        struct Patch {
+            Vec3                    m_a, m_b, m_c;  //!< Triangle vertices.
+            Vec3                    m_normal;       //!< Emitting side normal.
+            float                   m_area;         //!< Triangle area.
+        };
+
+        //! Picks a triangle index proportionally to it's area.
+        int                         pick( float sample ) const;
+
+        //! Calculates a solid angle of a spherical triangle and an interior angle at it's first vertex.
+        static float                sphericalTriangle( const Vec3& a, const Vec3& b, const Vec3& c, float& alpha );
+
+        //! Samples a direction uniformly inside a spherical triangle.
+        static Vec3                 sampleSphericalTriangle( const Vec3& a, const Vec3& b, const Vec3& c, float solidAngle, float alpha, const Vec2& sample );
+
+    private:
+
+        //! Emitting triangles in a mesh world space.
+        Array<Patch>                m_patches;
+
+        //! Probability of keeping a triangle picked from an alias table column.
+        Array<float>                m_probability;
+
+        //! Alias triangle of each alias table column.
+        Array<int>                  m_alias;
+
+        //! Total light area.
+        float                       m_area;
+
+        //! Bounds of emitting triangles.
+        Bounds                      m_bounds;
+    };
+
 } // namespace relight
 
 #endif  /*  !defined( __Relight_Light_H__ ) */
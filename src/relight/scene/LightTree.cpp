@@ -0,0 +1,253 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#include "../BuildCheck.h"
+
+#include "LightTree.h"
+#include "Light.h"
+
+namespace relight {
+
+// ** LightTree::LightTree
+LightTree::LightTree( void ) : m_maxDistance( 1.0f )
+{
+
+}
+
+// ** LightTree::nodeCount
+int LightTree::nodeCount( void ) const
+{
+    return ( int )m_nodes.size();
+}
+
+// ** LightTree::node
+const LightTree::Node& LightTree::node( int index ) const
+{
+    assert( index >= 0 && index < nodeCount() );
+    return m_nodes[index];
+}
+
+// ** LightTree::unclusteredLightCount
+int LightTree::unclusteredLightCount( void ) const
+{
+    return ( int )m_unclustered.size();
+}
+
+// ** LightTree::unclusteredLight
+const Light* LightTree::unclusteredLight( int index ) const
+{
+    assert( index >= 0 && index < unclusteredLightCount() );
+    return m_unclustered[index];
+}
+
+// ** LightTree::isClustered
+bool LightTree::isClustered( const Light* light )
+{
+    // ** Directional lights have no attenuation, area lights are sampled over their surface and vertex generated lights at their vertices
+    return light->attenuation() && light->influence() && !light->vertexGenerator() && !light->areaSampler();
+}
+
+// ** LightTree::build
+void LightTree::build( const Array<const Light*>& lights, const Bounds& bounds )
+{
+    Array<int> indices;
+
+    m_nodes.clear();
+    m_unclustered.clear();
+
+    Bounds extents = bounds;
+
+    for( int i = 0, n = ( int )lights.size(); i < n; i++ ) {
+        if( isClustered( lights[i] ) ) {
+            indices.push_back( i );
+            extents << lights[i]->position();
+        } else {
+            m_unclustered.push_back( lights[i] );
+        }
+    }
+
+    if( indices.empty() ) {
+        return;
+    }
+
+    m_maxDistance = max2( (extents.max() - extents.min()).length(), 1.0f );
+    m_nodes.reserve( indices.size() * 2 - 1 );
+
+    build( lights, &indices[0], ( int )indices.size() );
+}
+
+// ** LightTree::build
+int LightTree::build( const Array<const Light*>& lights, int* indices, int count )
+{
+    int index = ( int )m_nodes.size();
+    m_nodes.push_back( Node() );
+
+    // ** Create a leaf node
+    if( count == 1 ) {
+        const Light* light = lights[indices[0]];
+        Node&        node  = m_nodes[index];
+
+        node.m_bounds      = Bounds( light->position(), light->position() );
+        node.m_intensity   = light->color() * light->intensity();
+        node.m_light       = light;
+        node.m_children[0] = node.m_children[1] = -1;
+
+        for( int i = 0; i < AttenuationSamples; i++ ) {
+            node.m_attenuation[i] = light->attenuation()->calculate( sampleDistance( i ) );
+        }
+
+        return index;
+    }
+
+    // ** Split lights by a median position along the longest axis
+    Bounds bounds;
+
+    for( int i = 0; i < count; i++ ) {
+        bounds << lights[indices[i]]->position();
+    }
+
+    Vec3 size = bounds.max() - bounds.min();
+    int  axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+    struct Position {
+        const Array<const Light*>*  m_lights;
+        int                         m_axis;
+
+        bool operator()( int a, int b ) const {
+            float pa = (*m_lights)[a]->position()[m_axis];
+            float pb = (*m_lights)[b]->position()[m_axis];
+            return pa < pb || (pa == pb && a < b);
+        }
+    };
+
+    Position position;
+    position.m_lights = &lights;
+    position.m_axis   = axis;
+
+    int half = count / 2;
+    std::nth_element( indices, indices + half, indices + count, position );
+
+    int left  = build( lights, indices, half );
+    int right = build( lights, indices + half, count - half );
+
+    // ** Merge children, the node reference is taken after recursion because nodes are appended to an array
+    Node&       node = m_nodes[index];
+    const Node& a    = m_nodes[left];
+    const Node& b    = m_nodes[right];
+
+    node.m_bounds      = a.m_bounds;
+    node.m_bounds     += b.m_bounds;
+    node.m_intensity   = a.m_intensity + b.m_intensity;
+    node.m_light       = NULL;
+    node.m_children[0] = left;
+    node.m_children[1] = right;
+
+    for( int i = 0; i < AttenuationSamples; i++ ) {
+        node.m_attenuation[i] = max2( a.m_attenuation[i], b.m_attenuation[i] );
+    }
+
+    return index;
+}
+
+// ** LightTree::bound
+float LightTree::bound( const Node& node, const Vec3& point, const Vec3& normal ) const
+{
+    // ** A cosine numerator is linear in a light position, so it's maximum is reached at a box corner
+    const Vec3& min = node.m_bounds.min();
+    const Vec3& max = node.m_bounds.max();
+    float       dp  = 0.0f;
+
+    for( int i = 0; i < 8; i++ ) {
+        Vec3 corner( i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z );
+        dp = max2( dp, (corner - point) * normal );
+    }
+
+    if( dp <= 0.0f ) {
+        return 0.0f;
+    }
+
+    float distance = LightTree::distance( node.m_bounds, point );
+    float cosine   = distance > 0.0f ? min2( dp / distance, 1.0f ) : 1.0f;
+
+    return node.m_intensity.luminance() * cosine * attenuation( node, distance );
+}
+
+// ** LightTree::bound
+float LightTree::bound( const Node& node, const Bounds& region ) const
+{
+    float cutoff = 1.0f;
+
+    if( node.isLeaf() && node.m_light->cutoff() ) {
+        cutoff = node.m_light->cutoff()->bound( region );
+    }
+
+    return node.m_intensity.luminance() * cutoff * attenuation( node, distance( node.m_bounds, region ) );
+}
+
+// ** LightTree::attenuation
+float LightTree::attenuation( const Node& node, float distance ) const
+{
+    // ** Take the nearest tabulated distance that does not exceed a given one
+    int index = 0;
+
+    if( distance >= sampleDistance( 1 ) ) {
+        index = AttenuationSamples - 1 + static_cast<int>( floorf( 2.0f * logf( distance / m_maxDistance ) / logf( 2.0f ) ) );
+        index = max2( 1, min2( index, AttenuationSamples - 1 ) );
+    }
+
+    return node.m_attenuation[index];
+}
+
+// ** LightTree::sampleDistance
+float LightTree::sampleDistance( int index ) const
+{
+    // ** Distances are spaced by half an octave down from the largest one, the first distance is zero
+    if( index == 0 ) {
+        return 0.0f;
+    }
+
+    return m_maxDistance * powf( 2.0f, (index - (AttenuationSamples - 1)) * 0.5f );
+}
+
+// ** LightTree::distance
+float LightTree::distance( const Bounds& bounds, const Vec3& point )
+{
+    return distance( bounds, Bounds( point, point ) );
+}
+
+// ** LightTree::distance
+float LightTree::distance( const Bounds& a, const Bounds& b )
+{
+    Vec3 gap;
+
+    for( int i = 0; i < 3; i++ ) {
+        gap[i] = max3( a.min()[i] - b.max()[i], b.min()[i] - a.max()[i], 0.0f );
+    }
+
+    return gap.length();
+}
+
+} // namespace relight
@@ -0,0 +1,125 @@
+/**************************************************************************
+
+ The MIT License (MIT)
+
+ Copyright (c) 2015 Dmitry Sovetov
+
+ https://github.com/dmsovetov
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+ **************************************************************************/
+
+#ifndef __Relight_Scene_LightTree_H__
+#define __Relight_Scene_LightTree_H__
+
+#include "../Relight.h"
+
+namespace relight {
+
+    /*!
+     A light tree is a bounding volume hierarchy over positional light sources, that lets a baker
+     bound a light received from a whole cluster of lights without visiting each of them
+     (Walter et al., "Lightcuts: A Scalable Approach to Illumination").
+
+     Lights are split top-down by a median position along the longest axis, nodes are stored in
+     a depth-first order. Cluster bounds assume that light attenuation never grows with a distance,
+     so an upper envelope of cluster attenuation functions is tabulated at a fixed set of distances.
+     Directional and area lights are not clustered and should be evaluated separately.
+     */
+    class LightTree {
+    public:
+
+        enum {
+            AttenuationSamples = 33,    //!< Amount of distances an attenuation envelope is tabulated at.
+        };
+
+        //! A light cluster.
+        struct Node {
+            Bounds              m_bounds;                           //!< Bounds of cluster light positions.
+            Rgb                 m_intensity;                        //!< Total colored intensity of cluster lights.
+            const Light*        m_light;                            //!< Light source of a leaf node, NULL for inner nodes.
+            int                 m_children[2];                      //!< Child node indices, both are negative for leaf nodes.
+            float               m_attenuation[AttenuationSamples];  //!< Maximum attenuation of cluster lights at tabulated distances.
+
+            //! Returns true if this is a leaf node holding a single light.
+            bool                isLeaf( void ) const { return m_children[0] < 0; }
+        };
+
+                                //! Constructs a LightTree instance.
+                                LightTree( void );
+
+        //! Builds a tree from a set of scene lights.
+        /*!
+         \param lights Scene lights, only clustered ones are placed to a tree.
+         \param bounds Scene bounds used to choose distances an attenuation envelope is tabulated at.
+         */
+        void                    build( const Array<const Light*>& lights, const Bounds& bounds );
+
+        //! Returns a total amount of tree nodes, the first one is a root.
+        int                     nodeCount( void ) const;
+
+        //! Returns a tree node by index.
+        const Node&             node( int index ) const;
+
+        //! Returns an amount of lights that were not clustered.
+        int                     unclusteredLightCount( void ) const;
+
+        //! Returns a light that was not clustered by index.
+        const Light*            unclusteredLight( int index ) const;
+
+        //! Returns an upper bound of a cluster light luminance received by a surface point.
+        float                   bound( const Node& node, const Vec3& point, const Vec3& normal ) const;
+
+        //! Returns an upper bound of a cluster light luminance received by any point inside a region.
+        float                   bound( const Node& node, const Bounds& region ) const;
+
+        //! Returns true if a light is clustered by a light tree.
+        static bool             isClustered( const Light* light );
+
+    private:
+
+        //! Recursively builds a subtree from a range of light indices and returns it's root node.
+        int                     build( const Array<const Light*>& lights, int* indices, int count );
+
+        //! Returns an upper bound of a cluster attenuation at a given distance.
+        float                   attenuation( const Node& node, float distance ) const;
+
+        //! Returns a distance an attenuation envelope is tabulated at.
+        float                   sampleDistance( int index ) const;
+
+        //! Returns a distance between a point and a bounding box.
+        static float            distance( const Bounds& bounds, const Vec3& point );
+
+        //! Returns a distance between two bounding boxes.
+        static float            distance( const Bounds& a, const Bounds& b );
+
+    private:
+
+        //! Tree nodes.
+        Array<Node>             m_nodes;
+
+        //! Lights that are not clustered.
+        Array<const Light*>     m_unclustered;
+
+        //! The largest tabulated distance.
+        float                   m_maxDistance;
+    };
+
+} // namespace relight
+
+#endif  /*  !defined( __Relight_Scene_LightTree_H__ ) */
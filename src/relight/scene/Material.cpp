@@ -43,6 +43,12 @@ Rgba Material::colorAt( const Uv& uv ) const
     return m_color;
 }
 
+// ** Material::hasAlpha
+bool Material::hasAlpha( void ) const
+{
+    return false;
+}
+
 // ** Material::color
 const Rgb& Material::color( void ) const
 {
@@ -69,6 +75,12 @@ Rgba TexturedMaterial::colorAt( const Uv& uv ) const
     return Material::colorAt( uv ) * m_texture->colorAt( uv );
 }
 
+// ** TexturedMaterial::hasAlpha
+bool TexturedMaterial::hasAlpha( void ) const
+{
+    return m_texture->channels() == 4;
+}
+
 // ---------------------------------------- Texture ---------------------------------------- //
 
 // ** Texture::Texture
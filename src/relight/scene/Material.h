@@ -54,6 +54,9 @@ namespace relight {
         //! Returns a surface color at a given UV coordinates.
         virtual Rgba    colorAt( const Uv& uv ) const;
 
+        //! Returns true if a surface color has an alpha channel.
+        virtual bool    hasAlpha( void ) const;
+
     private:
 
         //! Diffuse color.
@@ -132,6 +135,9 @@ namespace relight {
         //! Returns a material diffuse color multiplied by a texture color.
         virtual Rgba    colorAt( const Uv& uv ) const;
 
+        //! Returns true if a material texture has an alpha channel.
+        virtual bool    hasAlpha( void ) const;
+
     private:
 
         //! Material texture.
@@ -35,7 +35,7 @@ namespace relight {
 // ---------------------------------------------- Mesh ---------------------------------------------- //
 
 // ** Mesh::Mesh
-Mesh::Mesh( void ) : m_lightmap( NULL ), m_photonmap( NULL ), m_radiancemap( NULL )
+Mesh::Mesh( void ) : m_lightmap( NULL ), m_photonmap( NULL ), m_radiancemap( NULL ), m_prototype( NULL ), m_id( 0 )
 {
 
 }
@@ -49,24 +49,40 @@ const Bounds& Mesh::bounds( void ) const
 // ** Mesh::vertexBuffer
 const Vertex* Mesh::vertexBuffer( void ) const
 {
+    if( m_prototype ) {
+        return m_prototype->vertexBuffer();
+    }
+
     return &m_vertices[0];
 }
 
 // ** Mesh::indexBuffer
 const Index* Mesh::indexBuffer( void ) const
 {
+    if( m_prototype ) {
+        return m_prototype->indexBuffer();
+    }
+
     return &m_indices[0];
 }
 
 // ** Mesh::indexCount
 int Mesh::indexCount( void ) const
 {
+    if( m_prototype ) {
+        return m_prototype->indexCount();
+    }
+
     return ( int )m_indices.size();
 }
 
 // ** Mesh::index
 Index Mesh::index( int index ) const
 {
+    if( m_prototype ) {
+        return m_prototype->index( index );
+    }
+
     assert( index >= 0 && index < indexCount() );
     return m_indices[index];
 }
@@ -74,12 +90,20 @@ Index Mesh::index( int index ) const
 // ** Mesh::vertexCount
 int Mesh::vertexCount( void ) const
 {
+    if( m_prototype ) {
+        return m_prototype->vertexCount();
+    }
+
     return ( int )m_vertices.size();
 }
 
 // ** Mesh::vertex
 const Vertex& Mesh::vertex( int index ) const
 {
+    if( m_prototype ) {
+        return m_prototype->vertex( index );
+    }
+
     assert( index >= 0 && index < vertexCount() );
     return m_vertices[index];
 }
@@ -87,6 +111,10 @@ const Vertex& Mesh::vertex( int index ) const
 // ** Mesh::faceCount
 int Mesh::faceCount( void ) const
 {
+    if( m_prototype ) {
+        return m_prototype->faceCount();
+    }
+
     return ( int )m_faces.size();
 }
 
@@ -125,11 +153,25 @@ Mesh* Mesh::createFromFile( const String& fileName )
 // ** Mesh::overrideMaterial
 void Mesh::overrideMaterial( const Material* material )
 {
+    assert( m_prototype == NULL );
+
     for( int i = 0; i < vertexCount(); i++ ) {
         m_vertices[i].material = material;
     }
 }
 
+// ** Mesh::hasAlpha
+bool Mesh::hasAlpha( void ) const
+{
+    for( int i = 0; i < vertexCount(); i++ ) {
+        if( vertex( i ).material && vertex( i ).material->hasAlpha() ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 // ** Mesh::setUserData
 void Mesh::setUserData( void* value )
 {
@@ -142,9 +184,25 @@ void* Mesh::userData( void ) const
     return m_userData;
 }
 
+// ** Mesh::setId
+void Mesh::setId( int value )
+{
+    m_id = value;
+}
+
+// ** Mesh::id
+int Mesh::id( void ) const
+{
+    return m_id;
+}
+
 // ** Mesh::addFaces
 void Mesh::addFaces( const VertexBuffer& vertices, const IndexBuffer& indices, const Material* material )
 {
+    assert( m_prototype == NULL );
+    assert( m_vertices.size() + vertices.size() <= k_MaxMeshElements );
+    assert( m_indices.size() / 3 + indices.size() / 3 <= k_MaxMeshElements );
+
     // ** Push indices
     for( int i = 0, n = ( int )indices.size(); i < n; i++ ) {
         m_indices.push_back( indices[i] + m_vertices.size() );
@@ -220,6 +278,10 @@ void Mesh::buildFaces( void )
 // ** Mesh::face
 const Face& Mesh::face( int index ) const
 {
+    if( m_prototype ) {
+        return m_prototype->face( index );
+    }
+
     assert( index >= 0 && index < faceCount() );
     assert( m_faces[index].faceIdx() == index );
     return m_faces[index];
@@ -228,7 +290,9 @@ const Face& Mesh::face( int index ) const
 // ** Mesh::generateUv
 void Mesh::generateUv( float angle, float margin, float padding )
 {
-	typedef TriMesh<Vertex, u16, Vertex::Compare>	RelightMesh;
+    assert( m_prototype == NULL );
+
+	typedef TriMesh<Vertex, Index, Vertex::Compare>	RelightMesh;
 	typedef AngularChartifier<RelightMesh>			Chartifier;
 	typedef RectanglePacker<float>					Packer;
 
@@ -276,6 +340,8 @@ void Mesh::setRadiancemap( Radiancemap* value )
 // ** Mesh::transform
 void Mesh::transform( const Matrix4& transform )
 {
+    assert( m_prototype == NULL );
+
     for( int i = 0, n = vertexCount(); i < n; i++ ) {
         m_vertices[i].position = transform * m_vertices[i].position;
         m_vertices[i].normal   = transform.rotate( m_vertices[i].normal );
@@ -286,6 +352,11 @@ void Mesh::transform( const Matrix4& transform )
 // ** Mesh::transformed
 Mesh* Mesh::transformed( const Matrix4& transform ) const
 {
+    // ** Instances are cloned from a prototype geometry
+    if( m_prototype ) {
+        return m_prototype->transformed( transform * m_transform );
+    }
+
     Mesh* mesh          = new Mesh;
     mesh->m_vertices    = m_vertices;
     mesh->m_indices     = m_indices;
@@ -296,6 +367,60 @@ Mesh* Mesh::transformed( const Matrix4& transform ) const
     return mesh;
 }
 
+// ** Mesh::instantiate
+Mesh* Mesh::instantiate( const Matrix4& transform ) const
+{
+    // ** Instances of instances share a geometry with a root prototype
+    const Mesh* prototype = m_prototype ? m_prototype : this;
+
+    Mesh* mesh          = new Mesh;
+    mesh->m_prototype   = prototype;
+    mesh->m_transform   = m_prototype ? transform * m_transform : transform;
+    mesh->m_bounds      = prototype->bounds() * mesh->m_transform;
+
+    return mesh;
+}
+
+// ** Mesh::prototype
+const Mesh* Mesh::prototype( void ) const
+{
+    return m_prototype;
+}
+
+// ** Mesh::instanceTransform
+const Matrix4& Mesh::instanceTransform( void ) const
+{
+    return m_transform;
+}
+
+// ** Mesh::setInstanceTransform
+void Mesh::setInstanceTransform( const Matrix4& value )
+{
+    assert( m_prototype != NULL );
+
+    m_transform = value;
+    m_bounds    = m_prototype->bounds() * m_transform;
+}
+
+// ** Mesh::worldPosition
+Vec3 Mesh::worldPosition( const Vec3& position ) const
+{
+    return m_prototype ? m_transform * position : position;
+}
+
+// ** Mesh::worldNormal
+Vec3 Mesh::worldNormal( const Vec3& normal ) const
+{
+    if( !m_prototype ) {
+        return normal;
+    }
+
+    Vec3 result = m_transform.rotate( normal );
+    result.normalize();
+
+    return result;
+}
+
 // ----------------------------------------------- Vertex ----------------------------------------------- //
 
 // ** Vertex::interpolate
@@ -175,6 +175,7 @@ namespace relight {
     friend class Lightmap;
     friend class Photonmap;
 	friend class Radiancemap;
+    friend class Scene;
     public:
 
         //! Returns a mesh bounds.
@@ -228,15 +229,44 @@ namespace relight {
         //! Creates a clone of this mesh with applied transform.
         Mesh*               transformed( const Matrix4& transform ) const;
 
+        //! Creates an instance of this mesh that shares it's geometry.
+        /*!
+         Instance vertices and faces stay in a prototype space, use worldPosition and worldNormal
+         to transform them. An instance has it's own bounds, lightmap, photonmap and user data.
+         A prototype mesh should not be modified or destroyed while it has instances.
+         */
+        Mesh*               instantiate( const Matrix4& transform ) const;
+
+        //! Returns a prototype mesh of an instance or NULL for a regular mesh.
+        const Mesh*         prototype( void ) const;
+
+        //! Returns an instance transform.
+        const Matrix4&      instanceTransform( void ) const;
+
+        //! Sets a prototype to world space transform of an instance and updates instance bounds.
+        void                setInstanceTransform( const Matrix4& value );
+
+        //! Transforms a prototype space position to a world space.
+        Vec3                worldPosition( const Vec3& position ) const;
+
+        //! Transforms a prototype space normal to a world space.
+        Vec3                worldNormal( const Vec3& normal ) const;
+
         //! Sets a material for entire mesh.
         void                overrideMaterial( const Material* material );
 
+        //! Returns true if any of mesh materials has an alpha channel.
+        bool                hasAlpha( void ) const;
+
         //! Returns a user data.
         void*               userData( void ) const;
 
         //! Sets a user data.
         void                setUserData( void* value );
 
+        //! Returns a scene id of this mesh, it's kept when other meshes are removed from a scene.
+        int                 id( void ) const;
+
         //! Generates the unique UV set for this mesh.
         void                generateUv( float angle = 88.0f, float margin = 0.0f, float padding = 0.0f );
 
@@ -264,6 +294,9 @@ namespace relight {
 		//! Sets a target radiance map.
 		void				setRadiancemap( Radiancemap* value );
 
+        //! Sets a scene id of this mesh.
+        void                setId( int value );
+
         //! Builds a mesh faces array.
         void                buildFaces( void );
 
@@ -292,6 +325,15 @@ namespace relight {
 
         //! User data associated with this instance.
         void*               m_userData;
+
+        //! A mesh that shares it's geometry with this instance.
+        const Mesh*         m_prototype;
+
+        //! Instance transform.
+        Matrix4             m_transform;
+
+        //! Scene id assigned when a mesh is added to a scene.
+        int                 m_id;
     };
 
 } // namespace relight
@@ -28,17 +28,29 @@
 
 #include "Scene.h"
 #include "Mesh.h"
+#include "Light.h"
+#include "LightTree.h"
 #include "../Lightmap.h"
 #include "../rt/Embree.h"
+#include "../rt/Bvh.h"
+#include "../rt/Profiler.h"
+#include "../Statistics.h"
 
 namespace relight {
 
 // ** Scene::Scene
-Scene::Scene( void ) : m_state( StateInitial ), m_tracer( NULL )
+Scene::Scene( TracerBackend backend, SceneMode mode ) : m_nextMeshId( 0 ), m_lightTree( new LightTree ), m_lightsChanged( false ), m_mode( mode ), m_state( StateInitial ), m_backend( backend ), m_tracer( NULL )
 {
 
 }
 
+// ** Scene::~Scene
+Scene::~Scene( void )
+{
+    delete m_tracer;
+    delete m_lightTree;
+}
+
 // ** Scene::tracer
 rt::ITracer* Scene::tracer( void ) const
 {
@@ -64,6 +76,12 @@ const Light* Scene::light( int index ) const
     return m_lights[index];
 }
 
+// ** Scene::lightTree
+const LightTree* Scene::lightTree( void ) const
+{
+    return m_lightTree;
+}
+
 // ** Scene::meshCount
 int Scene::meshCount( void ) const
 {
@@ -91,19 +109,178 @@ void Scene::updateBounds( void )
 RelightStatus Scene::addLight( const Light* light )
 {
     m_lights.push_back( light );
+    m_lightsChanged = isDynamic();
 	return RelightSuccess;
 }
 
 // ** Scene::addMesh
 Mesh* Scene::addMesh( const Mesh* mesh, const Matrix4& transform, const Material* material )
 {
-    Mesh* transformed = mesh->transformed( transform );
+    Mesh* placed = NULL;
+
     if( material ) {
-        transformed->overrideMaterial( material );
+        placed = mesh->transformed( transform );
+        placed->overrideMaterial( material );
+    } else {
+        placed = mesh->instantiate( transform );
+    }
+
+    placed->setId( m_nextMeshId++ );
+    m_meshes.push_back( placed );
+    updateBounds();
+
+    // ** Meshes added to a dynamic scene are traced after a next update
+    if( isDynamic() ) {
+        m_tracer->addMesh( placed );
+        recordChange( placed, placed->bounds() );
+    }
+
+    return placed;
+}
+
+// ** Scene::isDynamic
+bool Scene::isDynamic( void ) const
+{
+    return m_mode == SceneDynamic && m_state == StateReadyToBake;
+}
+
+// ** Scene::removeMesh
+RelightStatus Scene::removeMesh( const Mesh* mesh )
+{
+    Array<const Mesh*>::iterator i = std::find( m_meshes.begin(), m_meshes.end(), mesh );
+
+    if( !isDynamic() || i == m_meshes.end() ) {
+        return RelightInvalidCall;
+    }
+
+    m_meshes.erase( i );
+    m_tracer->removeMesh( mesh );
+    recordChange( NULL, mesh->bounds() );
+    updateBounds();
+
+    return RelightSuccess;
+}
+
+// ** Scene::setMeshTransform
+RelightStatus Scene::setMeshTransform( Mesh* mesh, const Matrix4& transform )
+{
+    if( !isDynamic() || !mesh->prototype() ) {
+        return RelightInvalidCall;
     }
-    m_meshes.push_back( transformed );
+
+    // ** Both an old and a new mesh location are changed
+    Bounds bounds = mesh->bounds();
+    mesh->setInstanceTransform( transform );
+    bounds += mesh->bounds();
+
+    m_tracer->updateMesh( mesh );
+    recordChange( mesh, bounds );
     updateBounds();
-    return transformed;
+
+    return RelightSuccess;
+}
+
+// ** Scene::removeLight
+RelightStatus Scene::removeLight( const Light* light )
+{
+    Array<const Light*>::iterator i = std::find( m_lights.begin(), m_lights.end(), light );
+
+    if( !isDynamic() || i == m_lights.end() ) {
+        return RelightInvalidCall;
+    }
+
+    m_lights.erase( i );
+    m_lightsChanged = true;
+
+    return RelightSuccess;
+}
+
+// ** Scene::invalidateLight
+RelightStatus Scene::invalidateLight( const Light* light )
+{
+    if( !isDynamic() || std::find( m_lights.begin(), m_lights.end(), light ) == m_lights.end() ) {
+        return RelightInvalidCall;
+    }
+
+    m_lightsChanged = true;
+
+    return RelightSuccess;
+}
+
+// ** Scene::recordChange
+void Scene::recordChange( const Mesh* mesh, const Bounds& bounds )
+{
+    Change change;
+    change.m_mesh   = mesh;
+    change.m_bounds = bounds;
+    m_changes.push_back( change );
+}
+
+// ** Scene::isAffected
+bool Scene::isAffected( const Mesh* mesh, const Bounds& region, float influenceDistance ) const
+{
+    // ** Nearby surfaces receive occlusion and bounced light from a changed region
+    if( region.intersects( mesh->bounds().expanded( influenceDistance ) ) ) {
+        return true;
+    }
+
+    // ** A changed region casts or stops casting shadows to a mesh
+    for( int i = 0, n = lightCount(); i < n; i++ ) {
+        const Light* light = m_lights[i];
+
+        if( light->castsShadow() && region.intersects( light->influence()->shadowBounds( mesh->bounds() ) ) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ** Scene::update
+RelightStatus Scene::update( float influenceDistance )
+{
+    if( !isDynamic() ) {
+        return RelightInvalidCall;
+    }
+
+    m_tracer->update();
+    m_invalidated.clear();
+
+    if( m_lightsChanged ) {
+        m_lightTree->build( m_lights, m_bounds );
+    }
+
+    for( int i = 0, n = meshCount(); i < n; i++ ) {
+        const Mesh* mesh    = m_meshes[i];
+        bool        invalid = m_lightsChanged;
+
+        for( int j = 0, nchanges = ( int )m_changes.size(); j < nchanges && !invalid; j++ ) {
+            const Change& change = m_changes[j];
+            invalid = change.m_mesh == mesh || isAffected( mesh, change.m_bounds, influenceDistance );
+        }
+
+        if( invalid ) {
+            m_invalidated.push_back( mesh );
+        }
+    }
+
+    m_changes.clear();
+    m_lightsChanged = false;
+
+    return RelightSuccess;
+}
+
+// ** Scene::invalidatedMeshCount
+int Scene::invalidatedMeshCount( void ) const
+{
+    return ( int )m_invalidated.size();
+}
+
+// ** Scene::invalidatedMesh
+const Mesh* Scene::invalidatedMesh( int index ) const
+{
+    assert( index >= 0 && index < invalidatedMeshCount() );
+    return m_invalidated[index];
 }
 
 // ** Scene::begin
@@ -125,8 +302,22 @@ RelightStatus Scene::end( void )
         return RelightInvalidCall;
     }
 
-    // ** Create a tracer
-    m_tracer = new rt::Embree;
+    // ** Create a tracer, the built-in one is used when compiled without Embree
+#if RELIGHT_USE_EMBREE
+    if( m_backend == TracerEmbree ) {
+        m_tracer = new rt::Embree( m_mode == SceneDynamic );
+    } else {
+        m_tracer = new rt::Bvh;
+    }
+#else
+    m_tracer = new rt::Bvh;
+#endif
+
+    // ** Record tracer build and ray statistics
+    if( Statistics::isEnabled() ) {
+        m_tracer = new rt::Profiler( m_tracer );
+    }
+
     m_tracer->begin();
 
     for( int i = 0, n = ( int )m_meshes.size(); i < n; i++ ) {
@@ -135,6 +326,9 @@ RelightStatus Scene::end( void )
 
     m_tracer->end();
 
+    // ** Cluster scene lights
+    m_lightTree->build( m_lights, m_bounds );
+
     // ** Switch scene state
     m_state = StateReadyToBake;
 
@@ -39,6 +39,9 @@ namespace relight {
     friend class Relight;
     public:
 
+                                //! Destroys a scene tracer and light clusters, meshes and lights stay owned by a caller.
+                                ~Scene( void );
+
         //! Returns a tracer.
         rt::ITracer*            tracer( void ) const;
 
@@ -56,9 +59,12 @@ namespace relight {
         RelightStatus           end( void );
 
         /*!
-         Creates a new Mesh and places it on scene.
+         Creates a new Mesh and places it on scene. Placements without a material override become
+         instances that share a mesh geometry and a ray tracing acceleration structure, so a mesh
+         data should outlive a scene. Overriding a material creates a transformed copy of a mesh.
          \param mesh A mesh data to create an instance from.
          \param transform mesh instance transform.
+         \param material Material to override mesh materials with.
          */
         Mesh*                   addMesh( const Mesh* mesh, const Matrix4& transform, const Material* material = NULL );
 
@@ -74,6 +80,9 @@ namespace relight {
         //! Returns a Light instance by index.
         const Light*            light( int index ) const;
 
+        //! Returns a light tree that clusters scene lights, it's rebuilt by Scene::end and Scene::update.
+        const LightTree*        lightTree( void ) const;
+
         //! Returns a total amount of mesh instances.
         int                     meshCount( void ) const;
 
@@ -83,10 +92,52 @@ namespace relight {
         //! Returns a scene bounding box.
         const Bounds&           bounds( void ) const;
 
+        //! Removes a mesh from a dynamic scene.
+        /*!
+         A removed mesh is not destroyed, so it's lightmap and user data stay valid.
+         */
+        RelightStatus           removeMesh( const Mesh* mesh );
+
+        //! Sets a new transform of a mesh instance placed to a dynamic scene.
+        /*!
+         Only instances can be moved, meshes placed with a material override have their geometry baked to a world space.
+         */
+        RelightStatus           setMeshTransform( Mesh* mesh, const Matrix4& transform );
+
+        //! Removes a light from a dynamic scene.
+        RelightStatus           removeLight( const Light* light );
+
+        //! Notifies a dynamic scene that a light was moved or it's properties were changed, fails for lights not added to this scene.
+        RelightStatus           invalidateLight( const Light* light );
+
+        //! Applies changes made to a dynamic scene after Scene::end and collects invalidated meshes.
+        /*!
+         Changed meshes are invalidated along with meshes that may receive shadows from them. Light distance
+         attenuation never reaches zero, so adding, removing or changing a light invalidates all scene meshes.
+         \param influenceDistance A distance at which changed meshes still affect their surroundings, should
+                be set to a maximum of ambient occlusion and final gather distances if those are rebaked.
+         */
+        RelightStatus           update( float influenceDistance = 0.0f );
+
+        //! Returns an amount of meshes invalidated by the last update.
+        int                     invalidatedMeshCount( void ) const;
+
+        //! Returns a mesh invalidated by the last update.
+        const Mesh*             invalidatedMesh( int index ) const;
+
     private:
 
                                 //! Constructs a new Scene instance.
-                                Scene( void );
+                                Scene( TracerBackend backend, SceneMode mode );
+
+        //! Returns true if scene objects can be changed after a scene construction ended.
+        bool                    isDynamic( void ) const;
+
+        //! Records a mesh change to be applied by a next update.
+        void                    recordChange( const Mesh* mesh, const Bounds& bounds );
+
+        //! Returns true if a given mesh is affected by a change of a given region.
+        bool                    isAffected( const Mesh* mesh, const Bounds& region, float influenceDistance ) const;
 
         //! Updates scene bounds.
         void                    updateBounds( void );
@@ -103,12 +154,39 @@ namespace relight {
         //! Scene mesh instances.
         Array<const Mesh*>      m_meshes;
 
+        //! An id assigned to a next added mesh, ids of removed meshes are not reused.
+        int                     m_nextMeshId;
+
         //! Scene lights.
         Array<const Light*>     m_lights;
 
+        //! Scene light clusters.
+        LightTree*              m_lightTree;
+
+        //! A mesh change made to a dynamic scene.
+        struct Change {
+            const Mesh*         m_mesh;     //!< Changed mesh, NULL for removed meshes.
+            Bounds              m_bounds;   //!< Bounds of a changed region.
+        };
+
+        //! Mesh changes made since the last update.
+        Array<Change>           m_changes;
+
+        //! Lights were added, removed or changed since the last update.
+        bool                    m_lightsChanged;
+
+        //! Meshes invalidated by the last update.
+        Array<const Mesh*>      m_invalidated;
+
+        //! Scene mode.
+        SceneMode               m_mode;
+
         //! Scene state.
         State                   m_state;
 
+        //! Ray tracer backend.
+        TracerBackend           m_backend;
+
         //! Ray tracer instance.
         rt::ITracer*            m_tracer;
 